@@ -0,0 +1,222 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/*
+ * Attribute filter benchmark.  Fills a fresh database in a temporary
+ * directory with geocaches carrying random attributes, then runs filters on
+ * one to four attributes both as compiled by ph_query_compile(), which tests
+ * the attributes_yes and attributes_no bitmasks, and as LIKE patterns on the
+ * attributes text column, which is what the query compiler used to emit.
+ * Both have to find the same geocaches.
+ *
+ * Usage: ph-bench-attrs [CACHES] [ROUNDS]
+ */
+
+/* Includes {{{1 */
+
+#include "ph-bench-db.h"
+#include "ph-geocache.h"
+#include "ph-query.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Filters {{{1 */
+
+/*
+ * Attribute filters in the query language and as LIKE conditions.
+ */
+static const struct {
+    const gchar *query;
+    const gchar *like;
+} ph_bench_filters[] = {
+    { "+dog",
+        "attributes LIKE '%+1;%'" },
+    { "+dog -fee",
+        "attributes LIKE '%+1;%' AND attributes LIKE '%-2;%'" },
+    { "+dog -fee +hike",
+        "attributes LIKE '%+1;%' AND attributes LIKE '%-2;%' "
+        "AND attributes LIKE '%+9;%'" },
+    { "+dog -fee +hike +parking",
+        "attributes LIKE '%+1;%' AND attributes LIKE '%-2;%' "
+        "AND attributes LIKE '%+9;%' AND attributes LIKE '%+25;%'" }
+};
+
+/* Database setup {{{1 */
+
+/*
+ * Store the given number of geocaches with up to eight random attributes
+ * each, two thirds of them set to true.  Returns FALSE on error.
+ */
+static gboolean
+ph_bench_fill(PHDatabase *database,
+              guint caches,
+              GError **error)
+{
+    GRand *rand = g_rand_new_with_seed(1);
+    PHGeocache gc = {0};
+    gboolean success;
+    guint i, j;
+
+    success = ph_database_begin(database, error);
+    for (i = 0; success && i < caches; ++i) {
+        gchar *id = g_strdup_printf("GC%X", 0x10000 + i);
+
+        gc.id = id;
+        gc.name = id;
+        memset(&gc.attributes, 0, sizeof(PHGeocacheAttrs));
+        for (j = g_rand_int_range(rand, 0, 9); j > 0; --j)
+            ph_geocache_attrs_set(&gc.attributes,
+                    g_rand_int_range(rand, 1, PH_GEOCACHE_ATTR_COUNT),
+                    g_rand_int_range(rand, 0, 3) > 0);
+
+        success = ph_geocache_store(&gc, database, error);
+        g_free(id);
+    }
+
+    if (success)
+        success = ph_database_commit(database, error);
+    else
+        (void) ph_database_rollback(database, NULL);
+
+    g_rand_free(rand);
+    return success;
+}
+
+/* Benchmark {{{1 */
+
+/*
+ * Run a counting query the given number of times.  Returns the number of
+ * rows counted, or -1 on error.  The time per run in milliseconds is stored
+ * in elapsed.
+ */
+static gint64
+ph_bench_count(PHDatabase *database,
+               const gchar *query,
+               guint rounds,
+               gdouble *elapsed,
+               GError **error)
+{
+    sqlite3_stmt *stmt;
+    GTimer *timer;
+    gint64 result = -1;
+    guint i;
+
+    stmt = ph_database_prepare(database, query, error);
+    if (stmt == NULL)
+        return -1;
+
+    timer = g_timer_new();
+    for (i = 0; i < rounds; ++i) {
+        if (ph_database_step(database, stmt, error) != SQLITE_ROW) {
+            result = -1;
+            break;
+        }
+        result = sqlite3_column_int64(stmt, 0);
+        (void) sqlite3_reset(stmt);
+    }
+    *elapsed = g_timer_elapsed(timer, NULL) * 1000 / rounds;
+
+    g_timer_destroy(timer);
+    (void) sqlite3_finalize(stmt);
+    return result;
+}
+
+/*
+ * Time each filter both ways and print the results.  Returns FALSE on error.
+ */
+static gboolean
+ph_bench_run(PHDatabase *database,
+             guint rounds,
+             GError **error)
+{
+    gdouble like_time, mask_time;
+    gint64 like_count, mask_count;
+    gchar *like, *mask;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(ph_bench_filters); ++i) {
+        mask = ph_query_compile(ph_bench_filters[i].query,
+                PH_DATABASE_TABLE_GEOCACHES, "COUNT(*)", error);
+        if (mask == NULL)
+            return FALSE;
+        like = g_strconcat("SELECT COUNT(*) FROM geocaches WHERE ",
+                ph_bench_filters[i].like, NULL);
+
+        like_count = ph_bench_count(database, like, rounds, &like_time,
+                error);
+        mask_count = (like_count < 0) ? -1 :
+            ph_bench_count(database, mask, rounds, &mask_time, error);
+        g_free(like);
+        g_free(mask);
+        if (mask_count < 0)
+            return FALSE;
+
+        if (mask_count != like_count) {
+            g_set_error(error, PH_DATABASE_ERROR,
+                    PH_DATABASE_ERROR_INCONSISTENT,
+                    "Filter `%s' finds %" G_GINT64_FORMAT " geocaches, "
+                    "but %" G_GINT64_FORMAT " with LIKE",
+                    ph_bench_filters[i].query, mask_count, like_count);
+            return FALSE;
+        }
+
+        printf("%-28s %8" G_GINT64_FORMAT " caches  LIKE %8.2f ms  "
+                "bitmask %8.2f ms  %5.1fx\n", ph_bench_filters[i].query,
+                mask_count, like_time, mask_time,
+                (mask_time > 0) ? like_time / mask_time : 0.0);
+    }
+
+    return TRUE;
+}
+
+/* Main program {{{1 */
+
+int
+main(int argc,
+     char **argv)
+{
+    GError *error = NULL;
+    PHDatabase *database = NULL;
+    gchar *directory = NULL;
+    guint caches = 100000, rounds = 10;
+    gboolean success;
+
+    if (argc > 1)
+        caches = MAX(atoi(argv[1]), 1);
+    if (argc > 2)
+        rounds = MAX(atoi(argv[2]), 1);
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+
+    database = ph_bench_db_open(&directory, &error);
+    success = (database != NULL);
+
+    if (success)
+        success = ph_bench_fill(database, caches, &error);
+    if (success)
+        success = ph_bench_run(database, rounds, &error);
+
+    ph_bench_db_cleanup(database, directory);
+
+    if (!success) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
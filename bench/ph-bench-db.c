@@ -0,0 +1,75 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/*
+ * Fresh database in a temporary directory, shared by the benchmarks which
+ * need one.
+ */
+
+/* Includes {{{1 */
+
+#include "ph-bench-db.h"
+#include <glib/gstdio.h>
+
+/* Public interface {{{1 */
+
+/*
+ * Create a temporary directory and an empty database in it.  The directory
+ * is returned even if the database cannot be opened, so that
+ * ph_bench_db_cleanup() can remove it.  Returns NULL on error.
+ */
+PHDatabase *
+ph_bench_db_open(gchar **directory,
+                 GError **error)
+{
+    PHDatabase *result;
+    gchar *filename;
+
+    *directory = g_dir_make_tmp("ph-bench-XXXXXX", error);
+    if (*directory == NULL)
+        return NULL;
+
+    filename = g_build_filename(*directory, "bench.db", NULL);
+    result = ph_database_new(filename, TRUE, error);
+    g_free(filename);
+
+    return result;
+}
+
+/*
+ * Close the database, if any, and remove it together with its write-ahead
+ * log and the temporary directory, which is freed.
+ */
+void
+ph_bench_db_cleanup(PHDatabase *database,
+                    gchar *directory)
+{
+    static const gchar *suffixes[] = { "", "-wal", "-shm" };
+    gchar *filename;
+    guint i;
+
+    if (database != NULL)
+        g_object_unref(database);
+    if (directory == NULL)
+        return;
+
+    for (i = 0; i < G_N_ELEMENTS(suffixes); ++i) {
+        filename = g_strconcat(directory, G_DIR_SEPARATOR_S, "bench.db",
+                suffixes[i], NULL);
+        (void) g_remove(filename);
+        g_free(filename);
+    }
+    (void) g_rmdir(directory);
+    g_free(directory);
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -0,0 +1,29 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+#ifndef PH_BENCH_DB_H
+#define PH_BENCH_DB_H
+
+/* Includes {{{1 */
+
+#include "ph-database.h"
+
+/* Public interface {{{1 */
+
+PHDatabase *ph_bench_db_open(gchar **directory,
+                             GError **error);
+void ph_bench_db_cleanup(PHDatabase *database,
+                         gchar *directory);
+
+/* }}} */
+
+#endif
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -0,0 +1,340 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/*
+ * Generator for synthetic pocket queries in the format Groundspeak uses, as
+ * input for ph-bench-import.  The same options and seed always produce the
+ * same file.
+ *
+ * Usage: ph-bench-gpx [OPTION...] [FILE]
+ */
+
+/* Includes {{{1 */
+
+#include "ph-gpx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Options {{{1 */
+
+static gint ph_bench_caches = 1000;
+static gint ph_bench_logs = 20;
+static gint ph_bench_description = 2000;
+static gint ph_bench_waypoints = 1;
+static gint ph_bench_trackables = 1;
+static gint ph_bench_seed = 1;
+
+static GOptionEntry ph_bench_options[] = {
+    { "caches", 'c', 0, G_OPTION_ARG_INT, &ph_bench_caches,
+        "Number of geocaches (default 1000)", "N" },
+    { "logs", 'l', 0, G_OPTION_ARG_INT, &ph_bench_logs,
+        "Logs per geocache (default 20)", "N" },
+    { "description", 'd', 0, G_OPTION_ARG_INT, &ph_bench_description,
+        "Average size of long descriptions in bytes (default 2000)", "BYTES" },
+    { "waypoints", 'w', 0, G_OPTION_ARG_INT, &ph_bench_waypoints,
+        "Additional waypoints per geocache (default 1)", "N" },
+    { "trackables", 't', 0, G_OPTION_ARG_INT, &ph_bench_trackables,
+        "Trackables per geocache (default 1)", "N" },
+    { "seed", 's', 0, G_OPTION_ARG_INT, &ph_bench_seed,
+        "Seed of the random number generator (default 1)", "N" },
+    { NULL }
+};
+
+/* Vocabulary {{{1 */
+
+/*
+ * Words descriptions, hints and logs are made of, NULL-terminated.
+ */
+static const gchar *ph_bench_words[] = {
+    "the", "cache", "is", "hidden", "near", "a", "small", "tree", "behind",
+    "old", "wall", "bring", "your", "own", "pen", "thanks", "for", "nice",
+    "walk", "found", "it", "quickly", "after", "some", "searching", "muggles",
+    "around", "log", "was", "wet", "please", "replace", "carefully", "TFTC",
+    "bridge", "river", "forest", "path", "view", "hill", "bench", "stone",
+    NULL
+};
+
+/*
+ * Strings from a table, in table order.
+ */
+typedef struct _PHBenchStrings {
+    const gchar *text[32];
+    guint count;
+} PHBenchStrings;
+
+/* Forward declarations {{{1 */
+
+static void ph_bench_collect(PHBenchStrings *strings,
+                             const PHXmlStringTable *table,
+                             gboolean skip_first);
+static const gchar *ph_bench_pick(GRand *rand,
+                                  const PHBenchStrings *strings);
+static void ph_bench_write_text(FILE *out, GRand *rand, gint length);
+static void ph_bench_write_time(FILE *out, const gchar *element, glong time);
+static void ph_bench_write_geocache(FILE *out, GRand *rand, guint index);
+
+/* Tables {{{1 */
+
+static PHBenchStrings ph_bench_waypoint_types;
+static PHBenchStrings ph_bench_geocache_types;
+static PHBenchStrings ph_bench_geocache_sizes;
+static PHBenchStrings ph_bench_log_types;
+
+/*
+ * Copy the primary strings of a table.  Tables listing the usual case first
+ * can have it skipped; it is chosen separately.
+ */
+static void
+ph_bench_collect(PHBenchStrings *strings,
+                 const PHXmlStringTable *table,
+                 gboolean skip_first)
+{
+    const PHXmlStringTable *entry;
+
+    strings->count = 0;
+    for (entry = table + (skip_first ? 1 : 0); entry->value != 0; ++entry)
+        if (entry->primary != NULL &&
+                strings->count < G_N_ELEMENTS(strings->text))
+            strings->text[strings->count++] = entry->primary;
+}
+
+/*
+ * Choose one of the strings at random.
+ */
+static const gchar *
+ph_bench_pick(GRand *rand,
+              const PHBenchStrings *strings)
+{
+    return strings->text[g_rand_int_range(rand, 0, strings->count)];
+}
+
+/* Output {{{1 */
+
+/*
+ * Write about length bytes of random words.
+ */
+static void
+ph_bench_write_text(FILE *out,
+                    GRand *rand,
+                    gint length)
+{
+    gint written = 0;
+
+    while (written < length) {
+        const gchar *word = ph_bench_words[g_rand_int_range(rand, 0,
+                G_N_ELEMENTS(ph_bench_words) - 1)];
+
+        if (written > 0)
+            written += fprintf(out, " ");
+        written += fprintf(out, "%s", word);
+    }
+}
+
+/*
+ * Write an element containing a UTC timestamp.
+ */
+static void
+ph_bench_write_time(FILE *out,
+                    const gchar *element,
+                    glong time)
+{
+    GTimeVal value = {time, 0};
+    gchar *text = g_time_val_to_iso8601(&value);
+
+    fprintf(out, "<%s>%s</%s>\n", element, text, element);
+    g_free(text);
+}
+
+/*
+ * Write a geocache with its logs and trackables, followed by its additional
+ * waypoints.
+ */
+static void
+ph_bench_write_geocache(FILE *out,
+                        GRand *rand,
+                        guint index)
+{
+    const gchar *type;
+    gchar code[16];
+    glong placed, logged;
+    gdouble lat, lon;
+    gint i, finder;
+
+    g_snprintf(code, sizeof(code), "GC%X", 0x10000 + index);
+    placed = 1009843200 + g_rand_int_range(rand, 0, 10 * 365) * 86400;
+    lat = g_rand_double_range(rand, 46.5, 49.0);
+    lon = g_rand_double_range(rand, 9.5, 17.0);
+    type = (g_rand_int_range(rand, 0, 2) == 0) ? "Traditional Cache" :
+        ph_bench_pick(rand, &ph_bench_geocache_types);
+
+    fprintf(out, "  <wpt lat=\"%.6f\" lon=\"%.6f\">\n    ", lat, lon);
+    ph_bench_write_time(out, "time", placed);
+    fprintf(out, "    <name>%s</name>\n"
+            "    <desc>Cache %u by Owner %u</desc>\n"
+            "    <url>http://www.geocaching.com/seek/cache_details.aspx"
+            "?guid=%08x-0000-0000-0000-%012x</url>\n"
+            "    <urlname>Cache %u</urlname>\n"
+            "    <sym>%s</sym>\n"
+            "    <type>Geocache|%s</type>\n",
+            code, index, index % 97, index, index, index,
+            (g_rand_int_range(rand, 0, 10) == 0) ? "Geocache Found" :
+                "Geocache", type);
+    fprintf(out, "    <groundspeak:cache id=\"%u\" available=\"True\" "
+            "archived=\"False\" "
+            "xmlns:groundspeak=\"http://www.groundspeak.com/cache/1/0/1\">\n"
+            "      <groundspeak:name>Cache %u</groundspeak:name>\n"
+            "      <groundspeak:placed_by>Owner %u</groundspeak:placed_by>\n"
+            "      <groundspeak:owner id=\"%u\">Owner %u</groundspeak:owner>\n"
+            "      <groundspeak:type>%s</groundspeak:type>\n"
+            "      <groundspeak:container>%s</groundspeak:container>\n"
+            "      <groundspeak:attributes>\n",
+            index, index, index % 97, index % 97, index % 97, type,
+            ph_bench_pick(rand, &ph_bench_geocache_sizes));
+    for (i = g_rand_int_range(rand, 0, 6); i > 0; --i)
+        fprintf(out, "        <groundspeak:attribute id=\"%d\" inc=\"%d\">"
+                "Attribute</groundspeak:attribute>\n",
+                g_rand_int_range(rand, 1, 70), g_rand_int_range(rand, 0, 2));
+    fprintf(out, "      </groundspeak:attributes>\n"
+            "      <groundspeak:difficulty>%.1f</groundspeak:difficulty>\n"
+            "      <groundspeak:terrain>%.1f</groundspeak:terrain>\n"
+            "      <groundspeak:country>Austria</groundspeak:country>\n"
+            "      <groundspeak:state>Wien</groundspeak:state>\n"
+            "      <groundspeak:short_description html=\"True\">",
+            g_rand_int_range(rand, 2, 11) / 2.0,
+            g_rand_int_range(rand, 2, 11) / 2.0);
+    ph_bench_write_text(out, rand, 100);
+    fprintf(out, "</groundspeak:short_description>\n"
+            "      <groundspeak:long_description html=\"True\">"
+            "&lt;p&gt;");
+    ph_bench_write_text(out, rand, g_rand_int_range(rand,
+                ph_bench_description / 2, ph_bench_description * 3 / 2 + 1));
+    fprintf(out, "&lt;/p&gt;</groundspeak:long_description>\n"
+            "      <groundspeak:encoded_hints>");
+    ph_bench_write_text(out, rand, 30);
+    fprintf(out, "</groundspeak:encoded_hints>\n"
+            "      <groundspeak:logs>\n");
+
+    /* newest first, as in pocket queries */
+    logged = 1349049600;
+    for (i = 0; i < ph_bench_logs; ++i) {
+        logged -= g_rand_int_range(rand, 0, 30) * 86400;
+        finder = g_rand_int_range(rand, 0, 5000);
+        fprintf(out, "        <groundspeak:log id=\"%u\">\n          ",
+                index * ph_bench_logs + i);
+        ph_bench_write_time(out, "groundspeak:date", MAX(logged, placed));
+        fprintf(out, "          <groundspeak:type>%s</groundspeak:type>\n"
+                "          <groundspeak:finder id=\"%d\">Finder %d"
+                "</groundspeak:finder>\n"
+                "          <groundspeak:text encoded=\"False\">",
+                (g_rand_int_range(rand, 0, 4) != 0) ? "Found it" :
+                    ph_bench_pick(rand, &ph_bench_log_types),
+                finder, finder);
+        ph_bench_write_text(out, rand, g_rand_int_range(rand, 20, 400));
+        fprintf(out, "</groundspeak:text>\n"
+                "        </groundspeak:log>\n");
+    }
+
+    fprintf(out, "      </groundspeak:logs>\n"
+            "      <groundspeak:travelbugs>\n");
+    for (i = 0; i < ph_bench_trackables; ++i)
+        fprintf(out, "        <groundspeak:travelbug id=\"%u\" ref=\"TB%X\">\n"
+                "          <groundspeak:name>Bug %u</groundspeak:name>\n"
+                "        </groundspeak:travelbug>\n",
+                index * ph_bench_trackables + i,
+                0x10000 + index * ph_bench_trackables + i,
+                index * ph_bench_trackables + i);
+    fprintf(out, "      </groundspeak:travelbugs>\n"
+            "    </groundspeak:cache>\n"
+            "  </wpt>\n");
+
+    for (i = 0; i < ph_bench_waypoints; ++i) {
+        type = ph_bench_pick(rand, &ph_bench_waypoint_types);
+        fprintf(out, "  <wpt lat=\"%.6f\" lon=\"%.6f\">\n    ",
+                lat + g_rand_double_range(rand, -0.01, 0.01),
+                lon + g_rand_double_range(rand, -0.01, 0.01));
+        ph_bench_write_time(out, "time", placed);
+        fprintf(out, "    <name>%02d%s</name>\n"
+                "    <cmt>", i % 100, code + 2);
+        ph_bench_write_text(out, rand, 60);
+        fprintf(out, "</cmt>\n"
+                "    <desc>%s</desc>\n"
+                "    <url>http://www.geocaching.com/seek/wpt.aspx"
+                "?WID=%08x</url>\n"
+                "    <urlname>%s</urlname>\n"
+                "    <sym>%s</sym>\n"
+                "    <type>Waypoint|%s</type>\n"
+                "  </wpt>\n", type, index, type, type, type);
+    }
+}
+
+/* Main program {{{1 */
+
+int
+main(int argc,
+     char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GRand *rand;
+    FILE *out = stdout;
+    guint i;
+
+    context = g_option_context_new("[FILE] - generate a pocket query");
+    g_option_context_add_main_entries(context, ph_bench_options, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return EXIT_FAILURE;
+    }
+    g_option_context_free(context);
+
+    if (argc > 1 && strcmp(argv[1], "-") != 0) {
+        out = fopen(argv[1], "w");
+        if (out == NULL) {
+            perror(argv[1]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    ph_bench_collect(&ph_bench_waypoint_types, ph_gpx_waypoint_types, TRUE);
+    ph_bench_collect(&ph_bench_geocache_types, ph_gpx_geocache_types, FALSE);
+    ph_bench_collect(&ph_bench_geocache_sizes, ph_gpx_geocache_sizes, FALSE);
+    ph_bench_collect(&ph_bench_log_types, ph_gpx_log_types, FALSE);
+
+    rand = g_rand_new_with_seed(ph_bench_seed);
+
+    fprintf(out, "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+            "<gpx xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\" "
+            "version=\"1.0\" creator=\"Groundspeak Pocket Query\" "
+            "xmlns=\"http://www.topografix.com/GPX/1/0\">\n"
+            "  <name>Synthetic Pocket Query</name>\n"
+            "  <desc>Geocache file generated by ph-bench-gpx</desc>\n"
+            "  <author>Groundspeak</author>\n"
+            "  <email>contact@groundspeak.com</email>\n"
+            "  <time>2012-10-01T00:00:00Z</time>\n");
+    for (i = 0; i < (guint) MAX(ph_bench_caches, 0); ++i)
+        ph_bench_write_geocache(out, rand, i);
+    fprintf(out, "</gpx>\n");
+
+    g_rand_free(rand);
+
+    if (fclose(out) != 0) {
+        perror((argc > 1) ? argv[1] : "stdout");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
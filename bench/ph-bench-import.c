@@ -0,0 +1,200 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/*
+ * Import throughput benchmark.  Runs PHImportProcess without a user interface
+ * on a fresh database in a temporary directory and prints the throughput,
+ * the peak memory usage and the time spent in each phase of the import.
+ * Input files can be created with ph-bench-gpx.  With several threads, the
+ * phase times add up the time spent in all of them.  Set COMPRESS to 1 to
+ * store long texts compressed; the size of the resulting database is printed
+ * either way.
+ *
+ * Usage: ph-bench-import FILE [THREADS] [COMPRESS]
+ */
+
+/* Includes {{{1 */
+
+#include "ph-bench-db.h"
+#include "ph-import-process.h"
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+/* Database size {{{1 */
+
+/*
+ * Get the size of the database in bytes, counting pages which are still in
+ * the write-ahead log.  Returns -1 on error.
+ */
+static gint64
+ph_bench_database_size(PHDatabase *database,
+                       GError **error)
+{
+    sqlite3_stmt *stmt;
+    gint64 result = -1;
+
+    stmt = ph_database_prepare(database, "SELECT page_count * page_size "
+            "FROM pragma_page_count(), pragma_page_size()", error);
+    if (stmt == NULL)
+        return -1;
+
+    if (ph_database_step(database, stmt, error) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+
+    (void) sqlite3_finalize(stmt);
+    return result;
+}
+
+/* Process signal handlers {{{1 */
+
+/*
+ * Keep the first error reported by the import.
+ */
+static void
+ph_bench_error(PHProcess *process,
+               GError *error_in,
+               gpointer data)
+{
+    GError **error_out = (GError **) data;
+
+    if (*error_out == NULL)
+        *error_out = g_error_copy(error_in);
+}
+
+/*
+ * Stop the main loop when the import has finished.
+ */
+static void
+ph_bench_stop(PHProcess *process,
+              gpointer data)
+{
+    g_main_loop_quit((GMainLoop *) data);
+}
+
+/* Benchmark {{{1 */
+
+/*
+ * Import path into database with the given number of threads and print the
+ * results.  Returns FALSE on error.
+ */
+static gboolean
+ph_bench_run(PHDatabase *database,
+             const gchar *path,
+             guint threads,
+             GError **error)
+{
+    GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+    PHProcess *process;
+    PHImportProfile *profile;
+    GTimer *timer;
+    GStatBuf buf;
+    struct rusage usage;
+    gdouble elapsed, mib;
+    gint64 caches, size = -1;
+
+    if (g_stat(path, &buf) != 0) {
+        g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                "Cannot access %s: %s", path, g_strerror(errno));
+        return FALSE;
+    }
+    mib = buf.st_size / 1048576.0;
+
+    process = ph_import_process_new(database, path);
+    g_object_set(process, "threads", threads, "profile", TRUE, NULL);
+    g_signal_connect(process, "error-notify",
+            G_CALLBACK(ph_bench_error), error);
+    g_signal_connect(process, "stop-notify",
+            G_CALLBACK(ph_bench_stop), loop);
+
+    timer = g_timer_new();
+    ph_process_start(process);
+    g_main_loop_run(loop);
+    elapsed = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
+    g_main_loop_unref(loop);
+
+    if (*error == NULL) {
+        caches = ph_database_count_rows(database, PH_DATABASE_TABLE_GEOCACHES,
+                error);
+        if (caches >= 0)
+            size = ph_bench_database_size(database, error);
+        profile = ph_import_process_get_profile(PH_IMPORT_PROCESS(process));
+        (void) getrusage(RUSAGE_SELF, &usage);
+
+        if (size >= 0) {
+            printf("%-16s %10" G_GINT64_FORMAT " caches  %8.2f s  "
+                    "%9.0f caches/s  %7.2f MB/s  peak RSS %ld MiB\n",
+                    "import", caches, elapsed,
+                    (elapsed > 0) ? caches / elapsed : 0.0,
+                    (elapsed > 0) ? mib / elapsed : 0.0,
+                    usage.ru_maxrss / 1024);
+            printf("%-16s parse %8.2f s  string lookup %8.2f s  "
+                    "SQL %8.2f s\n", "phases",
+                    ph_import_profile_get_parse_time(profile),
+                    ph_import_profile_get_lookup_time(profile),
+                    ph_import_profile_get_store_time(profile));
+            printf("%-16s %8.2f MiB  compressed texts %s\n", "database",
+                    size / 1048576.0,
+                    ph_database_get_compress_texts(database) ? "on" : "off");
+        }
+    }
+
+    g_object_unref(process);
+    return (*error == NULL);
+}
+
+/* Main program {{{1 */
+
+int
+main(int argc,
+     char **argv)
+{
+    GError *error = NULL;
+    PHDatabase *database = NULL;
+    gchar *directory = NULL;
+    guint threads = 1;
+    gboolean success;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s FILE [THREADS] [COMPRESS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (argc > 2)
+        threads = MAX(atoi(argv[2]), 1);
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+
+    database = ph_bench_db_open(&directory, &error);
+    success = (database != NULL);
+
+    if (success && argc > 3)
+        ph_database_set_compress_texts(database, atoi(argv[3]) != 0);
+    if (success)
+        success = ph_bench_run(database, argv[1], threads, &error);
+
+    ph_bench_db_cleanup(database, directory);
+
+    if (!success) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -0,0 +1,313 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/*
+ * Store path benchmark.  Writes the same synthetic records to a fresh
+ * database in a temporary directory once with ph_geocache_store(),
+ * ph_waypoint_store() and ph_log_store(), which build and run a new
+ * statement for every row, and once with PHImportWriter, which binds to
+ * statements prepared in advance.  Each path stores the records twice, the
+ * second time with changed texts so that every row is updated, and the rows
+ * per second of both passes are printed.  Both paths have to leave the same
+ * number of rows behind.
+ *
+ * Usage: ph-bench-store [RECORDS] [LOGS]
+ */
+
+/* Includes {{{1 */
+
+#include "ph-bench-db.h"
+#include "ph-import-writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Synthetic records {{{1 */
+
+/*
+ * Set of records sharing one arena.
+ */
+typedef struct _PHBenchRecords {
+    PHImportRecord *records;
+    guint count;
+    guint rows;
+    PHArena *arena;
+} PHBenchRecords;
+
+/*
+ * Create the given number of geocaches with the given number of logs each.
+ * Texts and fingerprints depend on the pass, so that storing the records of
+ * a later pass changes every row.
+ */
+static PHBenchRecords *
+ph_bench_records_new(guint count,
+                     guint logs,
+                     guint pass)
+{
+    PHBenchRecords *result = g_new0(PHBenchRecords, 1);
+    GRand *rand = g_rand_new_with_seed(1);
+    gchar *text;
+    guint i, j;
+
+    result->records = g_new0(PHImportRecord, count);
+    result->count = count;
+    result->rows = count * (logs + 2);
+    result->arena = ph_arena_new();
+
+    for (i = 0; i < count; ++i) {
+        PHImportRecord *record = &result->records[i];
+        PHWaypoint *wpt = &record->waypoint;
+        PHGeocache *gc;
+
+        text = g_strdup_printf("GC%X", 0x10000 + i);
+        wpt->id = ph_arena_strdup(result->arena, text);
+        g_free(text);
+        text = g_strdup_printf("Cache %u, pass %u", i, pass);
+        wpt->name = ph_arena_strdup(result->arena, text);
+        g_free(text);
+        wpt->url = ph_arena_strconcat(result->arena,
+                "http://coord.info/", wpt->id, NULL);
+        wpt->placed = 1262304000 + (glong) i * 600;
+        wpt->type = PH_WAYPOINT_TYPE_GEOCACHE;
+        wpt->latitude = g_rand_int_range(rand, -90000000, 90000000);
+        wpt->longitude = g_rand_int_range(rand, -180000000, 180000000);
+
+        gc = ph_arena_alloc0(result->arena, sizeof(PHGeocache));
+        gc->id = wpt->id;
+        gc->name = wpt->name;
+        gc->creator = gc->owner = "bench";
+        gc->type = PH_GEOCACHE_TYPE_TRADITIONAL;
+        gc->size = PH_GEOCACHE_SIZE_SMALL;
+        gc->difficulty = g_rand_int_range(rand, 2, 11) * 5;
+        gc->terrain = g_rand_int_range(rand, 2, 11) * 5;
+        gc->summary = wpt->name;
+        gc->description = ph_arena_strconcat(result->arena, "Description of ",
+                wpt->name, NULL);
+        gc->hint = "Under the rock";
+        gc->available = TRUE;
+        record->geocache = gc;
+
+        record->logs = g_array_sized_new(FALSE, FALSE, sizeof(PHLog), logs);
+        for (j = 0; j < logs; ++j) {
+            PHLog log = {0};
+
+            log.id = i * logs + j + 1;
+            log.geocache_id = wpt->id;
+            log.type = PH_LOG_TYPE_FOUND;
+            log.logger = "bench";
+            log.logged = wpt->placed + (glong) (j + 1) * 86400;
+            log.details = wpt->name;
+            g_array_append_val(record->logs, log);
+        }
+
+        record->arena = result->arena;
+        record->hash = (guint64) pass * count + i + 1;
+    }
+
+    g_rand_free(rand);
+    return result;
+}
+
+/*
+ * Free a set of records.
+ */
+static void
+ph_bench_records_free(PHBenchRecords *records)
+{
+    guint i;
+
+    for (i = 0; i < records->count; ++i)
+        g_array_free(records->records[i].logs, TRUE);
+    ph_arena_free(records->arena);
+    g_free(records->records);
+    g_free(records);
+}
+
+/* Store paths {{{1 */
+
+/*
+ * Store the records row by row.  Returns FALSE on error.
+ */
+static gboolean
+ph_bench_store_rows(PHDatabase *database,
+                    const PHBenchRecords *records,
+                    GError **error)
+{
+    gboolean success;
+    guint i, j;
+
+    success = ph_database_begin(database, error);
+    for (i = 0; success && i < records->count; ++i) {
+        const PHImportRecord *record = &records->records[i];
+
+        success = ph_geocache_store(record->geocache, database, error) &&
+            ph_waypoint_store(&record->waypoint, database, error);
+        for (j = 0; success && j < record->logs->len; ++j)
+            success = ph_log_store(&g_array_index(record->logs, PHLog, j),
+                    database, error);
+    }
+
+    if (success)
+        success = ph_database_commit(database, error);
+    else
+        (void) ph_database_rollback(database, NULL);
+
+    return success;
+}
+
+/*
+ * Store the records with a PHImportWriter.  Returns FALSE on error.
+ */
+static gboolean
+ph_bench_store_writer(PHDatabase *database,
+                      const PHBenchRecords *records,
+                      GError **error)
+{
+    PHImportWriter *writer = NULL;
+    gboolean success;
+    guint i;
+
+    success = ph_database_begin(database, error);
+    if (success) {
+        writer = ph_import_writer_new(database, error);
+        success = (writer != NULL);
+    }
+    for (i = 0; success && i < records->count; ++i)
+        success = ph_import_writer_store_record(writer,
+                &records->records[i], error);
+    if (writer != NULL)
+        ph_import_writer_free(writer);
+
+    if (success)
+        success = ph_database_commit(database, error);
+    else
+        (void) ph_database_rollback(database, NULL);
+
+    return success;
+}
+
+/* Benchmark {{{1 */
+
+/*
+ * Count the geocaches, waypoints and logs in the database.  Returns -1 on
+ * error.
+ */
+static gint64
+ph_bench_count_rows(PHDatabase *database,
+                    GError **error)
+{
+    sqlite3_stmt *stmt;
+    gint64 result = -1;
+
+    stmt = ph_database_prepare(database, "SELECT "
+            "(SELECT COUNT(*) FROM geocaches) + "
+            "(SELECT COUNT(*) FROM waypoints) + "
+            "(SELECT COUNT(*) FROM logs)", error);
+    if (stmt == NULL)
+        return -1;
+
+    if (ph_database_step(database, stmt, error) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+
+    (void) sqlite3_finalize(stmt);
+    return result;
+}
+
+/*
+ * Store both passes of records on a fresh database with the given function
+ * and print the throughput.  Returns FALSE on error.
+ */
+static gboolean
+ph_bench_run(const gchar *name,
+             gboolean (*store)(PHDatabase *, const PHBenchRecords *,
+                               GError **),
+             PHBenchRecords **passes,
+             GError **error)
+{
+    static const gchar *pass_names[] = { "insert", "update" };
+    PHDatabase *database;
+    gchar *directory = NULL;
+    GTimer *timer;
+    gdouble elapsed;
+    gint64 rows;
+    gboolean success;
+    guint i;
+
+    database = ph_bench_db_open(&directory, error);
+    success = (database != NULL);
+
+    timer = g_timer_new();
+    for (i = 0; success && i < G_N_ELEMENTS(pass_names); ++i) {
+        g_timer_start(timer);
+        success = store(database, passes[i], error);
+        elapsed = g_timer_elapsed(timer, NULL);
+        if (success)
+            printf("%-8s %-8s %9u rows %8.2f s %10.0f rows/s\n", name,
+                    pass_names[i], passes[i]->rows, elapsed,
+                    (elapsed > 0) ? passes[i]->rows / elapsed : 0.0);
+    }
+    g_timer_destroy(timer);
+
+    if (success) {
+        rows = ph_bench_count_rows(database, error);
+        success = (rows >= 0);
+        if (success && rows != passes[0]->rows) {
+            g_set_error(error, PH_DATABASE_ERROR,
+                    PH_DATABASE_ERROR_INCONSISTENT,
+                    "Storing with %s leaves %" G_GINT64_FORMAT " rows, "
+                    "expected %u", name, rows, passes[0]->rows);
+            success = FALSE;
+        }
+    }
+
+    ph_bench_db_cleanup(database, directory);
+    return success;
+}
+
+/* Main program {{{1 */
+
+int
+main(int argc,
+     char **argv)
+{
+    GError *error = NULL;
+    PHBenchRecords *passes[2];
+    guint count = 20000, logs = 5;
+    gboolean success;
+
+    if (argc > 1)
+        count = MAX(atoi(argv[1]), 1);
+    if (argc > 2)
+        logs = MAX(atoi(argv[2]), 0);
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+
+    passes[0] = ph_bench_records_new(count, logs, 0);
+    passes[1] = ph_bench_records_new(count, logs, 1);
+
+    success = ph_bench_run("rows", ph_bench_store_rows, passes, &error) &&
+        ph_bench_run("writer", ph_bench_store_writer, passes, &error);
+
+    ph_bench_records_free(passes[0]);
+    ph_bench_records_free(passes[1]);
+
+    if (!success) {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -0,0 +1,227 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/*
+ * Microbenchmark comparing ph_xml_find_string() with the compiled
+ * PHXmlStringMatcher on the strings found in typical pocket queries.  Before
+ * measuring, both are checked to agree on every sample and on variants of it.
+ *
+ * Usage: ph-bench-strings [ROUNDS]
+ */
+
+/* Includes {{{1 */
+
+#include "ph-gpx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Samples {{{1 */
+
+/*
+ * Element contents as they appear in GPX files, NULL-terminated.
+ */
+static const gchar *ph_bench_waypoint_types[] = {
+    "Geocache", "Geocache", "Geocache", "Geocache", "Geocache Found",
+    "Parking Area", "Question to Answer", "Stages of a Multicache",
+    "Final Location", "Reference Point", "Trailhead", NULL
+};
+
+static const gchar *ph_bench_geocache_types[] = {
+    "Traditional Cache", "Multi-cache", "Unknown Cache", "Letterbox Hybrid",
+    "Wherigo Cache", "Event Cache", "Mega-Event Cache",
+    "Cache In Trash Out Event", "Earthcache", "Virtual Cache", "Webcam Cache",
+    "Other", "Project APE Cache", NULL
+};
+
+static const gchar *ph_bench_geocache_sizes[] = {
+    "Micro", "Small", "Regular", "Large", "Virtual", "Other", "Not chosen",
+    "Unknown", NULL
+};
+
+static const gchar *ph_bench_log_types[] = {
+    "Found it", "Found it", "Found it", "Found it", "Found it", "Found it",
+    "Didn't find it", "Write note", "Temporarily Disable Listing",
+    "Enable Listing", "Publish Listing", "Owner Maintenance",
+    "Needs Maintenance", "Attended", "Will Attend", "Post Reviewer Note",
+    "Archive", "Unarchive", "Update Coordinates", "Webcam Photo Taken",
+    "Needs Archived", "Announcement", NULL
+};
+
+/*
+ * A string table together with the samples run through it.
+ */
+typedef struct _PHBenchCase {
+    const gchar *name;
+    const PHXmlStringTable *table;
+    const gchar **samples;
+} PHBenchCase;
+
+static const PHBenchCase ph_bench_cases[] = {
+    { "waypoint types", ph_gpx_waypoint_types, ph_bench_waypoint_types },
+    { "geocache types", ph_gpx_geocache_types, ph_bench_geocache_types },
+    { "geocache sizes", ph_gpx_geocache_sizes, ph_bench_geocache_sizes },
+    { "log types", ph_gpx_log_types, ph_bench_log_types },
+    { NULL }
+};
+
+/* Verification {{{1 */
+
+/*
+ * Compare the results of both lookup methods for a single string.  Returns
+ * FALSE if they differ.
+ */
+static gboolean
+ph_bench_check(const PHXmlStringTable *table,
+               const PHXmlStringMatcher *matcher,
+               const gchar *needle)
+{
+    gint expected = ph_xml_find_string(table, (const xmlChar *) needle);
+    gint actual = ph_xml_string_matcher_find(matcher,
+            (const xmlChar *) needle);
+
+    if (expected != actual) {
+        fprintf(stderr, "Mismatch for \"%s\": %d expected, %d found\n",
+                needle, expected, actual);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+ * Check the samples, the table strings themselves and variants of them:
+ * changed case, every prefix and some surrounding text.  Returns FALSE if
+ * any lookup differs.
+ */
+static gboolean
+ph_bench_verify(const PHBenchCase *bench,
+                const PHXmlStringMatcher *matcher)
+{
+    GPtrArray *strings = g_ptr_array_new_with_free_func(g_free);
+    const PHXmlStringTable *entry;
+    gboolean success = TRUE;
+    guint i;
+    gsize j;
+
+    for (i = 0; bench->samples[i] != NULL; ++i)
+        g_ptr_array_add(strings, g_strdup(bench->samples[i]));
+    for (entry = bench->table; entry->value != 0; ++entry) {
+        if (entry->primary != NULL)
+            g_ptr_array_add(strings, g_strdup(entry->primary));
+        if (entry->alt != NULL)
+            g_ptr_array_add(strings, g_strdup(entry->alt + 1));
+    }
+
+    for (i = 0; success && i < strings->len; ++i) {
+        const gchar *base = g_ptr_array_index(strings, i);
+        gchar *variant;
+
+        success = ph_bench_check(bench->table, matcher, base);
+
+        variant = g_ascii_strup(base, -1);
+        success = success && ph_bench_check(bench->table, matcher, variant);
+        g_free(variant);
+
+        variant = g_strdup_printf("x%s", base);
+        success = success && ph_bench_check(bench->table, matcher, variant);
+        g_free(variant);
+
+        variant = g_strdup_printf("%s (show)", base);
+        success = success && ph_bench_check(bench->table, matcher, variant);
+        g_free(variant);
+
+        for (j = 0; success && j < strlen(base); ++j) {
+            variant = g_strndup(base, j);
+            success = ph_bench_check(bench->table, matcher, variant);
+            g_free(variant);
+        }
+    }
+
+    success = success && ph_bench_check(bench->table, matcher, "");
+
+    g_ptr_array_free(strings, TRUE);
+    return success;
+}
+
+/* Timing {{{1 */
+
+/*
+ * Run all samples through both lookup methods the given number of times and
+ * print the time per lookup.
+ */
+static void
+ph_bench_run(const PHBenchCase *bench,
+             const PHXmlStringMatcher *matcher,
+             guint rounds)
+{
+    GTimer *timer = g_timer_new();
+    gdouble linear, compiled;
+    guint count, i, j, lookups;
+    glong checksum = 0;
+
+    for (count = 0; bench->samples[count] != NULL; ++count)
+        ;
+    lookups = count * rounds;
+
+    g_timer_start(timer);
+    for (i = 0; i < rounds; ++i) {
+        for (j = 0; j < count; ++j)
+            checksum += ph_xml_find_string(bench->table,
+                    (const xmlChar *) bench->samples[j]);
+    }
+    linear = g_timer_elapsed(timer, NULL);
+
+    g_timer_start(timer);
+    for (i = 0; i < rounds; ++i) {
+        for (j = 0; j < count; ++j)
+            checksum -= ph_xml_string_matcher_find(matcher,
+                    (const xmlChar *) bench->samples[j]);
+    }
+    compiled = g_timer_elapsed(timer, NULL);
+
+    printf("%-16s %10u lookups  linear %7.1f ns  compiled %7.1f ns  "
+            "speedup %5.2fx%s\n", bench->name, lookups,
+            linear * 1e9 / lookups, compiled * 1e9 / lookups,
+            (compiled > 0) ? linear / compiled : 0.0,
+            (checksum == 0) ? "" : "  (checksum mismatch!)");
+
+    g_timer_destroy(timer);
+}
+
+/* Main program {{{1 */
+
+int
+main(int argc,
+     char **argv)
+{
+    const PHBenchCase *bench;
+    guint rounds = 200000;
+    gboolean success = TRUE;
+
+    if (argc > 1)
+        rounds = MAX(atoi(argv[1]), 1);
+
+    for (bench = ph_bench_cases; bench->name != NULL; ++bench) {
+        PHXmlStringMatcher *matcher = ph_xml_string_matcher_new(bench->table);
+
+        if (ph_bench_verify(bench, matcher))
+            ph_bench_run(bench, matcher, rounds);
+        else
+            success = FALSE;
+
+        ph_xml_string_matcher_free(matcher);
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -0,0 +1,191 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/*
+ * Microbenchmark comparing ph_xml_parse_time() with g_time_val_from_iso8601()
+ * applied to a copy of the text, which is what the importer used to do.
+ * Before measuring, both are checked to agree on a corpus of timestamps in
+ * several time zones.
+ *
+ * Usage: ph-bench-time [ROUNDS]
+ */
+
+/* Includes {{{1 */
+
+#include "ph-xml.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Samples {{{1 */
+
+/*
+ * Timestamps which have to be parsed exactly like GLib does, NULL-terminated.
+ */
+static const gchar *ph_bench_corpus[] = {
+    /* Groundspeak pocket queries */
+    "2011-07-14T00:00:00Z", "2012-03-04T20:00:00Z", "2003-11-30T08:00:00",
+    "2011-07-14T07:00:00.0000000-07:00", "2012-02-29T19:00:00.1234567Z",
+    /* Opencaching */
+    "2011-01-02T00:00:00+01:00", "2010-06-30T23:59:59+02:00",
+    "2009-12-31T12:00:00.000+0100",
+    /* time zones */
+    "2012-10-28T01:30:00+05:30", "2012-10-28T01:30:00-09:30",
+    "2012-03-25T02:30:00+1400", "2012-03-25T02:30:00-12:00",
+    "2012-01-01T00:00:00+00:00", "2012-01-01T00:00:00-00:00",
+    "2012-01-01T00:00:00+01", "2012-01-01T00:00:00+1:00",
+    "2012-01-01T00:00:00+05:301",
+    /* fractional seconds */
+    "2012-01-01T00:00:00.5Z", "2012-01-01T00:00:00,5Z",
+    "2012-01-01T00:00:00.999999999+01:00", "2012-01-01T00:00:00.Z",
+    "2012-01-01T00:00:00.5",
+    /* local time around daylight saving changes */
+    "2012-03-25T02:30:00", "2012-10-28T02:30:00", "2012-07-01T12:00:00.25",
+    /* calendar edge cases */
+    "1970-01-01T00:00:00Z", "1969-12-31T23:59:59Z", "2000-02-29T12:00:00Z",
+    "1900-03-01T00:00:00Z", "2038-01-19T03:14:07Z", "2100-02-28T23:59:59Z",
+    "2011-02-29T00:00:00Z", "2011-04-31T00:00:00Z", "2011-12-31T23:59:60Z",
+    "2011-12-31T24:00:00Z", "2011-13-01T00:00:00Z", "2011-00-10T00:00:00Z",
+    /* other syntax GLib accepts */
+    "20110714T000000Z", "2011-7-4T0:0:0Z", " 2011-07-14T00:00:00Z",
+    "2011-07-14T00:00:00Z ", "+2011-07-14T00:00:00Z",
+    /* invalid input */
+    "", "2011", "2011-07-14", "2011-07-14T", "2011-07-14T00:00",
+    "2011-07-14 00:00:00Z", "2011-07-14T00:00:00X", "2011-07-14T00:00:00Zx",
+    "garbage", NULL
+};
+
+/*
+ * Time zones the corpus is checked in, NULL-terminated.
+ */
+static const gchar *ph_bench_zones[] = {
+    "UTC", "Europe/Vienna", "America/Los_Angeles", "Asia/Kolkata", NULL
+};
+
+/*
+ * Typical mix of timestamps in a pocket query, dominated by log dates.
+ */
+static const gchar *ph_bench_samples[] = {
+    "2011-07-14T07:00:00Z", "2012-03-04T20:00:00Z", "2012-03-02T20:00:00Z",
+    "2012-02-25T20:00:00Z", "2012-02-19T20:00:00Z", "2012-01-30T20:00:00Z",
+    "2011-07-14T07:00:00.0000000-07:00", "2011-01-02T00:00:00+01:00", NULL
+};
+
+/* Verification {{{1 */
+
+/*
+ * Parse text the way ph_xml_extract_time() used to.
+ */
+static glong
+ph_bench_parse_glib(const gchar *text)
+{
+    GTimeVal result = {0, 0};
+    gchar *copy = g_strdup(text);
+
+    (void) g_time_val_from_iso8601(copy, &result);
+    g_free(copy);
+    return result.tv_sec;
+}
+
+/*
+ * Check the corpus in the current time zone.  Returns FALSE if any
+ * timestamp is parsed differently.
+ */
+static gboolean
+ph_bench_verify(const gchar *zone)
+{
+    const gchar **text;
+    gboolean success = TRUE;
+
+    for (text = ph_bench_corpus; *text != NULL; ++text) {
+        glong expected = ph_bench_parse_glib(*text);
+        glong actual = ph_xml_parse_time((const xmlChar *) *text);
+
+        if (expected != actual) {
+            fprintf(stderr, "Mismatch for \"%s\" in %s: %ld expected, "
+                    "%ld found\n", *text, zone, expected, actual);
+            success = FALSE;
+        }
+    }
+
+    return success;
+}
+
+/* Timing {{{1 */
+
+/*
+ * Run all samples through both parsers the given number of times and print
+ * the time per timestamp.
+ */
+static void
+ph_bench_run(guint rounds)
+{
+    GTimer *timer = g_timer_new();
+    gdouble glib, fast;
+    guint count, i, j, parsed;
+    glong checksum = 0;
+
+    for (count = 0; ph_bench_samples[count] != NULL; ++count)
+        ;
+    parsed = count * rounds;
+
+    g_timer_start(timer);
+    for (i = 0; i < rounds; ++i) {
+        for (j = 0; j < count; ++j)
+            checksum += ph_bench_parse_glib(ph_bench_samples[j]);
+    }
+    glib = g_timer_elapsed(timer, NULL);
+
+    g_timer_start(timer);
+    for (i = 0; i < rounds; ++i) {
+        for (j = 0; j < count; ++j)
+            checksum -= ph_xml_parse_time(
+                    (const xmlChar *) ph_bench_samples[j]);
+    }
+    fast = g_timer_elapsed(timer, NULL);
+
+    printf("%-16s %10u parsed  glib %7.1f ns  fast %7.1f ns  "
+            "speedup %5.2fx%s\n", "timestamps", parsed,
+            glib * 1e9 / parsed, fast * 1e9 / parsed,
+            (fast > 0) ? glib / fast : 0.0,
+            (checksum == 0) ? "" : "  (checksum mismatch!)");
+
+    g_timer_destroy(timer);
+}
+
+/* Main program {{{1 */
+
+int
+main(int argc,
+     char **argv)
+{
+    const gchar **zone;
+    guint rounds = 200000;
+    gboolean success = TRUE;
+
+    if (argc > 1)
+        rounds = MAX(atoi(argv[1]), 1);
+
+    for (zone = ph_bench_zones; *zone != NULL; ++zone) {
+        g_setenv("TZ", *zone, TRUE);
+        tzset();
+        success = ph_bench_verify(*zone) && success;
+    }
+
+    if (success)
+        ph_bench_run(rounds);
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
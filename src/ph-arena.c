@@ -0,0 +1,297 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/* Includes {{{1 */
+
+#include "ph-arena.h"
+#include <stdarg.h>
+#include <string.h>
+
+/* Constants {{{1 */
+
+/*
+ * Usable size of a regular block.  The first block is allocated together
+ * with the arena, so an arena that stays below this size costs a single
+ * malloc() call.
+ */
+#define PH_ARENA_BLOCK_SIZE 16384
+
+/*
+ * Requests larger than this get a block of their own, so that the rest of
+ * the current block is not wasted.
+ */
+#define PH_ARENA_LARGE_SIZE (PH_ARENA_BLOCK_SIZE / 4)
+
+/*
+ * Alignment of memory returned by ph_arena_alloc().
+ */
+#define PH_ARENA_ALIGN 8
+
+/* Data structures {{{1 */
+
+/*
+ * Header of a chunk of memory objects are carved from.  The data follows
+ * immediately.
+ */
+typedef struct _PHArenaBlock {
+    struct _PHArenaBlock *next; /* next block to be freed */
+    gsize size;                 /* usable bytes after the header */
+    gsize used;                 /* bytes handed out so far */
+} PHArenaBlock;
+
+struct _PHArena {
+    PHArenaBlock *current;      /* block new objects are taken from */
+    PHArenaBlock *large;        /* blocks holding a single large object */
+    gsize size;                 /* total bytes handed out */
+    guint allocations;          /* number of objects handed out */
+    PHArenaBlock first;         /* built-in block, must come last */
+};
+
+/* Forward declarations {{{1 */
+
+static gpointer ph_arena_reserve(PHArena *arena, gsize size, gsize align);
+static guchar *ph_arena_block_data(PHArenaBlock *block);
+static PHArenaBlock *ph_arena_block_new(gsize size);
+
+/* Arena creation {{{1 */
+
+/*
+ * Create an empty arena.
+ */
+PHArena *
+ph_arena_new()
+{
+    PHArena *result = g_malloc(sizeof(PHArena) + PH_ARENA_BLOCK_SIZE);
+
+    result->first.next = NULL;
+    result->first.size = PH_ARENA_BLOCK_SIZE;
+    result->first.used = 0;
+    result->current = &result->first;
+    result->large = NULL;
+    result->size = 0;
+    result->allocations = 0;
+
+    return result;
+}
+
+/*
+ * Free the arena and everything allocated from it.  No-op for NULL.
+ */
+void
+ph_arena_free(PHArena *arena)
+{
+    if (arena == NULL)
+        return;
+
+    ph_arena_reset(arena);
+    g_free(arena);
+}
+
+/*
+ * Release everything allocated from the arena at once.  The built-in block
+ * is kept for reuse.
+ */
+void
+ph_arena_reset(PHArena *arena)
+{
+    PHArenaBlock *block, *next;
+
+    g_return_if_fail(arena != NULL);
+
+    /* the built-in block is always the last one in the list */
+    for (block = arena->current; block != &arena->first; block = next) {
+        next = block->next;
+        g_free(block);
+    }
+    for (block = arena->large; block != NULL; block = next) {
+        next = block->next;
+        g_free(block);
+    }
+
+    arena->first.used = 0;
+    arena->current = &arena->first;
+    arena->large = NULL;
+    arena->size = 0;
+    arena->allocations = 0;
+}
+
+/* Allocation {{{1 */
+
+/*
+ * Allocate size bytes of uninitialized, suitably aligned memory.
+ */
+gpointer
+ph_arena_alloc(PHArena *arena,
+               gsize size)
+{
+    g_return_val_if_fail(arena != NULL, NULL);
+
+    return ph_arena_reserve(arena, size, PH_ARENA_ALIGN);
+}
+
+/*
+ * Allocate size bytes of zero-filled, suitably aligned memory.
+ */
+gpointer
+ph_arena_alloc0(PHArena *arena,
+                gsize size)
+{
+    gpointer result;
+
+    g_return_val_if_fail(arena != NULL, NULL);
+
+    result = ph_arena_reserve(arena, size, PH_ARENA_ALIGN);
+    memset(result, 0, size);
+    return result;
+}
+
+/*
+ * Copy a string into the arena.  Returns NULL for NULL.
+ */
+gchar *
+ph_arena_strdup(PHArena *arena,
+                const gchar *text)
+{
+    gsize length;
+    gchar *result;
+
+    g_return_val_if_fail(arena != NULL, NULL);
+
+    if (text == NULL)
+        return NULL;
+
+    length = strlen(text) + 1;
+    result = ph_arena_reserve(arena, length, 1);
+    memcpy(result, text, length);
+    return result;
+}
+
+/*
+ * Concatenate a NULL-terminated list of strings into the arena.
+ */
+gchar *
+ph_arena_strconcat(PHArena *arena,
+                   const gchar *first,
+                   ...)
+{
+    va_list args;
+    const gchar *part;
+    gsize length = 1;
+    gchar *result, *cur;
+
+    g_return_val_if_fail(arena != NULL, NULL);
+
+    va_start(args, first);
+    for (part = first; part != NULL; part = va_arg(args, const gchar *))
+        length += strlen(part);
+    va_end(args);
+
+    result = cur = ph_arena_reserve(arena, length, 1);
+
+    va_start(args, first);
+    for (part = first; part != NULL; part = va_arg(args, const gchar *))
+        cur = g_stpcpy(cur, part);
+    va_end(args);
+
+    *cur = '\0';
+    return result;
+}
+
+/*
+ * Carve size bytes with the given alignment from the current block, or from
+ * a new one if it is full.
+ */
+static gpointer
+ph_arena_reserve(PHArena *arena,
+                 gsize size,
+                 gsize align)
+{
+    PHArenaBlock *block = arena->current;
+    gsize base, start;
+
+    ++arena->allocations;
+    arena->size += size;
+
+    if (size > PH_ARENA_LARGE_SIZE) {
+        /* the current block keeps being filled with small objects */
+        block = ph_arena_block_new(size + align);
+        block->next = arena->large;
+        arena->large = block;
+    }
+
+    base = GPOINTER_TO_SIZE(ph_arena_block_data(block));
+    start = ((base + block->used + align - 1) & ~(align - 1)) - base;
+    if (start + size > block->size) {
+        block = ph_arena_block_new(PH_ARENA_BLOCK_SIZE);
+        block->next = arena->current;
+        arena->current = block;
+        base = GPOINTER_TO_SIZE(ph_arena_block_data(block));
+        start = ((base + align - 1) & ~(align - 1)) - base;
+    }
+
+    block->used = start + size;
+    return ph_arena_block_data(block) + start;
+}
+
+/* Blocks {{{1 */
+
+/*
+ * Get the memory managed by a block.
+ */
+static guchar *
+ph_arena_block_data(PHArenaBlock *block)
+{
+    return (guchar *) (block + 1);
+}
+
+/*
+ * Allocate a block with the given usable size.
+ */
+static PHArenaBlock *
+ph_arena_block_new(gsize size)
+{
+    PHArenaBlock *result = g_malloc(sizeof(PHArenaBlock) + size);
+
+    result->next = NULL;
+    result->size = size;
+    result->used = 0;
+
+    return result;
+}
+
+/* Statistics {{{1 */
+
+/*
+ * Get the number of bytes allocated from the arena since it was created or
+ * last reset.
+ */
+gsize
+ph_arena_get_size(const PHArena *arena)
+{
+    g_return_val_if_fail(arena != NULL, 0);
+
+    return arena->size;
+}
+
+/*
+ * Get the number of allocations made from the arena since it was created or
+ * last reset.
+ */
+guint
+ph_arena_get_allocations(const PHArena *arena)
+{
+    g_return_val_if_fail(arena != NULL, 0);
+
+    return arena->allocations;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
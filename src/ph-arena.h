@@ -0,0 +1,50 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+#ifndef PH_ARENA_H
+#define PH_ARENA_H
+
+/* Includes {{{1 */
+
+#include <glib.h>
+
+/* Data types {{{1 */
+
+/*
+ * Bump-pointer allocator for many small objects sharing a lifetime.  Nothing
+ * allocated from an arena is freed individually; everything goes away at
+ * once with ph_arena_reset() or ph_arena_free().
+ */
+typedef struct _PHArena PHArena;
+
+/* Public interface {{{1 */
+
+PHArena *ph_arena_new();
+void ph_arena_free(PHArena *arena);
+void ph_arena_reset(PHArena *arena);
+
+gpointer ph_arena_alloc(PHArena *arena,
+                        gsize size);
+gpointer ph_arena_alloc0(PHArena *arena,
+                         gsize size);
+gchar *ph_arena_strdup(PHArena *arena,
+                       const gchar *text);
+gchar *ph_arena_strconcat(PHArena *arena,
+                          const gchar *first,
+                          ...);
+
+gsize ph_arena_get_size(const PHArena *arena);
+guint ph_arena_get_allocations(const PHArena *arena);
+
+/* }}} */
+
+#endif
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
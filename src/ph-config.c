@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <glib/gstdio.h>
 #include <string.h>
+#include <time.h>
 
 /* Data structure {{{1 */
 
@@ -709,6 +710,194 @@ ph_config_set_max_tile_cache_size(const GValue *value)
                               NULL);
 }
 
+/* Log retention {{{1 */
+
+/*
+ * Get the number of logs kept per geocache after an import, or 0 to keep all
+ * of them.  This is an unsigned integer value.
+ */
+void
+ph_config_get_max_logs(GValue *value)
+{
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(G_VALUE_HOLDS_UINT(value));
+
+    g_value_set_uint(value, g_key_file_get_uint64(ph_config->key_file,
+                                                  "log-retention", "max-logs",
+                                                  NULL));
+}
+
+/*
+ * Set the number of logs kept per geocache.
+ */
+void
+ph_config_set_max_logs(const GValue *value)
+{
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(value == NULL || G_VALUE_HOLDS_UINT(value));
+
+    if (value != NULL)
+        g_key_file_set_uint64(ph_config->key_file, "log-retention",
+                              "max-logs", g_value_get_uint(value));
+    else
+        g_key_file_remove_key(ph_config->key_file, "log-retention",
+                              "max-logs", NULL);
+}
+
+/*
+ * Get the number of days after which logs are removed during an import, or 0
+ * to keep them forever.  This is an unsigned integer value.
+ */
+void
+ph_config_get_max_log_age(GValue *value)
+{
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(G_VALUE_HOLDS_UINT(value));
+
+    g_value_set_uint(value, g_key_file_get_uint64(ph_config->key_file,
+                                                  "log-retention", "max-age",
+                                                  NULL));
+}
+
+/*
+ * Set the maximum age of logs kept in the database.
+ */
+void
+ph_config_set_max_log_age(const GValue *value)
+{
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(value == NULL || G_VALUE_HOLDS_UINT(value));
+
+    if (value != NULL)
+        g_key_file_set_uint64(ph_config->key_file, "log-retention",
+                              "max-age", g_value_get_uint(value));
+    else
+        g_key_file_remove_key(ph_config->key_file, "log-retention",
+                              "max-age", NULL);
+}
+
+/*
+ * Get the name the user logs geocaches with.  Their finds are never removed.
+ * This is a string value, NULL if unset.
+ */
+void
+ph_config_get_own_logger(GValue *value)
+{
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(G_VALUE_HOLDS_STRING(value));
+
+    g_value_take_string(value, g_key_file_get_string(ph_config->key_file,
+                                                     "log-retention",
+                                                     "own-logger", NULL));
+}
+
+/*
+ * Set the name the user logs geocaches with.
+ */
+void
+ph_config_set_own_logger(const GValue *value)
+{
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(value == NULL || G_VALUE_HOLDS_STRING(value));
+
+    if (value != NULL && g_value_get_string(value) != NULL)
+        g_key_file_set_string(ph_config->key_file, "log-retention",
+                              "own-logger", g_value_get_string(value));
+    else
+        g_key_file_remove_key(ph_config->key_file, "log-retention",
+                              "own-logger", NULL);
+}
+
+/*
+ * Collect the configured log retention rules, with the cutoff relative to the
+ * current time.  Returns NULL if all logs are to be kept.  Free the result
+ * with ph_log_retention_free().
+ */
+PHLogRetention *
+ph_config_get_log_retention()
+{
+    PHLogRetention *result;
+    GValue value = {0};
+    guint max_logs, max_age;
+
+    g_return_val_if_fail(ph_config != NULL, NULL);
+
+    g_value_init(&value, G_TYPE_UINT);
+    ph_config_get_max_logs(&value);
+    max_logs = g_value_get_uint(&value);
+    ph_config_get_max_log_age(&value);
+    max_age = g_value_get_uint(&value);
+    g_value_unset(&value);
+
+    if (max_logs == 0 && max_age == 0)
+        return NULL;
+
+    result = g_new0(PHLogRetention, 1);
+    result->max_logs = max_logs;
+    if (max_age != 0)
+        result->cutoff = time(NULL) - (glong) max_age * 24 * 60 * 60;
+
+    g_value_init(&value, G_TYPE_STRING);
+    ph_config_get_own_logger(&value);
+    result->own_logger = g_value_dup_string(&value);
+    g_value_unset(&value);
+
+    return result;
+}
+
+/* Database storage {{{1 */
+
+/*
+ * Check whether long texts of geocaches and logs are stored compressed, which
+ * makes the database file smaller at the cost of unpacking them whenever they
+ * are displayed.  This is a boolean value.
+ */
+void
+ph_config_get_compress_texts(GValue *value)
+{
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(G_VALUE_HOLDS_BOOLEAN(value));
+
+    g_value_set_boolean(value, g_key_file_get_boolean(ph_config->key_file,
+                                                      "database",
+                                                      "compress-texts",
+                                                      NULL));
+}
+
+/*
+ * Enable or disable compression of newly stored texts.
+ */
+void
+ph_config_set_compress_texts(const GValue *value)
+{
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(value == NULL || G_VALUE_HOLDS_BOOLEAN(value));
+
+    if (value != NULL)
+        g_key_file_set_boolean(ph_config->key_file, "database",
+                               "compress-texts", g_value_get_boolean(value));
+    else
+        g_key_file_remove_key(ph_config->key_file, "database",
+                              "compress-texts", NULL);
+}
+
+/*
+ * Apply the configured storage settings to a newly opened database.
+ */
+void
+ph_config_setup_database(PHDatabase *database)
+{
+    GValue value = {0};
+
+    g_return_if_fail(ph_config != NULL);
+    g_return_if_fail(database != NULL && PH_IS_DATABASE(database));
+
+    g_value_init(&value, G_TYPE_BOOLEAN);
+    ph_config_get_compress_texts(&value);
+    ph_database_set_compress_texts(database, g_value_get_boolean(&value));
+    g_value_unset(&value);
+}
+
 /* }}} */
 
 /* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
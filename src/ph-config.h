@@ -14,6 +14,7 @@
 /* Includes {{{1 */
 
 #include "ph-geocache.h"
+#include "ph-log.h"
 #include <gtk/gtk.h>
 
 /* Input and output {{{1 */
@@ -43,6 +44,18 @@ void ph_config_set_max_tile_age(const GValue *value);
 void ph_config_get_max_tile_cache_size(GValue *value);
 void ph_config_set_max_tile_cache_size(const GValue *value);
 
+void ph_config_get_max_logs(GValue *value);
+void ph_config_set_max_logs(const GValue *value);
+void ph_config_get_max_log_age(GValue *value);
+void ph_config_set_max_log_age(const GValue *value);
+void ph_config_get_own_logger(GValue *value);
+void ph_config_set_own_logger(const GValue *value);
+PHLogRetention *ph_config_get_log_retention();
+
+void ph_config_get_compress_texts(GValue *value);
+void ph_config_set_compress_texts(const GValue *value);
+void ph_config_setup_database(PHDatabase *database);
+
 /* }}} */
 
 #endif
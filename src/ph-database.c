@@ -12,12 +12,15 @@
 
 #include "ph-database.h"
 #include <glib/gi18n.h>
+#include <string.h>
+#include <zlib.h>
 
 /* Signals {{{1 */
 
 enum {
     PH_DATABASE_SIGNAL_GEOCACHE_UPDATED,
     PH_DATABASE_SIGNAL_BULK_UPDATED,
+    PH_DATABASE_SIGNAL_IMPORT_STOPPED,
     PH_DATABASE_SIGNAL_COUNT
 };
 
@@ -31,8 +34,22 @@ static guint ph_database_signals[PH_DATABASE_SIGNAL_COUNT];
 typedef struct _PHDatabasePrivate {
     gchar *filename;                /* path to the database file */
     sqlite3 *connection;            /* SQLite handle */
+    PHDatabaseProfile profile;      /* current connection settings */
+    gboolean compress_texts;        /* store long texts compressed */
+    GQueue cache;                   /* cached statements, most recent first */
+    GHashTable *cache_links;        /* SQL text -> link in cache */
+    guint cache_hits;               /* statements reused from the cache */
+    guint cache_misses;             /* statements prepared for the cache */
 } PHDatabasePrivate;
 
+/*
+ * Prepared statement kept by ph_database_prepare_cached().
+ */
+typedef struct _PHDatabaseCached {
+    sqlite3_stmt *stmt;             /* statement keyed by its SQL text */
+    gboolean busy;                  /* handed out and not yet released */
+} PHDatabaseCached;
+
 /* Forward declarations {{{1 */
 
 static void ph_database_class_init(PHDatabaseClass *cls);
@@ -41,8 +58,22 @@ static void ph_database_finalize(GObject *obj);
 
 static gint ph_database_get_version(PHDatabase *database, GError **error);
 static gboolean ph_database_create(PHDatabase *database, GError **error);
+static gboolean ph_database_upgrade(PHDatabase *database, gint version,
+                                    GError **error);
 static gboolean ph_database_setup(PHDatabase *database, GError **error);
 
+static gboolean ph_database_add_functions(PHDatabase *database,
+                                          GError **error);
+static guint8 *ph_database_pack(const gchar *text, gsize length,
+                                gsize *size);
+static gchar *ph_database_unpack(const guint8 *data, gsize size);
+static void ph_database_sql_text(sqlite3_context *context, int argc,
+                                 sqlite3_value **argv);
+static void ph_database_sql_pack(sqlite3_context *context, int argc,
+                                 sqlite3_value **argv);
+
+static void ph_database_cache_trim(PHDatabase *database, guint size);
+
 /* Standard GObject code {{{1 */
 
 G_DEFINE_TYPE(PHDatabase, ph_database, G_TYPE_OBJECT)
@@ -71,6 +102,13 @@ ph_database_class_init(PHDatabaseClass *cls)
                 NULL, NULL,
                 g_cclosure_marshal_VOID__VOID,
                 G_TYPE_NONE, 0);
+    ph_database_signals[PH_DATABASE_SIGNAL_IMPORT_STOPPED] =
+        g_signal_new("import-stopped", PH_TYPE_DATABASE,
+                G_SIGNAL_RUN_FIRST,
+                G_STRUCT_OFFSET(PHDatabaseClass, import_stopped),
+                NULL, NULL,
+                g_cclosure_marshal_VOID__VOID,
+                G_TYPE_NONE, 0);
 
     g_type_class_add_private(cls, sizeof(PHDatabasePrivate));
 }
@@ -84,6 +122,8 @@ ph_database_init(PHDatabase *database)
     PHDatabasePrivate *priv = PH_DATABASE_GET_PRIVATE(database);
 
     database->priv = priv;
+    g_queue_init(&priv->cache);
+    priv->cache_links = g_hash_table_new(g_str_hash, g_str_equal);
 }
 
 /*
@@ -94,7 +134,13 @@ ph_database_finalize(GObject *obj)
 {
     PHDatabase *database = PH_DATABASE(obj);
 
-    g_message("Closing database `%s'.", database->priv->filename);
+    g_message("Closing database `%s' (statement cache: %u hits, "
+            "%u misses).", database->priv->filename,
+            database->priv->cache_hits, database->priv->cache_misses);
+
+    /* SQLite does not close connections with unfinalized statements */
+    ph_database_cache_trim(database, 0);
+    g_hash_table_destroy(database->priv->cache_links);
 
     if (database->priv->filename != NULL)
         g_free(database->priv->filename);
@@ -107,10 +153,22 @@ ph_database_finalize(GObject *obj)
 
 /* Instance creation {{{1 */
 
+/*
+ * Time in milliseconds a new connection waits for another one to release a
+ * lock.  It is kept short, as the user interface freezes while it waits, and
+ * an import holds the write lock until it has finished anyway.  Connections
+ * used in the background may wait longer, see ph_database_set_busy_timeout().
+ */
+#define PH_DATABASE_BUSY_TIMEOUT 100
+
 /*
  * Open an SQLite database.  If create is set, establish a new one if needed.
  * An empty database will be populated with the schema needed by plastichunt.
- * Returns NULL on error.
+ * The database is switched to write-ahead logging, so that connections
+ * reading it keep seeing the last committed state while another one writes,
+ * and the connection starts out with the interactive profile.  The SQL
+ * functions for compressed texts are registered before the schema is set up,
+ * as its triggers call them.  Returns NULL on error.
  */
 PHDatabase *
 ph_database_new(const gchar *filename,
@@ -133,7 +191,15 @@ ph_database_new(const gchar *filename,
         result = g_object_new(PH_TYPE_DATABASE, NULL);
         result->priv->filename = g_strdup(filename);
         result->priv->connection = connection;
-        if (ph_database_setup(result, error)) {
+        (void) sqlite3_busy_timeout(connection, PH_DATABASE_BUSY_TIMEOUT);
+        if (!ph_database_exec(result, "PRAGMA journal_mode = WAL", NULL))
+            g_message("Write-ahead logging unavailable for `%s'.", filename);
+        if (ph_database_exec(result, "PRAGMA recursive_triggers = ON",
+                    error) &&
+                ph_database_add_functions(result, error) &&
+                ph_database_set_profile(result,
+                    PH_DATABASE_PROFILE_INTERACTIVE, error) &&
+                ph_database_setup(result, error)) {
             g_message("Opened database `%s'.", filename);
             return result;
         }
@@ -165,9 +231,514 @@ ph_database_get_filename(PHDatabase *database)
     return database->priv->filename;
 }
 
+/*
+ * Set the time in milliseconds to wait for another connection to release a
+ * lock before failing with PH_DATABASE_ERROR_BUSY.
+ */
+void
+ph_database_set_busy_timeout(PHDatabase *database,
+                             gint timeout)
+{
+    g_return_if_fail(database != NULL && PH_IS_DATABASE(database));
+
+    (void) sqlite3_busy_timeout(database->priv->connection, timeout);
+}
+
+/* Tuning profiles {{{1 */
+
+/*
+ * Settings applied by each PHDatabaseProfile, in the order of its values.
+ * With write-ahead logging, synchronous = NORMAL cannot corrupt the database;
+ * a power failure may only lose the last commits.  Only the interactive
+ * profile, which stores notes typed in by the user, syncs on every commit.
+ */
+static const struct {
+    const gchar *name;
+    gint cache_size;                /* in KiB */
+    gint64 mmap_size;               /* in bytes */
+    const gchar *synchronous;
+    const gchar *temp_store;
+    gint autocheckpoint;            /* in WAL pages, 0 to checkpoint later */
+    gboolean query_only;
+} ph_database_profiles[PH_DATABASE_PROFILE_COUNT] = {
+    { "interactive", 8192, G_GINT64_CONSTANT(64) << 20,
+        "FULL", "DEFAULT", 1000, FALSE },
+    { "bulk-import", 65536, G_GINT64_CONSTANT(256) << 20,
+        "NORMAL", "MEMORY", 0, FALSE },
+    { "read-only-analytics", 32768, G_GINT64_CONSTANT(256) << 20,
+        "NORMAL", "MEMORY", 1000, TRUE }
+};
+
+/*
+ * Apply the settings of a tuning profile to the connection.  SQLite refuses
+ * to change some of them within a transaction, so this has to be called
+ * outside of one.  Leaving the bulk import profile, which never checkpoints
+ * on its own, copies the write-ahead log into the database file without
+ * waiting for readers.  Returns FALSE on error.
+ */
+gboolean
+ph_database_set_profile(PHDatabase *database,
+                        PHDatabaseProfile profile,
+                        GError **error)
+{
+    gchar *query;
+    gboolean success;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(profile < PH_DATABASE_PROFILE_COUNT, FALSE);
+    g_return_val_if_fail(
+            sqlite3_get_autocommit(database->priv->connection), FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    query = g_strdup_printf("PRAGMA cache_size = -%d; "
+            "PRAGMA mmap_size = %" G_GINT64_FORMAT "; "
+            "PRAGMA synchronous = %s; PRAGMA temp_store = %s; "
+            "PRAGMA wal_autocheckpoint = %d; PRAGMA query_only = %d",
+            ph_database_profiles[profile].cache_size,
+            ph_database_profiles[profile].mmap_size,
+            ph_database_profiles[profile].synchronous,
+            ph_database_profiles[profile].temp_store,
+            ph_database_profiles[profile].autocheckpoint,
+            ph_database_profiles[profile].query_only);
+    success = ph_database_exec(database, query, error);
+    g_free(query);
+
+    if (success &&
+            database->priv->profile == PH_DATABASE_PROFILE_BULK_IMPORT &&
+            profile != PH_DATABASE_PROFILE_BULK_IMPORT)
+        success = ph_database_exec(database,
+                "PRAGMA wal_checkpoint(PASSIVE)", error);
+
+    if (success) {
+        g_debug("Using the %s profile for `%s'",
+                ph_database_profiles[profile].name, database->priv->filename);
+        database->priv->profile = profile;
+    }
+
+    return success;
+}
+
+/*
+ * Get the tuning profile last applied to the connection.
+ */
+PHDatabaseProfile
+ph_database_get_profile(PHDatabase *database)
+{
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database),
+            PH_DATABASE_PROFILE_INTERACTIVE);
+
+    return database->priv->profile;
+}
+
+/*
+ * Get the name of a tuning profile, like "bulk-import".
+ */
+const gchar *
+ph_database_profile_name(PHDatabaseProfile profile)
+{
+    g_return_val_if_fail(profile < PH_DATABASE_PROFILE_COUNT, NULL);
+
+    return ph_database_profiles[profile].name;
+}
+
+/* Text compression {{{1 */
+
+/*
+ * Texts shorter than this many bytes are always stored as they are, as
+ * compressing them would hardly save anything.
+ */
+#define PH_DATABASE_PACK_THRESHOLD 256
+
+/*
+ * Flags of SQL functions which may appear in triggers.  Connections with
+ * trusted_schema turned off only let the schema call innocuous functions.
+ */
+#ifdef SQLITE_INNOCUOUS
+#define PH_DATABASE_SCHEMA_FUNCTION (SQLITE_UTF8 | SQLITE_DETERMINISTIC | \
+            SQLITE_INNOCUOUS)
+#else
+#define PH_DATABASE_SCHEMA_FUNCTION (SQLITE_UTF8 | SQLITE_DETERMINISTIC)
+#endif
+
+/*
+ * Choose whether texts stored via ph_database_bind_packed() or the SQL
+ * function ph_pack() are compressed.  Existing rows are left alone, and
+ * compressed texts can always be read, whatever the setting.
+ */
+void
+ph_database_set_compress_texts(PHDatabase *database,
+                               gboolean compress)
+{
+    g_return_if_fail(database != NULL && PH_IS_DATABASE(database));
+
+    database->priv->compress_texts = compress;
+}
+
+/*
+ * Check whether long texts are stored compressed.
+ */
+gboolean
+ph_database_get_compress_texts(PHDatabase *database)
+{
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database),
+            FALSE);
+
+    return database->priv->compress_texts;
+}
+
+/*
+ * Bind a text parameter, compressed if that has been enabled and pays off.
+ * Uncompressed texts are not copied, so they have to stay valid until the
+ * statement has been executed.  NULL is stored as SQL NULL.
+ */
+void
+ph_database_bind_packed(PHDatabase *database,
+                        sqlite3_stmt *stmt,
+                        gint index,
+                        const gchar *text)
+{
+    guint8 *packed = NULL;
+    gsize size;
+
+    g_return_if_fail(database != NULL && PH_IS_DATABASE(database));
+    g_return_if_fail(stmt != NULL);
+
+    if (database->priv->compress_texts && text != NULL)
+        packed = ph_database_pack(text, strlen(text), &size);
+
+    if (packed != NULL)
+        (void) sqlite3_bind_blob(stmt, index, packed, size, g_free);
+    else
+        (void) sqlite3_bind_text(stmt, index, text, -1, SQLITE_STATIC);
+}
+
+/*
+ * Get a copy of a text column of the current result row, which may have been
+ * stored compressed.  Returns NULL for SQL NULL and for damaged data.  Free
+ * the result with g_free().
+ */
+gchar *
+ph_database_column_text(sqlite3_stmt *stmt,
+                        gint column)
+{
+    const guint8 *data;
+    gchar *result;
+
+    g_return_val_if_fail(stmt != NULL, NULL);
+
+    if (sqlite3_column_type(stmt, column) != SQLITE_BLOB)
+        return g_strdup((const gchar *) sqlite3_column_text(stmt, column));
+
+    data = sqlite3_column_blob(stmt, column);
+    result = ph_database_unpack(data, sqlite3_column_bytes(stmt, column));
+    if (result == NULL)
+        g_warning("Damaged compressed text in column `%s'.",
+                sqlite3_column_name(stmt, column));
+
+    return result;
+}
+
+/*
+ * Register ph_text(), which unpacks a compressed text and passes anything
+ * else through, and ph_pack(), which compresses a text if
+ * ph_database_bind_packed() would.  Returns FALSE on error.
+ */
+static gboolean
+ph_database_add_functions(PHDatabase *database,
+                          GError **error)
+{
+    sqlite3 *connection = database->priv->connection;
+
+    if (sqlite3_create_function_v2(connection, "ph_text", 1,
+                PH_DATABASE_SCHEMA_FUNCTION, NULL, ph_database_sql_text,
+                NULL, NULL, NULL) == SQLITE_OK &&
+            sqlite3_create_function_v2(connection, "ph_pack", 1,
+                SQLITE_UTF8, database, ph_database_sql_pack,
+                NULL, NULL, NULL) == SQLITE_OK)
+        return TRUE;
+
+    g_set_error(error, PH_DATABASE_ERROR, PH_DATABASE_ERROR_FAILED,
+            _("Could not register SQL functions: %s"),
+            sqlite3_errmsg(connection));
+    return FALSE;
+}
+
+/*
+ * Compress a text of the given length in bytes.  The result consists of the
+ * length as four bytes in little-endian order, followed by the zlib stream.
+ * Returns NULL if the text is too short or does not shrink, otherwise a
+ * buffer to be freed with g_free() whose size is stored in size.
+ */
+static guint8 *
+ph_database_pack(const gchar *text,
+                 gsize length,
+                 gsize *size)
+{
+    guint8 *result;
+    guint32 header;
+    uLongf packed;
+
+    if (length < PH_DATABASE_PACK_THRESHOLD || length > G_MAXINT)
+        return NULL;
+
+    packed = compressBound(length);
+    result = g_malloc(sizeof(header) + packed);
+    if (compress2(result + sizeof(header), &packed, (const Bytef *) text,
+                length, Z_DEFAULT_COMPRESSION) != Z_OK ||
+            sizeof(header) + packed >= length) {
+        g_free(result);
+        return NULL;
+    }
+
+    header = GUINT32_TO_LE((guint32) length);
+    memcpy(result, &header, sizeof(header));
+    *size = sizeof(header) + packed;
+    return result;
+}
+
+/*
+ * Decompress the output of ph_database_pack().  Returns a NUL-terminated
+ * string to be freed with g_free(), or NULL if the data are damaged.
+ */
+static gchar *
+ph_database_unpack(const guint8 *data,
+                   gsize size)
+{
+    gchar *result;
+    guint32 header;
+    uLongf length;
+
+    if (data == NULL || size < sizeof(header))
+        return NULL;
+
+    memcpy(&header, data, sizeof(header));
+    length = GUINT32_FROM_LE(header);
+    result = g_try_malloc(length + 1);
+    if (result == NULL)
+        return NULL;
+
+    if (uncompress((Bytef *) result, &length, data + sizeof(header),
+                size - sizeof(header)) != Z_OK ||
+            length != GUINT32_FROM_LE(header)) {
+        g_free(result);
+        return NULL;
+    }
+
+    result[length] = '\0';
+    return result;
+}
+
+/*
+ * Implementation of the SQL function ph_text(value).
+ */
+static void
+ph_database_sql_text(sqlite3_context *context,
+                     int argc,
+                     sqlite3_value **argv)
+{
+    gchar *text;
+
+    if (sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+        sqlite3_result_value(context, argv[0]);
+        return;
+    }
+
+    text = ph_database_unpack(sqlite3_value_blob(argv[0]),
+            sqlite3_value_bytes(argv[0]));
+    if (text != NULL)
+        sqlite3_result_text(context, text, -1, g_free);
+    else
+        sqlite3_result_error(context, "damaged compressed text", -1);
+}
+
+/*
+ * Implementation of the SQL function ph_pack(value).
+ */
+static void
+ph_database_sql_pack(sqlite3_context *context,
+                     int argc,
+                     sqlite3_value **argv)
+{
+    PHDatabase *database = sqlite3_user_data(context);
+    guint8 *packed = NULL;
+    gsize size;
+
+    if (database->priv->compress_texts &&
+            sqlite3_value_type(argv[0]) == SQLITE_TEXT)
+        packed = ph_database_pack(
+                (const gchar *) sqlite3_value_text(argv[0]),
+                sqlite3_value_bytes(argv[0]), &size);
+
+    if (packed != NULL)
+        sqlite3_result_blob(context, packed, size, g_free);
+    else
+        sqlite3_result_value(context, argv[0]);
+}
+
 /* Schema version handling {{{1 */
 
-#define PH_DATABASE_CURRENT_VERSION 1
+#define PH_DATABASE_CURRENT_VERSION 9
+
+/*
+ * Columns of the geocaches, waypoints and logs tables.  The serial numbers
+ * identify rows for the spatial and full-text indexes.  Unlike the implicit
+ * rowid of a table with a text primary key, they survive VACUUM and dumps.
+ */
+#define PH_DATABASE_GEOCACHES_COLUMNS \
+    "serial INTEGER PRIMARY KEY, id TEXT UNIQUE, name TEXT, creator TEXT, " \
+    "owner TEXT, type TINYINT, size TINYINT, difficulty TINYINT, " \
+    "terrain TINYINT, attributes TEXT, summary_html BOOLEAN, " \
+    "summary TEXT, description_html BOOLEAN, description TEXT, " \
+    "hint TEXT, logged BOOLEAN, archived BOOLEAN, available BOOLEAN, " \
+    "content_hash INTEGER, attributes_yes INTEGER NOT NULL DEFAULT 0, " \
+    "attributes_no INTEGER NOT NULL DEFAULT 0"
+#define PH_DATABASE_WAYPOINTS_COLUMNS \
+    "serial INTEGER PRIMARY KEY, id TEXT UNIQUE, geocache_id TEXT, " \
+    "name TEXT, placed INTEGER, type TINYINT, url TEXT, summary TEXT, " \
+    "description TEXT, latitude INTEGER, longitude INTEGER"
+#define PH_DATABASE_LOGS_COLUMNS \
+    "serial INTEGER PRIMARY KEY, id INTEGER, geocache_id TEXT, " \
+    "type TINYINT, logger TEXT, logged INTEGER, details TEXT, " \
+    "UNIQUE (id, geocache_id)"
+
+/*
+ * Views of the geocaches and waypoints with their notes.
+ */
+#define PH_DATABASE_GEOCACHES_VIEW \
+    "CREATE VIEW geocaches_full AS SELECT geocaches.*, " \
+        "geocache_notes.found, geocache_notes.note FROM geocaches " \
+        "LEFT JOIN geocache_notes USING (id)"
+#define PH_DATABASE_WAYPOINTS_VIEW \
+    "CREATE VIEW waypoints_full AS SELECT waypoints.*, " \
+        "waypoint_notes.new_latitude, waypoint_notes.new_longitude " \
+        "FROM waypoints LEFT JOIN waypoint_notes USING (id)"
+
+/*
+ * Add the effective positions of the waypoints matching the condition, which
+ * starts with AND, to the waypoint_positions R*Tree.  Corrected coordinates
+ * take precedence, and waypoints without coordinates are left out.
+ */
+#define PH_DATABASE_POSITION_INSERT(condition) \
+    "INSERT INTO waypoint_positions " \
+        "SELECT serial, " \
+        "COALESCE(new_latitude, latitude), COALESCE(new_latitude, latitude), " \
+        "COALESCE(new_longitude, longitude), " \
+        "COALESCE(new_longitude, longitude) " \
+        "FROM waypoints LEFT JOIN waypoint_notes USING (id) " \
+        "WHERE COALESCE(new_latitude, latitude) IS NOT NULL " \
+        "AND COALESCE(new_longitude, longitude) IS NOT NULL " condition "; "
+
+/*
+ * Store the position of the waypoint with the given ID again after its
+ * corrected coordinates have changed.  Within triggers, virtual tables see
+ * the conflict resolution of the outer statement, so INSERT OR REPLACE
+ * would not do.
+ */
+#define PH_DATABASE_POSITION_REFRESH(id) \
+    "DELETE FROM waypoint_positions WHERE id = " \
+        "(SELECT serial FROM waypoints WHERE id = " id "); " \
+    PH_DATABASE_POSITION_INSERT("AND waypoints.id = " id)
+
+/*
+ * Triggers keeping the spatial index in line with every change of a
+ * waypoint or of its corrected coordinates.  Connections turn on recursive
+ * triggers, so that rows deleted by REPLACE are removed as well.
+ */
+#define PH_DATABASE_POSITIONS_TRIGGERS \
+    "CREATE TRIGGER waypoint_positions_insert AFTER INSERT ON waypoints " \
+        "BEGIN " PH_DATABASE_POSITION_INSERT("AND serial = new.serial") \
+        "END; " \
+    "CREATE TRIGGER waypoint_positions_update " \
+        "AFTER UPDATE OF serial, id, latitude, longitude ON waypoints " \
+        "BEGIN DELETE FROM waypoint_positions WHERE id = old.serial; " \
+        PH_DATABASE_POSITION_INSERT("AND serial = new.serial") "END; " \
+    "CREATE TRIGGER waypoint_positions_delete AFTER DELETE ON waypoints " \
+        "BEGIN DELETE FROM waypoint_positions WHERE id = old.serial; END; " \
+    "CREATE TRIGGER waypoint_positions_note_insert " \
+        "AFTER INSERT ON waypoint_notes " \
+        "BEGIN " PH_DATABASE_POSITION_REFRESH("new.id") "END; " \
+    "CREATE TRIGGER waypoint_positions_note_update " \
+        "AFTER UPDATE ON waypoint_notes BEGIN " \
+        PH_DATABASE_POSITION_REFRESH("old.id") \
+        PH_DATABASE_POSITION_REFRESH("new.id") "END; " \
+    "CREATE TRIGGER waypoint_positions_note_delete " \
+        "AFTER DELETE ON waypoint_notes " \
+        "BEGIN " PH_DATABASE_POSITION_REFRESH("old.id") "END; "
+
+/*
+ * Spatial index over the effective waypoint coordinates, keyed by the serial
+ * number of the waypoint.  The triggers keep it exact, so queries need not
+ * check the coordinates again.
+ */
+#define PH_DATABASE_POSITIONS_SCHEMA \
+    "CREATE VIRTUAL TABLE waypoint_positions USING rtree_i32(id, " \
+        "min_latitude, max_latitude, min_longitude, max_longitude); " \
+    PH_DATABASE_POSITIONS_TRIGGERS \
+    PH_DATABASE_POSITION_INSERT("")
+
+/*
+ * Triggers handing every change of the indexed texts to the full-text
+ * indexes, unpacking compressed ones.
+ */
+#define PH_DATABASE_TEXT_TRIGGERS \
+    "CREATE TRIGGER geocache_text_insert AFTER INSERT ON geocaches BEGIN " \
+        "INSERT INTO geocache_text (rowid, name, summary, description, " \
+        "hint) VALUES (new.serial, new.name, ph_text(new.summary), " \
+        "ph_text(new.description), new.hint); END; " \
+    "CREATE TRIGGER geocache_text_update " \
+        "AFTER UPDATE OF serial, name, summary, description, hint " \
+        "ON geocaches BEGIN " \
+        "INSERT INTO geocache_text (geocache_text, rowid, name, summary, " \
+        "description, hint) VALUES ('delete', old.serial, old.name, " \
+        "ph_text(old.summary), ph_text(old.description), old.hint); " \
+        "INSERT INTO geocache_text (rowid, name, summary, description, " \
+        "hint) VALUES (new.serial, new.name, ph_text(new.summary), " \
+        "ph_text(new.description), new.hint); END; " \
+    "CREATE TRIGGER geocache_text_delete AFTER DELETE ON geocaches BEGIN " \
+        "INSERT INTO geocache_text (geocache_text, rowid, name, summary, " \
+        "description, hint) VALUES ('delete', old.serial, old.name, " \
+        "ph_text(old.summary), ph_text(old.description), old.hint); END; " \
+    "CREATE TRIGGER log_text_insert AFTER INSERT ON logs BEGIN " \
+        "INSERT INTO log_text (rowid, details) " \
+        "VALUES (new.serial, ph_text(new.details)); END; " \
+    "CREATE TRIGGER log_text_update " \
+        "AFTER UPDATE OF serial, details ON logs BEGIN " \
+        "INSERT INTO log_text (log_text, rowid, details) " \
+        "VALUES ('delete', old.serial, ph_text(old.details)); " \
+        "INSERT INTO log_text (rowid, details) " \
+        "VALUES (new.serial, ph_text(new.details)); END; " \
+    "CREATE TRIGGER log_text_delete AFTER DELETE ON logs BEGIN " \
+        "INSERT INTO log_text (log_text, rowid, details) " \
+        "VALUES ('delete', old.serial, ph_text(old.details)); END; "
+
+/*
+ * Fill the full-text indexes from scratch.  Unlike their 'rebuild' command,
+ * this unpacks compressed texts.
+ */
+#define PH_DATABASE_TEXT_FILL \
+    "INSERT INTO geocache_text (geocache_text) VALUES ('delete-all'); " \
+    "INSERT INTO geocache_text (rowid, name, summary, description, hint) " \
+        "SELECT serial, name, ph_text(summary), ph_text(description), " \
+        "hint FROM geocaches; " \
+    "INSERT INTO log_text (log_text) VALUES ('delete-all'); " \
+    "INSERT INTO log_text (rowid, details) " \
+        "SELECT serial, ph_text(details) FROM logs"
+
+/*
+ * Full-text indexes over the texts of geocaches and logs, keyed by the
+ * serial number of the row they belong to.  They keep no copy of the
+ * content, triggers hand them every change.  Upgrades fill them with
+ * ph_database_rebuild_text().  Full integrity checks read the tables without
+ * unpacking anything, so they cannot be used once texts are compressed.
+ */
+#define PH_DATABASE_TEXT_SCHEMA \
+    "CREATE VIRTUAL TABLE geocache_text USING fts5(name, summary, " \
+        "description, hint, content='geocaches', content_rowid='serial', " \
+        "tokenize='unicode61 remove_diacritics 2'); " \
+    "CREATE VIRTUAL TABLE log_text USING fts5(details, content='logs', " \
+        "content_rowid='serial', " \
+        "tokenize='unicode61 remove_diacritics 2'); " \
+    PH_DATABASE_TEXT_TRIGGERS
 
 /*
  * Read the schema version from the db_info table.  If the database is empty,
@@ -220,31 +791,21 @@ ph_database_create(PHDatabase *database,
                    GError **error)
 {
     gchar *queries[] = {
-        "CREATE TABLE geocaches (id TEXT PRIMARY KEY, name TEXT, creator TEXT, "
-            "owner TEXT, type TINYINT, size TINYINT, difficulty TINYINT, "
-            "terrain TINYINT, attributes TEXT, summary_html BOOLEAN, "
-            "summary TEXT, description_html BOOLEAN, description TEXT, "
-            "hint TEXT, logged BOOLEAN, archived BOOLEAN, available BOOLEAN)",
+        "CREATE TABLE geocaches (" PH_DATABASE_GEOCACHES_COLUMNS ")",
         "CREATE TABLE geocache_notes (id TEXT PRIMARY KEY, "
             "found BOOLEAN, note TEXT)",
-        "CREATE VIEW geocaches_full AS SELECT geocaches.*, "
-            "geocache_notes.found, geocache_notes.note FROM geocaches "
-            "LEFT JOIN geocache_notes USING (id)",
-        "CREATE TABLE waypoints (id TEXT PRIMARY KEY, geocache_id TEXT, "
-            "name TEXT, placed INTEGER, type TINYINT, url TEXT, summary TEXT, "
-            "description TEXT, latitude INTEGER, longitude INTEGER)",
+        PH_DATABASE_GEOCACHES_VIEW,
+        "CREATE TABLE waypoints (" PH_DATABASE_WAYPOINTS_COLUMNS ")",
         "CREATE TABLE waypoint_notes (id TEXT PRIMARY KEY, "
             "new_latitude INTEGER, new_longitude INTEGER)",
-        "CREATE VIEW waypoints_full AS SELECT waypoints.*, "
-            "waypoint_notes.new_latitude, waypoint_notes.new_longitude "
-            "FROM waypoints LEFT JOIN waypoint_notes USING (id)",
-        "CREATE INDEX waypoints_by_geocache ON waypoints (geocache_id)",
-        "CREATE TABLE logs (id INTEGER, geocache_id TEXT, type TINYINT, "
-            "logger TEXT, logged INTEGER, details TEXT, "
-            "PRIMARY KEY (id, geocache_id))",
+        PH_DATABASE_WAYPOINTS_VIEW,
+        "CREATE TABLE logs (" PH_DATABASE_LOGS_COLUMNS ")",
         "CREATE TABLE trackables (id TEXT PRIMARY KEY, name TEXT, "
             "geocache_id TEXT)",
-        "CREATE INDEX trackables_by_geocache ON trackables (geocache_id)",
+        "CREATE TABLE import_journal (filename TEXT PRIMARY KEY, "
+            "size INTEGER, mtime INTEGER)",
+        PH_DATABASE_POSITIONS_SCHEMA,
+        PH_DATABASE_TEXT_SCHEMA,
         NULL
     }, **query;
     gboolean success;
@@ -257,15 +818,262 @@ ph_database_create(PHDatabase *database,
             return FALSE;
     }
 
+    if (!ph_database_create_indexes(database, error))
+        return FALSE;
+
     return ph_database_exec(database,
             "UPDATE db_info SET schema_version = "
             G_STRINGIFY(PH_DATABASE_CURRENT_VERSION),
             error);
 }
 
+/*
+ * Secondary indexes as pairs of name and indexed columns, NULL-terminated.
+ * Bulk imports drop them and build them again at the end.
+ */
+static const gchar *ph_database_indexes[][2] = {
+    { "waypoints_by_geocache", "waypoints (geocache_id)" },
+    { "trackables_by_geocache", "trackables (geocache_id)" },
+    { NULL, NULL }
+};
+
+/*
+ * Create the secondary indexes which do not exist yet.  Filling an index
+ * for a table that is already populated takes a single sorting pass, which
+ * is much cheaper than updating it row by row.  Returns FALSE on error.
+ */
+gboolean
+ph_database_create_indexes(PHDatabase *database,
+                           GError **error)
+{
+    gchar *query;
+    gboolean success = TRUE;
+    guint i;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    for (i = 0; success && ph_database_indexes[i][0] != NULL; ++i) {
+        query = g_strdup_printf("CREATE INDEX IF NOT EXISTS %s ON %s",
+                ph_database_indexes[i][0], ph_database_indexes[i][1]);
+        success = ph_database_exec(database, query, error);
+        g_free(query);
+    }
+
+    return success;
+}
+
+/*
+ * Drop the secondary indexes until ph_database_create_indexes() is called.
+ * Inside a transaction, rolling back restores them.  Returns FALSE on error.
+ */
+gboolean
+ph_database_drop_indexes(PHDatabase *database,
+                         GError **error)
+{
+    gchar *query;
+    gboolean success = TRUE;
+    guint i;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    for (i = 0; success && ph_database_indexes[i][0] != NULL; ++i) {
+        query = g_strdup_printf("DROP INDEX IF EXISTS %s",
+                ph_database_indexes[i][0]);
+        success = ph_database_exec(database, query, error);
+        g_free(query);
+    }
+
+    return success;
+}
+
+/*
+ * Triggers maintaining the spatial and full-text indexes, NULL-terminated.
+ * Bulk imports drop them and fill the indexes in one pass at the end.
+ */
+static const gchar *ph_database_triggers[] = {
+    "waypoint_positions_insert", "waypoint_positions_update",
+    "waypoint_positions_delete", "waypoint_positions_note_insert",
+    "waypoint_positions_note_update", "waypoint_positions_note_delete",
+    "geocache_text_insert", "geocache_text_update", "geocache_text_delete",
+    "log_text_insert", "log_text_update", "log_text_delete",
+    NULL
+};
+
+/*
+ * Drop the triggers maintaining the spatial and full-text indexes until
+ * ph_database_create_triggers() is called.  Inside a transaction, rolling
+ * back restores them.  Returns FALSE on error.
+ */
+gboolean
+ph_database_drop_triggers(PHDatabase *database,
+                          GError **error)
+{
+    gchar *query;
+    gboolean success = TRUE;
+    guint i;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    for (i = 0; success && ph_database_triggers[i] != NULL; ++i) {
+        query = g_strdup_printf("DROP TRIGGER IF EXISTS %s",
+                ph_database_triggers[i]);
+        success = ph_database_exec(database, query, error);
+        g_free(query);
+    }
+
+    return success;
+}
+
+/*
+ * Create the triggers dropped by ph_database_drop_triggers() again and fill
+ * the indexes they maintain from scratch, each in a single set-based pass.
+ * Returns FALSE on error.
+ */
+gboolean
+ph_database_create_triggers(PHDatabase *database,
+                            GError **error)
+{
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    return ph_database_exec(database,
+            PH_DATABASE_POSITIONS_TRIGGERS PH_DATABASE_TEXT_TRIGGERS
+            "DELETE FROM waypoint_positions; "
+            PH_DATABASE_POSITION_INSERT(""), error) &&
+        ph_database_rebuild_text(database, error);
+}
+
+/*
+ * Fill the full-text indexes again from the geocaches and logs tables in a
+ * single pass.  Returns FALSE on error.
+ */
+gboolean
+ph_database_rebuild_text(PHDatabase *database,
+                         GError **error)
+{
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    return ph_database_exec(database, PH_DATABASE_TEXT_FILL, error);
+}
+
+/*
+ * Queries bringing the schema from version n to n + 1, indexed by n - 1.
+ */
+static const gchar *ph_database_upgrades[] = {
+    /* 1 -> 2: hash of the imported content, to skip unchanged geocaches */
+    "ALTER TABLE geocaches ADD COLUMN content_hash INTEGER",
+    /* 2 -> 3: files stored by an import which has not finished */
+    "CREATE TABLE import_journal (filename TEXT PRIMARY KEY, "
+        "size INTEGER, mtime INTEGER)",
+    /* 3 -> 4: spatial index for the geocache list, now created by 7 -> 8 */
+    "",
+    /* 4 -> 5: full-text index for searches, now created by 8 -> 9 */
+    "",
+    /* 5 -> 6: attributes as bitmasks, filled in from entries like "+12;";
+     * older rows may repeat an entry, so each bit is only added once */
+    "ALTER TABLE geocaches ADD COLUMN "
+        "attributes_yes INTEGER NOT NULL DEFAULT 0; "
+    "ALTER TABLE geocaches ADD COLUMN "
+        "attributes_no INTEGER NOT NULL DEFAULT 0; "
+    "UPDATE geocaches SET (attributes_yes, attributes_no) = ("
+        "WITH RECURSIVE entries (sign, id, rest) AS ("
+            "SELECT NULL, NULL, attributes UNION ALL "
+            "SELECT substr(trim(substr(rest, 1, instr(rest, ';') - 1)), 1, 1), "
+            "CAST(substr(trim(substr(rest, 1, instr(rest, ';') - 1)), 2) "
+                "AS INTEGER), "
+            "substr(rest, instr(rest, ';') + 1) "
+            "FROM entries WHERE instr(rest, ';') > 0) "
+        "SELECT "
+        "COALESCE(SUM(DISTINCT CASE sign WHEN '+' THEN 1 << id END), 0), "
+        "COALESCE(SUM(DISTINCT CASE sign WHEN '-' THEN 1 << id END), 0) "
+        "FROM entries WHERE id BETWEEN 0 AND 63) "
+        "WHERE attributes IS NOT NULL",
+    /* 6 -> 7: full-text indexes fed with unpacked texts, now by 8 -> 9 */
+    "",
+    /* 7 -> 8: waypoints with a serial number, which keys the spatial index */
+    "DROP VIEW waypoints_full; "
+    "DROP TABLE IF EXISTS waypoint_positions; "
+    "DROP TRIGGER IF EXISTS waypoint_positions_note_insert; "
+    "DROP TRIGGER IF EXISTS waypoint_positions_note_update; "
+    "DROP TRIGGER IF EXISTS waypoint_positions_note_delete; "
+    "CREATE TABLE waypoints_serial (" PH_DATABASE_WAYPOINTS_COLUMNS "); "
+    "INSERT INTO waypoints_serial (id, geocache_id, name, placed, type, url, "
+        "summary, description, latitude, longitude) "
+        "SELECT id, geocache_id, name, placed, type, url, summary, "
+        "description, latitude, longitude FROM waypoints ORDER BY rowid; "
+    "DROP TABLE waypoints; "
+    "ALTER TABLE waypoints_serial RENAME TO waypoints; "
+    PH_DATABASE_WAYPOINTS_VIEW "; "
+    PH_DATABASE_POSITIONS_SCHEMA,
+    /* 8 -> 9: geocaches and logs with serial numbers, which key the
+     * full-text indexes */
+    "DROP VIEW geocaches_full; "
+    "DROP TRIGGER IF EXISTS geocache_text_insert; "
+    "DROP TRIGGER IF EXISTS geocache_text_update; "
+    "DROP TRIGGER IF EXISTS geocache_text_delete; "
+    "DROP TRIGGER IF EXISTS log_text_insert; "
+    "DROP TRIGGER IF EXISTS log_text_update; "
+    "DROP TRIGGER IF EXISTS log_text_delete; "
+    "DROP TABLE IF EXISTS geocache_text; "
+    "DROP TABLE IF EXISTS log_text; "
+    "CREATE TABLE geocaches_serial (" PH_DATABASE_GEOCACHES_COLUMNS "); "
+    "INSERT INTO geocaches_serial (id, name, creator, owner, type, size, "
+        "difficulty, terrain, attributes, summary_html, summary, "
+        "description_html, description, hint, logged, archived, available, "
+        "content_hash, attributes_yes, attributes_no) "
+        "SELECT id, name, creator, owner, type, size, difficulty, terrain, "
+        "attributes, summary_html, summary, description_html, description, "
+        "hint, logged, archived, available, content_hash, attributes_yes, "
+        "attributes_no FROM geocaches ORDER BY rowid; "
+    "DROP TABLE geocaches; "
+    "ALTER TABLE geocaches_serial RENAME TO geocaches; "
+    PH_DATABASE_GEOCACHES_VIEW "; "
+    "CREATE TABLE logs_serial (" PH_DATABASE_LOGS_COLUMNS "); "
+    "INSERT INTO logs_serial (id, geocache_id, type, logger, logged, "
+        "details) SELECT id, geocache_id, type, logger, logged, details "
+        "FROM logs ORDER BY rowid; "
+    "DROP TABLE logs; "
+    "ALTER TABLE logs_serial RENAME TO logs; "
+    PH_DATABASE_TEXT_SCHEMA
+};
+
+/*
+ * Upgrade the schema of an existing database from the given version to the
+ * current one.  Returns FALSE on error.
+ */
+static gboolean
+ph_database_upgrade(PHDatabase *database,
+                    gint version,
+                    GError **error)
+{
+    g_return_val_if_fail(version >= 1 &&
+            version < PH_DATABASE_CURRENT_VERSION, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    for (; version < PH_DATABASE_CURRENT_VERSION; ++version) {
+        g_message("Upgrading database schema to version %d", version + 1);
+        if (!ph_database_exec(database, ph_database_upgrades[version - 1],
+                    error))
+            return FALSE;
+    }
+
+    /* rebuilt tables have lost their secondary indexes */
+    return ph_database_create_indexes(database, error) &&
+        ph_database_rebuild_text(database, error) &&
+        ph_database_exec(database,
+                "UPDATE db_info SET schema_version = "
+                G_STRINGIFY(PH_DATABASE_CURRENT_VERSION),
+                error);
+}
+
 /*
  * Check whether the database is empty.  If so, let ph_database_create()
- * prepare the schema.  Returns FALSE on error.
+ * prepare the schema; if it is outdated, let ph_database_upgrade() bring it
+ * up to date.  Returns FALSE on error.
  */
 static gboolean
 ph_database_setup(PHDatabase *database,
@@ -283,6 +1091,8 @@ ph_database_setup(PHDatabase *database,
         success = ph_database_create(database, error);
     else if (version == PH_DATABASE_CURRENT_VERSION)
         success = TRUE;
+    else if (version > 0 && version < PH_DATABASE_CURRENT_VERSION)
+        success = ph_database_upgrade(database, version, error);
     else if (version != -1)
         g_set_error(error, PH_DATABASE_ERROR, PH_DATABASE_ERROR_SCHEMA,
                 _("Unknown database schema version in `%s': %d (highest "
@@ -354,6 +1164,74 @@ ph_database_rollback(PHDatabase *database,
     return ph_database_exec(database, "ROLLBACK", error);
 }
 
+/*
+ * Start a named savepoint within a transaction.  Returns FALSE on error.
+ */
+gboolean
+ph_database_savepoint(PHDatabase *database,
+                      const gchar *name,
+                      GError **error)
+{
+    gchar *query;
+    gboolean success;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(name != NULL, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    query = g_strdup_printf("SAVEPOINT %s", name);
+    success = ph_database_exec(database, query, error);
+    g_free(query);
+
+    return success;
+}
+
+/*
+ * Keep the changes made since a savepoint as part of the surrounding
+ * transaction and forget the savepoint.  Returns FALSE on error.
+ */
+gboolean
+ph_database_release(PHDatabase *database,
+                    const gchar *name,
+                    GError **error)
+{
+    gchar *query;
+    gboolean success;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(name != NULL, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    query = g_strdup_printf("RELEASE %s", name);
+    success = ph_database_exec(database, query, error);
+    g_free(query);
+
+    return success;
+}
+
+/*
+ * Undo the changes made since a savepoint and forget it, leaving the
+ * surrounding transaction open.  Returns FALSE on error.
+ */
+gboolean
+ph_database_rollback_to(PHDatabase *database,
+                        const gchar *name,
+                        GError **error)
+{
+    gchar *query;
+    gboolean success;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), FALSE);
+    g_return_val_if_fail(name != NULL, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    query = g_strdup_printf("ROLLBACK TO %s", name);
+    success = ph_database_exec(database, query, error);
+    g_free(query);
+
+    return success && ph_database_release(database, name, error);
+}
+
 /* Prepared statements {{{1 */
 
 /*
@@ -382,6 +1260,138 @@ ph_database_prepare(PHDatabase *database,
     return result;
 }
 
+/*
+ * Maximum number of statements kept by ph_database_prepare_cached().
+ */
+#define PH_DATABASE_CACHE_SIZE 32
+
+/*
+ * Like ph_database_prepare(), but reuse the statement prepared for the same
+ * query the last time unless it has been evicted from the cache since then.
+ * Values have to be passed as bound parameters to make this work.  Hand the
+ * statement back with ph_database_release_cached() instead of finalizing it.
+ * Returns NULL on error.
+ */
+sqlite3_stmt *
+ph_database_prepare_cached(PHDatabase *database,
+                           const gchar *query,
+                           GError **error)
+{
+    GList *link;
+    PHDatabaseCached *cached;
+    sqlite3_stmt *stmt;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), NULL);
+    g_return_val_if_fail(query != NULL, NULL);
+    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+    link = g_hash_table_lookup(database->priv->cache_links, query);
+    if (link != NULL) {
+        cached = (PHDatabaseCached *) link->data;
+        if (cached->busy)
+            /* still in use further up the stack, leave it alone */
+            return ph_database_prepare(database, query, error);
+
+        g_queue_unlink(&database->priv->cache, link);
+        g_queue_push_head_link(&database->priv->cache, link);
+        cached->busy = TRUE;
+        ++database->priv->cache_hits;
+        return cached->stmt;
+    }
+
+    stmt = ph_database_prepare(database, query, error);
+    if (stmt == NULL)
+        return NULL;
+
+    ph_database_cache_trim(database, PH_DATABASE_CACHE_SIZE - 1);
+    cached = g_new(PHDatabaseCached, 1);
+    cached->stmt = stmt;
+    cached->busy = TRUE;
+    g_queue_push_head(&database->priv->cache, cached);
+    g_hash_table_insert(database->priv->cache_links,
+            (gpointer) sqlite3_sql(stmt), database->priv->cache.head);
+    ++database->priv->cache_misses;
+
+    return stmt;
+}
+
+/*
+ * Give back a statement obtained from ph_database_prepare_cached().  Its
+ * bindings are cleared.  No-op for NULL.
+ */
+void
+ph_database_release_cached(PHDatabase *database,
+                           sqlite3_stmt *stmt)
+{
+    GList *link;
+
+    g_return_if_fail(database != NULL && PH_IS_DATABASE(database));
+
+    if (stmt == NULL)
+        return;
+
+    link = g_hash_table_lookup(database->priv->cache_links, sqlite3_sql(stmt));
+    if (link == NULL || ((PHDatabaseCached *) link->data)->stmt != stmt) {
+        /* prepared while the cached one was busy */
+        (void) sqlite3_finalize(stmt);
+        return;
+    }
+
+    (void) sqlite3_reset(stmt);
+    (void) sqlite3_clear_bindings(stmt);
+    ((PHDatabaseCached *) link->data)->busy = FALSE;
+}
+
+/*
+ * Finalize the least recently used statements until at most size are left
+ * in the cache.  Statements still in use are kept regardless.
+ */
+static void
+ph_database_cache_trim(PHDatabase *database,
+                       guint size)
+{
+    GList *link = database->priv->cache.tail, *prev;
+    guint length = database->priv->cache.length;
+
+    for (; link != NULL && length > size; link = prev) {
+        PHDatabaseCached *cached = (PHDatabaseCached *) link->data;
+
+        prev = link->prev;
+        if (cached->busy)
+            continue;
+
+        (void) g_hash_table_remove(database->priv->cache_links,
+                sqlite3_sql(cached->stmt));
+        g_queue_delete_link(&database->priv->cache, link);
+        (void) sqlite3_finalize(cached->stmt);
+        g_free(cached);
+        --length;
+    }
+}
+
+/*
+ * Get the number of statements ph_database_prepare_cached() has reused.
+ */
+guint
+ph_database_get_cache_hits(PHDatabase *database)
+{
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), 0);
+
+    return database->priv->cache_hits;
+}
+
+/*
+ * Get the number of statements ph_database_prepare_cached() has had to
+ * prepare.
+ */
+guint
+ph_database_get_cache_misses(PHDatabase *database)
+{
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), 0);
+
+    return database->priv->cache_misses;
+}
+
 /*
  * Move to the next row in the result set.  Returns SQLITE_DONE if no more
  * data is available, SQLITE_ROW if there is, and the appropriate SQLite
@@ -400,7 +1410,11 @@ ph_database_step(PHDatabase *database,
     g_return_val_if_fail(error == NULL || *error == NULL, SQLITE_ERROR);
 
     rc = sqlite3_step(stmt);
-    if (rc != SQLITE_DONE && rc != SQLITE_ROW)
+    if (rc == SQLITE_BUSY)
+        g_set_error(error, PH_DATABASE_ERROR, PH_DATABASE_ERROR_BUSY,
+                _("The database is locked by another connection: %s"),
+                sqlite3_errmsg(database->priv->connection));
+    else if (rc != SQLITE_DONE && rc != SQLITE_ROW)
         g_set_error(error, PH_DATABASE_ERROR, PH_DATABASE_ERROR_STEP,
                 _("Could not get next row in result set: %s"),
                 sqlite3_errmsg(database->priv->connection));
@@ -433,6 +1447,13 @@ ph_database_exec(PHDatabase *database,
     rc = sqlite3_exec(database->priv->connection, query, NULL, NULL, &errmsg);
     if (rc == SQLITE_OK)
         return TRUE;
+    else if (rc == SQLITE_BUSY) {
+        g_set_error(error, PH_DATABASE_ERROR, PH_DATABASE_ERROR_BUSY,
+                _("The database is locked by another connection: %s"),
+                errmsg);
+        sqlite3_free(errmsg);
+        return FALSE;
+    }
     else {
         g_set_error(error, PH_DATABASE_ERROR, PH_DATABASE_ERROR_SQL,
                 _("SQL statement `%s' failed: %s"), query, errmsg);
@@ -441,6 +1462,41 @@ ph_database_exec(PHDatabase *database,
     }
 }
 
+/*
+ * Build the clause which turns an INSERT into the given NULL-terminated
+ * list of columns into an upsert.  The first keys columns identify the row.
+ * The others are updated on a conflict, but only if at least one of them
+ * differs, so that storing an unchanged row writes nothing at all and does
+ * not count as a change.  Free the result with g_free().
+ */
+gchar *
+ph_database_upsert_clause(const gchar *const *columns,
+                          guint keys)
+{
+    GString *result = g_string_new(" ON CONFLICT (");
+    guint i;
+
+    g_return_val_if_fail(columns != NULL, NULL);
+    g_return_val_if_fail(keys > 0, NULL);
+
+    for (i = 0; i < keys; ++i)
+        g_string_append_printf(result, (i == 0) ? "%s" : ", %s",
+                columns[i]);
+
+    g_string_append(result, ") DO UPDATE SET ");
+    for (i = keys; columns[i] != NULL; ++i)
+        g_string_append_printf(result, (i == keys) ? "%s = excluded.%s" :
+                ", %s = excluded.%s", columns[i], columns[i]);
+
+    g_string_append(result, " WHERE ");
+    for (i = keys; columns[i] != NULL; ++i)
+        g_string_append_printf(result, (i == keys) ?
+                "%s IS NOT excluded.%s" : " OR %s IS NOT excluded.%s",
+                columns[i], columns[i]);
+
+    return g_string_free(result, FALSE);
+}
+
 /* Update notification {{{1 */
 
 /*
@@ -472,6 +1528,20 @@ ph_database_notify_bulk_update(PHDatabase *database)
             0);
 }
 
+/*
+ * Emit the "import-stopped" signal once an import has released the database,
+ * so that writes which failed while it held the lock can be tried again.
+ */
+void
+ph_database_notify_import_stop(PHDatabase *database)
+{
+    g_return_if_fail(database != NULL && PH_IS_DATABASE(database));
+
+    g_signal_emit(database,
+            ph_database_signals[PH_DATABASE_SIGNAL_IMPORT_STOPPED],
+            0);
+}
+
 /* Table names {{{1 */
 
 /*
@@ -499,6 +1569,62 @@ ph_database_table_name(PHDatabaseTable table)
     return ph_database_table_names[index];
 }
 
+/*
+ * Count the rows of a table.  Returns -1 on error.
+ */
+gint64
+ph_database_count_rows(PHDatabase *database,
+                       PHDatabaseTable table,
+                       GError **error)
+{
+    sqlite3_stmt *stmt;
+    gchar *query;
+    gint64 result = -1;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), -1);
+    g_return_val_if_fail(error == NULL || *error == NULL, -1);
+
+    query = g_strdup_printf("SELECT COUNT(*) FROM %s",
+            ph_database_table_name(table));
+    stmt = ph_database_prepare(database, query, error);
+    g_free(query);
+    if (stmt == NULL)
+        return -1;
+
+    if (ph_database_step(database, stmt, error) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+    (void) sqlite3_finalize(stmt);
+
+    return result;
+}
+
+/*
+ * Get the number of bytes in unused pages of the database file, as seen by
+ * the current transaction.  Returns -1 on error.
+ */
+gint64
+ph_database_get_free_space(PHDatabase *database,
+                           GError **error)
+{
+    sqlite3_stmt *stmt;
+    gint64 result = -1;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), -1);
+    g_return_val_if_fail(error == NULL || *error == NULL, -1);
+
+    stmt = ph_database_prepare(database,
+            "SELECT freelist_count * page_size "
+            "FROM pragma_freelist_count, pragma_page_size", error);
+    if (stmt == NULL)
+        return -1;
+
+    if (ph_database_step(database, stmt, error) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+    (void) sqlite3_finalize(stmt);
+
+    return result;
+}
+
 /* Error reporting {{{1 */
 
 /*
@@ -50,6 +50,7 @@ struct _PHDatabaseClass {
     /* signals */
     void (*geocache_updated)(PHDatabase *database, gchar *id);
     void (*bulk_updated)(PHDatabase *database);
+    void (*import_stopped)(PHDatabase *database);
 };
 
 /* Tables and views {{{1 */
@@ -65,12 +66,44 @@ typedef enum _PHDatabaseTable {
     PH_DATABASE_TABLE_TRACKABLES = 0x80
 } PHDatabaseTable;
 
+/* Tuning profiles {{{1 */
+
+/*
+ * Named sets of connection settings (cache and memory map sizes, syncing,
+ * temporary storage and checkpoints) for the different ways of using the
+ * database.
+ */
+typedef enum _PHDatabaseProfile {
+    PH_DATABASE_PROFILE_INTERACTIVE,
+    PH_DATABASE_PROFILE_BULK_IMPORT,
+    PH_DATABASE_PROFILE_ANALYTICS,
+    PH_DATABASE_PROFILE_COUNT
+} PHDatabaseProfile;
+
 /* Public interface {{{1 */
 
 PHDatabase *ph_database_new(const gchar *filename,
                             gboolean create,
                             GError **error);
 const gchar *ph_database_get_filename(PHDatabase *database);
+void ph_database_set_busy_timeout(PHDatabase *database,
+                                  gint timeout);
+
+gboolean ph_database_set_profile(PHDatabase *database,
+                                 PHDatabaseProfile profile,
+                                 GError **error);
+PHDatabaseProfile ph_database_get_profile(PHDatabase *database);
+const gchar *ph_database_profile_name(PHDatabaseProfile profile);
+
+void ph_database_set_compress_texts(PHDatabase *database,
+                                    gboolean compress);
+gboolean ph_database_get_compress_texts(PHDatabase *database);
+void ph_database_bind_packed(PHDatabase *database,
+                             sqlite3_stmt *stmt,
+                             gint index,
+                             const gchar *text);
+gchar *ph_database_column_text(sqlite3_stmt *stmt,
+                               gint column);
 
 gboolean ph_database_begin(PHDatabase *database,
                            GError **error);
@@ -80,20 +113,55 @@ gboolean ph_database_commit_notify(PHDatabase *database,
                                    GError **error);
 gboolean ph_database_rollback(PHDatabase *database,
                               GError **error);
+gboolean ph_database_savepoint(PHDatabase *database,
+                               const gchar *name,
+                               GError **error);
+gboolean ph_database_release(PHDatabase *database,
+                             const gchar *name,
+                             GError **error);
+gboolean ph_database_rollback_to(PHDatabase *database,
+                                 const gchar *name,
+                                 GError **error);
+
+gboolean ph_database_create_indexes(PHDatabase *database,
+                                    GError **error);
+gboolean ph_database_drop_indexes(PHDatabase *database,
+                                  GError **error);
+gboolean ph_database_drop_triggers(PHDatabase *database,
+                                   GError **error);
+gboolean ph_database_create_triggers(PHDatabase *database,
+                                     GError **error);
+gboolean ph_database_rebuild_text(PHDatabase *database,
+                                  GError **error);
+gint64 ph_database_count_rows(PHDatabase *database,
+                              PHDatabaseTable table,
+                              GError **error);
+gint64 ph_database_get_free_space(PHDatabase *database,
+                                  GError **error);
 
 void ph_database_notify_geocache_update(PHDatabase *database,
                                         const gchar *id);
 void ph_database_notify_bulk_update(PHDatabase *database);
+void ph_database_notify_import_stop(PHDatabase *database);
 
 sqlite3_stmt *ph_database_prepare(PHDatabase *database,
                                   const gchar *query,
                                   GError **error);
+sqlite3_stmt *ph_database_prepare_cached(PHDatabase *database,
+                                         const gchar *query,
+                                         GError **error);
+void ph_database_release_cached(PHDatabase *database,
+                                sqlite3_stmt *stmt);
+guint ph_database_get_cache_hits(PHDatabase *database);
+guint ph_database_get_cache_misses(PHDatabase *database);
 gint ph_database_step(PHDatabase *database,
                       sqlite3_stmt *stmt,
                       GError **error);
 gboolean ph_database_exec(PHDatabase *database,
                           const gchar *query,
                           GError **error);
+gchar *ph_database_upsert_clause(const gchar *const *columns,
+                                 guint keys);
 
 const gchar *ph_database_table_name(PHDatabaseTable table);
 
@@ -110,7 +178,8 @@ typedef enum {
     PH_DATABASE_ERROR_STEP,
     PH_DATABASE_ERROR_SCHEMA,
     PH_DATABASE_ERROR_INCONSISTENT,
-    PH_DATABASE_ERROR_FAILED
+    PH_DATABASE_ERROR_FAILED,
+    PH_DATABASE_ERROR_BUSY
 } PHDatabaseError;
 
 /* }}} */
@@ -42,7 +42,7 @@ static guint ph_detail_view_signals[PH_DETAIL_VIEW_SIGNAL_COUNT];
 
 struct _PHDetailViewPrivate {
     PHDatabase *database;               /* data source */
-    gulong db_signal_handlers[2];       /* database signal handlers */
+    gulong db_signal_handlers[3];       /* database signal handlers */
     gboolean updating;                  /* did we trigger DB signals? */
 
     /* displaying immutable data */
@@ -64,6 +64,10 @@ struct _PHDetailViewPrivate {
     GtkTreePath *current_waypoint;
     GtkWidget *waypoint_editor;
     GtkWidget *waypoint_edit_buttons;
+
+    /* notes not written because the database was locked */
+    PHGeocacheNote *pending_geocache_note;
+    GList *pending_waypoint_notes;
 };
 
 /* Forward declarations {{{1 */
@@ -87,9 +91,16 @@ static void ph_detail_view_set_database(PHDetailView *view,
 static void ph_detail_view_geocache_updated(PHDatabase *database, gchar *id,
                                             gpointer data);
 static void ph_detail_view_bulk_updated(PHDatabase *database, gpointer data);
+static void ph_detail_view_import_stopped(PHDatabase *database,
+                                          gpointer data);
 static void ph_detail_view_store_geocache_note(PHDetailView *view);
 static void ph_detail_view_store_waypoint_note(PHDetailView *view,
                                                const PHWaypointNote *note);
+static gboolean ph_detail_view_store_pending_notes(PHDetailView *view,
+                                                   GError **error);
+static void ph_detail_view_report_note_error(PHDetailView *view,
+                                             const gchar *message,
+                                             const GError *error);
 
 static gboolean ph_detail_view_load(PHDetailView *view, const gchar *id,
                                     GError **error);
@@ -204,9 +215,18 @@ static void
 ph_detail_view_dispose(GObject *object)
 {
     PHDetailView *view = PH_DETAIL_VIEW(object);
+    GError *error = NULL;
 
-    if (view->priv->database != NULL)
+    if (view->priv->database != NULL) {
+        /* last chance for notes kept while an import was running */
+        view->priv->updating = TRUE;
+        if (!ph_detail_view_store_pending_notes(view, &error)) {
+            g_warning("Discarding notes on %s: %s",
+                    view->priv->geocache_note->id, error->message);
+            g_error_free(error);
+        }
         ph_detail_view_set_database(view, NULL);
+    }
 
     if (G_OBJECT_CLASS(ph_detail_view_parent_class)->dispose != NULL)
         G_OBJECT_CLASS(ph_detail_view_parent_class)->dispose(object);
@@ -223,6 +243,10 @@ ph_detail_view_finalize(GObject *object) {
         ph_geocache_note_free(view->priv->geocache_note);
     if (view->priv->current_waypoint != NULL)
         gtk_tree_path_free(view->priv->current_waypoint);
+    if (view->priv->pending_geocache_note != NULL)
+        ph_geocache_note_free(view->priv->pending_geocache_note);
+    g_list_free_full(view->priv->pending_waypoint_notes,
+            (GDestroyNotify) ph_waypoint_note_free);
 
     if (G_OBJECT_CLASS(ph_detail_view_parent_class)->finalize != NULL)
         G_OBJECT_CLASS(ph_detail_view_parent_class)->finalize(object);
@@ -611,6 +635,9 @@ ph_detail_view_set_database(PHDetailView *view,
         view->priv->db_signal_handlers[1] =
             g_signal_connect(view->priv->database, "bulk-updated",
                     G_CALLBACK(ph_detail_view_bulk_updated), view);
+        view->priv->db_signal_handlers[2] =
+            g_signal_connect(view->priv->database, "import-stopped",
+                    G_CALLBACK(ph_detail_view_import_stopped), view);
     }
 }
 
@@ -649,6 +676,24 @@ ph_detail_view_bulk_updated(PHDatabase *database,
     (void) ph_detail_view_load(view, view->priv->geocache_note->id, NULL);
 }
 
+/*
+ * An import has released the database.  Write the notes which could not be
+ * stored while it was running.
+ */
+static void
+ph_detail_view_import_stopped(PHDatabase *database,
+                              gpointer data)
+{
+    PHDetailView *view = PH_DETAIL_VIEW(data);
+    GError *error = NULL;
+
+    if (!ph_detail_view_store_pending_notes(view, &error)) {
+        ph_detail_view_report_note_error(view,
+                _("Cannot write the notes to the database."), error);
+        g_error_free(error);
+    }
+}
+
 /*
  * Load geocache, waypoint, log and trackable information from the database and
  * display it.
@@ -691,7 +736,8 @@ ph_detail_view_load(PHDetailView *view,
 }
 
 /*
- * Store a geocache note in the database and notify.
+ * Store a geocache note in the database and notify.  If the database is
+ * locked, keep a copy to be written once the import holding it has stopped.
  */
 static void
 ph_detail_view_store_geocache_note(PHDetailView *view)
@@ -700,29 +746,30 @@ ph_detail_view_store_geocache_note(PHDetailView *view)
     PHDatabase *database = view->priv->database;
     GError *error = NULL;
 
+    if (view->priv->pending_geocache_note != NULL) {
+        /* superseded by the current state */
+        ph_geocache_note_free(view->priv->pending_geocache_note);
+        view->priv->pending_geocache_note = NULL;
+    }
+
     if (ph_geocache_note_store(note, database, &error)) {
         view->priv->updating = TRUE;
         ph_database_notify_geocache_update(database, note->id);
         view->priv->updating = FALSE;
     }
     else {
-        GtkWidget *toplevel = gtk_widget_get_toplevel(GTK_WIDGET(view));
-        if (GTK_IS_WINDOW(toplevel)) {
-            GtkWidget *message = gtk_message_dialog_new(
-                GTK_WINDOW(toplevel), GTK_DIALOG_MODAL,
-                GTK_MESSAGE_ERROR, GTK_BUTTONS_CANCEL,
-                _("Cannot write the geocache note to the database."));
-            gtk_message_dialog_format_secondary_text(
-                GTK_MESSAGE_DIALOG(message), "%s.", error->message);
-            gtk_dialog_run(GTK_DIALOG(message));
-            gtk_widget_destroy(message);
-        }
+        if (g_error_matches(error, PH_DATABASE_ERROR,
+                    PH_DATABASE_ERROR_BUSY))
+            view->priv->pending_geocache_note = ph_geocache_note_copy(note);
+        ph_detail_view_report_note_error(view,
+                _("Cannot write the geocache note to the database."), error);
         g_error_free(error);
     }
 }
 
 /*
- * Store a waypoint note in the database and notify.
+ * Store a waypoint note in the database and notify.  If the database is
+ * locked, keep a copy to be written once the import holding it has stopped.
  */
 static void
 ph_detail_view_store_waypoint_note(PHDetailView *view,
@@ -731,6 +778,19 @@ ph_detail_view_store_waypoint_note(PHDetailView *view,
     PHDatabase *database = view->priv->database;
     gchar *geocache_id = view->priv->geocache_note->id;
     GError *error = NULL;
+    GList *pending;
+
+    for (pending = view->priv->pending_waypoint_notes; pending != NULL;
+            pending = pending->next) {
+        PHWaypointNote *old = (PHWaypointNote *) pending->data;
+        if (strcmp(old->id, note->id) == 0) {
+            /* superseded by the current state */
+            ph_waypoint_note_free(old);
+            view->priv->pending_waypoint_notes = g_list_delete_link(
+                    view->priv->pending_waypoint_notes, pending);
+            break;
+        }
+    }
 
     if (ph_waypoint_note_store(note, database, &error)) {
         view->priv->updating = TRUE;
@@ -738,21 +798,88 @@ ph_detail_view_store_waypoint_note(PHDetailView *view,
         view->priv->updating = FALSE;
     }
     else {
-        GtkWidget *toplevel = gtk_widget_get_toplevel(GTK_WIDGET(view));
-        if (GTK_IS_WINDOW(toplevel)) {
-            GtkWidget *message = gtk_message_dialog_new(
-                GTK_WINDOW(toplevel), GTK_DIALOG_MODAL,
-                GTK_MESSAGE_ERROR, GTK_BUTTONS_CANCEL,
-                _("Cannot write the waypoint note to the database."));
-            gtk_message_dialog_format_secondary_text(
-                GTK_MESSAGE_DIALOG(message), "%s.", error->message);
-            gtk_dialog_run(GTK_DIALOG(message));
-            gtk_widget_destroy(message);
-        }
+        if (g_error_matches(error, PH_DATABASE_ERROR,
+                    PH_DATABASE_ERROR_BUSY))
+            view->priv->pending_waypoint_notes = g_list_append(
+                    view->priv->pending_waypoint_notes,
+                    ph_waypoint_note_copy(note));
+        ph_detail_view_report_note_error(view,
+                _("Cannot write the waypoint note to the database."), error);
         g_error_free(error);
     }
 }
 
+/*
+ * Write the notes kept by ph_detail_view_store_geocache_note() and
+ * ph_detail_view_store_waypoint_note() while the database was locked.  Notes
+ * which still cannot be written are kept for the next attempt.  Returns
+ * FALSE on error.
+ */
+static gboolean
+ph_detail_view_store_pending_notes(PHDetailView *view,
+                                   GError **error)
+{
+    PHDatabase *database = view->priv->database;
+    gboolean stored = FALSE;
+    GList *pending;
+
+    if (view->priv->pending_geocache_note != NULL) {
+        if (!ph_geocache_note_store(view->priv->pending_geocache_note,
+                    database, error))
+            return FALSE;
+        ph_geocache_note_free(view->priv->pending_geocache_note);
+        view->priv->pending_geocache_note = NULL;
+        stored = TRUE;
+    }
+
+    while ((pending = view->priv->pending_waypoint_notes) != NULL) {
+        if (!ph_waypoint_note_store((PHWaypointNote *) pending->data,
+                    database, error))
+            break;
+        ph_waypoint_note_free((PHWaypointNote *) pending->data);
+        view->priv->pending_waypoint_notes = g_list_delete_link(
+                view->priv->pending_waypoint_notes, pending);
+        stored = TRUE;
+    }
+
+    /* the import may have reloaded the view with the old notes */
+    if (stored)
+        ph_database_notify_geocache_update(database,
+                view->priv->geocache_note->id);
+
+    return (pending == NULL);
+}
+
+/*
+ * Tell the user that a note could not be written.  If the database was
+ * locked, most likely by an import, the note is written again later.
+ */
+static void
+ph_detail_view_report_note_error(PHDetailView *view,
+                                 const gchar *message,
+                                 const GError *error)
+{
+    GtkWidget *toplevel = gtk_widget_get_toplevel(GTK_WIDGET(view));
+    GtkWidget *dialog;
+
+    if (!GTK_IS_WINDOW(toplevel))
+        return;
+
+    dialog = gtk_message_dialog_new(
+        GTK_WINDOW(toplevel), GTK_DIALOG_MODAL,
+        GTK_MESSAGE_ERROR, GTK_BUTTONS_CANCEL, "%s", message);
+    if (g_error_matches(error, PH_DATABASE_ERROR, PH_DATABASE_ERROR_BUSY))
+        gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog),
+                _("%s.\n\nAn import is probably in progress.  The note has "
+                    "been kept and will be written when it has finished."),
+                error->message);
+    else
+        gtk_message_dialog_format_secondary_text(GTK_MESSAGE_DIALOG(dialog),
+                "%s.", error->message);
+    gtk_dialog_run(GTK_DIALOG(dialog));
+    gtk_widget_destroy(dialog);
+}
+
 /* Show a geocache {{{1 */
 
 static const gchar *ph_detail_view_css =
@@ -111,7 +111,9 @@ static void ph_geocache_list_delete_entry_by_id(PHGeocacheList *list,
 static gchar *ph_geocache_list_sql_from_query(const gchar *query,
                                               GError **error);
 static gchar *ph_geocache_list_sql_constrain(PHGeocacheList *list,
-                                             const gchar *geocache_id);
+                                             gboolean single);
+static sqlite3_stmt *ph_geocache_list_prepare(PHGeocacheList *list,
+                                              const gchar *geocache_id);
 
 static void ph_geocache_list_run_query(PHGeocacheList *list, gboolean update);
 static void ph_geocache_list_filter(PHGeocacheList *list);
@@ -879,31 +881,61 @@ ph_geocache_list_sql_from_query(const gchar *query,
             error);
 }
 
+/*
+ * Restrict the query to the loaded range and, if single is set, to one
+ * geocache.  The range and the ID are left as parameters, so that the
+ * statement can be reused; ph_geocache_list_prepare() binds them.  The
+ * waypoint_positions R*Tree holds the exact effective coordinates of every
+ * waypoint, so it finds those in range without scanning the table.
+ */
 static gchar *
 ph_geocache_list_sql_constrain(PHGeocacheList *list,
-                               const gchar *geocache_id)
+                               gboolean single)
 {
     GString *result = g_string_new(list->priv->sql);
 
-    g_string_append_printf(result, " "
-            "AND (COALESCE(waypoint_notes.new_latitude, waypoints.latitude) "
-            "BETWEEN %d AND %d) "
-            "AND (COALESCE(waypoint_notes.new_longitude, waypoints.longitude) "
-            "BETWEEN %d AND %d) ",
-            list->priv->loaded_range.south, list->priv->loaded_range.north,
-            list->priv->loaded_range.west, list->priv->loaded_range.east);
-
-    if (geocache_id != NULL) {
-        char *quoted = sqlite3_mprintf("%Q", geocache_id);
-        g_string_append_printf(result, "AND geocaches.id = %s ", quoted);
-        sqlite3_free(quoted);
-    }
+    g_string_append(result, " "
+            "AND waypoints.serial IN (SELECT id FROM waypoint_positions "
+            "WHERE max_latitude >= ?1 AND min_latitude <= ?2 "
+            "AND max_longitude >= ?3 AND min_longitude <= ?4) ");
+
+    if (single)
+        g_string_append(result, "AND geocaches.id = ?5 ");
 
     g_string_append(result, "ORDER BY geocaches.name ASC, geocaches.id ASC");
 
     return g_string_free(result, FALSE);
 }
 
+/*
+ * Get a statement for the geocaches in the loaded range, or only the one
+ * with the given ID if it is not NULL.  Release it with
+ * ph_database_release_cached().  Returns NULL on error.
+ */
+static sqlite3_stmt *
+ph_geocache_list_prepare(PHGeocacheList *list,
+                         const gchar *geocache_id)
+{
+    gchar *sql;
+    sqlite3_stmt *stmt;
+
+    sql = ph_geocache_list_sql_constrain(list, geocache_id != NULL);
+    stmt = ph_database_prepare_cached(list->priv->database, sql, NULL);
+    g_free(sql);
+
+    if (stmt == NULL)
+        return NULL;
+
+    (void) sqlite3_bind_int(stmt, 1, list->priv->loaded_range.south);
+    (void) sqlite3_bind_int(stmt, 2, list->priv->loaded_range.north);
+    (void) sqlite3_bind_int(stmt, 3, list->priv->loaded_range.west);
+    (void) sqlite3_bind_int(stmt, 4, list->priv->loaded_range.east);
+    if (geocache_id != NULL)
+        (void) sqlite3_bind_text(stmt, 5, geocache_id, -1, SQLITE_STATIC);
+
+    return stmt;
+}
+
 /* Load from the database {{{1 */
 
 /*
@@ -913,17 +945,13 @@ static void
 ph_geocache_list_run_query(PHGeocacheList *list,
                            gboolean update)
 {
-    gchar *sql;
     sqlite3_stmt *stmt;
     gint status;
     GList *visible_cur, *loaded_cur;
     gint pos;
     gboolean changed = FALSE;
 
-    sql = ph_geocache_list_sql_constrain(list, NULL);
-    stmt = ph_database_prepare(list->priv->database, sql, NULL);
-    g_free(sql);
-
+    stmt = ph_geocache_list_prepare(list, NULL);
     if (stmt == NULL)
         return;
 
@@ -1033,7 +1061,7 @@ ph_geocache_list_run_query(PHGeocacheList *list,
         }
     }
 
-    (void) sqlite3_finalize(stmt);
+    ph_database_release_cached(list->priv->database, stmt);
 
     list->priv->visible_length = pos;
 
@@ -1129,14 +1157,10 @@ ph_geocache_list_geocache_updated(PHDatabase *database,
                                   gpointer data)
 {
     PHGeocacheList *list = PH_GEOCACHE_LIST(data);
-    gchar *sql;
     sqlite3_stmt *stmt;
     gint status;
 
-    sql = ph_geocache_list_sql_constrain(list, id);
-    stmt = ph_database_prepare(list->priv->database, sql, NULL);
-    g_free(sql);
-
+    stmt = ph_geocache_list_prepare(list, id);
     if (stmt == NULL)
         return;
 
@@ -1150,7 +1174,7 @@ ph_geocache_list_geocache_updated(PHDatabase *database,
         ph_geocache_list_delete_entry_by_id(list, id);
     }
 
-    (void) sqlite3_finalize(stmt);
+    ph_database_release_cached(list->priv->database, stmt);
 
     g_signal_emit(list,
             ph_geocache_list_signals[PH_GEOCACHE_LIST_SIGNAL_UPDATED],
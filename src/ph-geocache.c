@@ -11,7 +11,7 @@
 /* Includes {{{1 */
 
 #include "ph-geocache.h"
-#include <stdlib.h>
+#include <string.h>
 #include <glib/gi18n.h>
 
 /* Forward declarations {{{1 */
@@ -56,12 +56,12 @@ ph_geocache_from_row(PHGeocache *gc,
     gc->size = sqlite3_column_int(stmt, 5);
     gc->difficulty = sqlite3_column_int(stmt, 6);
     gc->terrain = sqlite3_column_int(stmt, 7);
-    gc->attributes = ph_geocache_attrs_from_string(
+    ph_geocache_attrs_from_string(&gc->attributes,
             (const gchar *) sqlite3_column_text(stmt, 8));
     gc->summary_html = (sqlite3_column_int(stmt, 9) != 0);
-    gc->summary = g_strdup((const gchar *) sqlite3_column_text(stmt, 10));
+    gc->summary = ph_database_column_text(stmt, 10);
     gc->description_html = (sqlite3_column_int(stmt, 11));
-    gc->description = g_strdup((const gchar *) sqlite3_column_text(stmt, 12));
+    gc->description = ph_database_column_text(stmt, 12);
     gc->hint = g_strdup((const gchar *) sqlite3_column_text(stmt, 13));
     gc->logged = (sqlite3_column_int(stmt, 14) != 0);
     gc->archived = (sqlite3_column_int(stmt, 15) != 0);
@@ -86,7 +86,7 @@ ph_geocache_load_by_id(PHDatabase *database,
                        GError **error)
 {
     PHGeocache *result = NULL;
-    char *query;
+    const gchar *query;
     sqlite3_stmt *stmt;
     gint status;
 
@@ -95,19 +95,19 @@ ph_geocache_load_by_id(PHDatabase *database,
     g_return_val_if_fail(error == NULL || *error == NULL, NULL);
 
     if (full)
-        query = sqlite3_mprintf("SELECT id, name, creator, owner, type, size, "
+        query = "SELECT id, name, creator, owner, type, size, "
                 "difficulty, terrain, attributes, summary_html, summary, "
                 "description_html, description, hint, logged, archived, "
-                "available, found, note FROM geocaches_full WHERE id = %Q", id);
+                "available, found, note FROM geocaches_full WHERE id = ?";
     else
-        query = sqlite3_mprintf("SELECT id, name, creator, owner, type, size, "
+        query = "SELECT id, name, creator, owner, type, size, "
                 "difficulty, terrain, attributes, summary_html, summary, "
                 "description_html, description, hint, logged, archived, "
-                "available FROM geocaches WHERE id = %Q", id);
-    stmt = ph_database_prepare(database, query, error);
-    sqlite3_free(query);
+                "available FROM geocaches WHERE id = ?";
+    stmt = ph_database_prepare_cached(database, query, error);
     if (stmt == NULL)
         return FALSE;
+    (void) sqlite3_bind_text(stmt, 1, id, -1, SQLITE_STATIC);
 
     status = ph_database_step(database, stmt, error);
     if (status == SQLITE_DONE)
@@ -118,7 +118,7 @@ ph_geocache_load_by_id(PHDatabase *database,
         ph_geocache_from_row(result, stmt, full);
     }
 
-    sqlite3_finalize(stmt);
+    ph_database_release_cached(database, stmt);
 
     return result;
 }
@@ -141,7 +141,6 @@ ph_geocache_free(PHGeocache *gc)
     g_free(gc->summary);
     g_free(gc->description);
     g_free(gc->hint);
-    ph_geocache_attrs_free(gc->attributes);
     /* do not free gc->note.id (== gc->id) */
     g_free(gc->note.note);
     g_free(gc);
@@ -179,8 +178,21 @@ ph_geocache_note_free(PHGeocacheNote *note)
 /* Database storage {{{1 */
 
 /*
- * Store the given geocache in the database.  Uses an INSERT OR REPLACE
- * statement to avoid duplicates.  Returns FALSE on error.
+ * Columns written by ph_geocache_store(), starting with the primary key.
+ */
+static const gchar *const ph_geocache_columns[] = {
+    "id", "name", "creator", "owner", "type", "size", "difficulty",
+    "terrain", "attributes", "summary_html", "summary", "description_html",
+    "description", "hint", "logged", "archived", "available", "content_hash",
+    "attributes_yes", "attributes_no", NULL
+};
+
+/*
+ * Store the given geocache in the database, updating an existing row with
+ * the same ID only if anything has changed.  The content hash of the last
+ * import is cleared, so that the next import does not skip the geocache.
+ * The summary and the description are compressed if the database is set up
+ * to do so.  Returns FALSE on error.
  */
 gboolean
 ph_geocache_store(const PHGeocache *gc,
@@ -189,25 +201,31 @@ ph_geocache_store(const PHGeocache *gc,
 {
     char *query;
     gboolean success;
-    gchar *attributes;
+    gchar *attributes, *upsert;
 
     g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-    attributes = ph_geocache_attrs_to_string(gc->attributes);
-    query = sqlite3_mprintf("INSERT OR REPLACE INTO geocaches "
+    attributes = ph_geocache_attrs_to_string(&gc->attributes);
+    upsert = ph_database_upsert_clause(ph_geocache_columns, 1);
+    query = sqlite3_mprintf("INSERT INTO geocaches "
             "(id, name, creator, owner, type, size, difficulty, terrain, "
             "attributes, summary_html, summary, description_html, description, "
-            "hint, logged, archived, available) VALUES "
-            "(%Q, %Q, %Q, %Q, %d, %d, %d, %d, %Q, %d, %Q, %d, %Q, %Q, "
-            "%d, %d, %d)",
+            "hint, logged, archived, available, content_hash, "
+            "attributes_yes, attributes_no) VALUES "
+            "(%Q, %Q, %Q, %Q, %d, %d, %d, %d, %Q, %d, ph_pack(%Q), "
+            "%d, ph_pack(%Q), %Q, %d, %d, %d, NULL, %lld, %lld)%s",
             gc->id, gc->name, gc->creator, gc->owner, gc->type,
             gc->size, gc->difficulty, gc->terrain, attributes,
             gc->summary_html ? 1 : 0, gc->summary,
             gc->description_html ? 1 : 0, gc->description,
             gc->hint, gc->logged ? 1 : 0,
-            gc->archived ? 1 : 0, gc->available ? 1 : 0);
+            gc->archived ? 1 : 0, gc->available ? 1 : 0,
+            (sqlite3_int64) ph_geocache_attrs_get_mask(&gc->attributes, TRUE),
+            (sqlite3_int64) ph_geocache_attrs_get_mask(&gc->attributes, FALSE),
+            upsert);
     success = ph_database_exec(database, query, error);
     g_free(attributes);
+    g_free(upsert);
     sqlite3_free(query);
 
     return success;
@@ -239,165 +257,171 @@ ph_geocache_note_store(const PHGeocacheNote *note,
 /* Attribute handling {{{1 */
 
 /*
- * Create a list of geocache attributes from a string stored in the database.
+ * Bit of an attribute ID within its word of a PHGeocacheAttrs bitset.
+ */
+#define PH_GEOCACHE_ATTRS_BIT(id) (G_GUINT64_CONSTANT(1) << ((id) % 64))
+
+/*
+ * Fill in attributes from a string stored in the database, which consists of
+ * entries like "+12;" or "-3;".  Anything else between them is skipped.
  */
-PHGeocacheAttrs *
-ph_geocache_attrs_from_string(const gchar *input)
+void
+ph_geocache_attrs_from_string(PHGeocacheAttrs *attrs,
+                              const gchar *input)
 {
-    PHGeocacheAttrs *result = NULL;
-    static GRegex *regex = NULL;
-    GMatchInfo *match;
-    gboolean matched;
-
-    if (regex == NULL) {
-        regex = g_regex_new("([+-])(\\d+);", 0, 0, NULL);
-        g_return_val_if_fail(regex != NULL, NULL);
-    }
+    const gchar *cur = input;
 
-    matched = g_regex_match(regex, input, 0, &match);
-    while (matched) {
-        PHGeocacheAttrs *attr = g_new(PHGeocacheAttrs, 1);
-        gchar *temp;
-
-        attr->next = result;
-        attr->id = atoi(temp = g_match_info_fetch(match, 2));
-        g_free(temp);
-        attr->value = ((temp = g_match_info_fetch(match, 1))[0] == '+');
-        g_free(temp);
-        result = attr;
-        matched = g_match_info_next(match, NULL);
-    }
-    g_match_info_free(match);
+    g_return_if_fail(attrs != NULL);
 
-    return result;
+    memset(attrs, 0, sizeof(PHGeocacheAttrs));
+    if (input == NULL)
+        return;
+
+    while (*cur != '\0') {
+        const gchar *start;
+        gboolean value;
+        guint id = 0;
+
+        if (*cur != '+' && *cur != '-') {
+            ++cur;
+            continue;
+        }
+
+        value = (*cur == '+');
+        start = ++cur;
+        while (g_ascii_isdigit(*cur) && id < PH_GEOCACHE_ATTRS_SIZE)
+            id = id * 10 + (*cur++ - '0');
+
+        if (cur > start && *cur == ';') {
+            ph_geocache_attrs_set(attrs, id, value);
+            ++cur;
+        }
+    }
 }
 
 /*
  * Create a parseable and searchable string representing the geocache
- * attributes.
+ * attributes, in the order of their IDs.
  */
 gchar *
 ph_geocache_attrs_to_string(const PHGeocacheAttrs *attrs)
 {
-    GString *result = g_string_new("");
+    /* "+127; " for each of them */
+    gchar buffer[PH_GEOCACHE_ATTRS_SIZE * 6 + 1];
+    gchar *cur = buffer;
+    guint id;
 
-    for (; attrs != NULL; attrs = attrs->next)
-        g_string_append_printf(result, "%c%d; ",
-                attrs->value ? '+' : '-', attrs->id);
+    g_return_val_if_fail(attrs != NULL, NULL);
 
-    if (result->len > 0)
-        /* remove trailing space */
-        g_string_truncate(result, result->len - 1);
+    for (id = 0; id < PH_GEOCACHE_ATTRS_SIZE; ++id) {
+        guint64 bit = PH_GEOCACHE_ATTRS_BIT(id);
 
-    return g_string_free(result, FALSE);
+        if ((attrs->yes[id / 64] & bit) != 0)
+            *cur++ = '+';
+        else if ((attrs->no[id / 64] & bit) != 0)
+            *cur++ = '-';
+        else
+            continue;
+
+        if (id >= 100)
+            *cur++ = '0' + id / 100;
+        if (id >= 10)
+            *cur++ = '0' + id / 10 % 10;
+        *cur++ = '0' + id % 10;
+        *cur++ = ';';
+        *cur++ = ' ';
+    }
+
+    /* remove trailing space */
+    return g_strndup(buffer, (cur > buffer) ? cur - buffer - 1 : 0);
 }
 
 /*
- * Search the attribute list for the given ID.  NULL will be returned if no
- * match could be found.
+ * Look up the attribute with the given ID.  Returns FALSE if it is not
+ * defined, otherwise stores its setting in value, which may be NULL.
  */
-PHGeocacheAttrs *
-ph_geocache_attrs_find(PHGeocacheAttrs *attrs,
-                       PHGeocacheAttrID id)
+gboolean
+ph_geocache_attrs_find(const PHGeocacheAttrs *attrs,
+                       PHGeocacheAttrID id,
+                       gboolean *value)
 {
-    while (attrs != NULL && attrs->id != id)
-        attrs = attrs->next;
-    return attrs;
+    guint64 bit = PH_GEOCACHE_ATTRS_BIT(id);
+
+    g_return_val_if_fail(attrs != NULL, FALSE);
+
+    if (id >= PH_GEOCACHE_ATTRS_SIZE)
+        return FALSE;
+    else if ((attrs->yes[id / 64] & bit) != 0) {
+        if (value != NULL)
+            *value = TRUE;
+        return TRUE;
+    }
+    else if ((attrs->no[id / 64] & bit) != 0) {
+        if (value != NULL)
+            *value = FALSE;
+        return TRUE;
+    }
+    else
+        return FALSE;
 }
 
 /*
- * Set the entry from the attribute list with the given id to value.  If
- * necessary, create the entry.  Returns the new head of the list.
+ * Set the attribute with the given ID to value.  IDs beyond the capacity of
+ * the bitsets are ignored.
  */
-PHGeocacheAttrs *
+void
 ph_geocache_attrs_set(PHGeocacheAttrs *attrs,
                       PHGeocacheAttrID id,
                       gboolean value)
 {
-    PHGeocacheAttrs *cur = attrs, *prev = NULL;
+    guint64 bit = PH_GEOCACHE_ATTRS_BIT(id);
 
-    while (cur != NULL && cur->id != id) {
-        prev = cur;
-        cur = cur->next;
-    }
+    g_return_if_fail(attrs != NULL);
 
-    if (cur == NULL) {
-        cur = ph_geocache_attrs_prepend(NULL, id, value);
-        if (prev == NULL)
-            return cur;
-        else {
-            prev->next = cur;
-            return attrs;
-        }
+    if (id >= PH_GEOCACHE_ATTRS_SIZE)
+        return;
+
+    if (value) {
+        attrs->yes[id / 64] |= bit;
+        attrs->no[id / 64] &= ~bit;
     }
     else {
-        cur->value = value;
-        return attrs;
+        attrs->yes[id / 64] &= ~bit;
+        attrs->no[id / 64] |= bit;
     }
 }
 
 /*
- * Allocate a PHGeocacheAttrs with the given id and value and adds it at the
- * head of the list.  Returns the new head.
+ * Remove the attribute with the given ID.  This is different from
+ * ph_geocache_attrs_set() with a FALSE value in that it signifies an
+ * undefined attribute.
  */
-PHGeocacheAttrs *
-ph_geocache_attrs_prepend(PHGeocacheAttrs *attrs,
-                          PHGeocacheAttrID id,
-                          gboolean value)
-{
-    PHGeocacheAttrs *result = g_new(PHGeocacheAttrs, 1);
-
-    result->next = attrs;
-    result->id = id;
-    result->value = value;
-
-    return result;
-}
-
-/*
- * Search attrs for an entry for the given id, remove this entry from the list
- * and deallocate its memory.  Returns the new head of the list.  This is
- * different from ph_geocache_attrs_set() with a FALSE value in that it
- * signifies an undefined attribute.
- */
-PHGeocacheAttrs *
+void
 ph_geocache_attrs_unset(PHGeocacheAttrs *attrs,
                         PHGeocacheAttrID id)
 {
-    PHGeocacheAttrs *cur = attrs, *prev = NULL;
+    guint64 bit = PH_GEOCACHE_ATTRS_BIT(id);
 
-    while (cur != NULL && cur->id != id) {
-        prev = cur;
-        cur = cur->next;
-    }
+    g_return_if_fail(attrs != NULL);
 
-    if (cur == NULL)
-        return attrs;
-    else {
-        PHGeocacheAttrs *next = cur->next;
-        g_free(cur);
-        if (prev != NULL) {
-            prev->next = next;
-            return attrs;
-        }
-        else
-            return next;
-    }
+    if (id >= PH_GEOCACHE_ATTRS_SIZE)
+        return;
+
+    attrs->yes[id / 64] &= ~bit;
+    attrs->no[id / 64] &= ~bit;
 }
 
 /*
- * Traverse the list of attributes and free all entries.
+ * Get the bits of the attributes with IDs below PH_GEOCACHE_ATTRS_MASK_SIZE
+ * which are set to value, as a signed integer for SQLite.
  */
-void
-ph_geocache_attrs_free(PHGeocacheAttrs *attrs)
+gint64
+ph_geocache_attrs_get_mask(const PHGeocacheAttrs *attrs,
+                           gboolean value)
 {
-    PHGeocacheAttrs *next;
+    g_return_val_if_fail(attrs != NULL, 0);
 
-    while (attrs != NULL) {
-        next = attrs->next;
-        g_free(attrs);
-        attrs = next;
-    }
+    return (gint64) (value ? attrs->yes[0] : attrs->no[0]);
 }
 
 /* Boxed type registration {{{1 */
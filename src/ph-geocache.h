@@ -140,28 +140,43 @@ typedef enum _PHGeocacheAttrID {
     PH_GEOCACHE_ATTR_COUNT
 } PHGeocacheAttrID;
 
-typedef struct _PHGeocacheAttrs PHGeocacheAttrs;
+/*
+ * Number of attribute IDs a PHGeocacheAttrs can hold.  This leaves room for
+ * attributes introduced after PH_GEOCACHE_ATTR_COUNT; larger IDs are ignored.
+ */
+#define PH_GEOCACHE_ATTRS_SIZE 128
+
+#define PH_GEOCACHE_ATTRS_WORDS (PH_GEOCACHE_ATTRS_SIZE / 64)
+
+/*
+ * Attribute IDs below this are also stored as bits in the attributes_yes
+ * and attributes_no integer columns, see ph_geocache_attrs_get_mask().
+ */
+#define PH_GEOCACHE_ATTRS_MASK_SIZE 64
 
 /*
- * Geocache attribute settings as a singly-linked list.
+ * Geocache attribute settings as a pair of bitsets.  An attribute is either
+ * set to true, set to false, or not defined at all.  All bits cleared means
+ * no attributes.
  */
-struct _PHGeocacheAttrs {
-    PHGeocacheAttrs *next;      /* rest pointer */
-    PHGeocacheAttrID id;        /* number of the attribute */
-    gboolean value;             /* true or false? */
-};
+typedef struct _PHGeocacheAttrs {
+    guint64 yes[PH_GEOCACHE_ATTRS_WORDS];   /* attributes set to true */
+    guint64 no[PH_GEOCACHE_ATTRS_WORDS];    /* attributes set to false */
+} PHGeocacheAttrs;
 
-PHGeocacheAttrs *ph_geocache_attrs_from_string(const gchar *input);
+void ph_geocache_attrs_from_string(PHGeocacheAttrs *attrs,
+                                   const gchar *input);
 gchar *ph_geocache_attrs_to_string(const PHGeocacheAttrs *attrs);
-PHGeocacheAttrs *ph_geocache_attrs_find(PHGeocacheAttrs *attrs,
-        PHGeocacheAttrID id);
-PHGeocacheAttrs *ph_geocache_attrs_set(PHGeocacheAttrs *attrs,
-        PHGeocacheAttrID id, gboolean value);
-PHGeocacheAttrs *ph_geocache_attrs_prepend(PHGeocacheAttrs *attrs,
-        PHGeocacheAttrID id, gboolean value);
-PHGeocacheAttrs *ph_geocache_attrs_unset(PHGeocacheAttrs *attrs,
-        PHGeocacheAttrID id);
-void ph_geocache_attrs_free(PHGeocacheAttrs *attrs);
+gboolean ph_geocache_attrs_find(const PHGeocacheAttrs *attrs,
+                                PHGeocacheAttrID id,
+                                gboolean *value);
+void ph_geocache_attrs_set(PHGeocacheAttrs *attrs,
+                           PHGeocacheAttrID id,
+                           gboolean value);
+void ph_geocache_attrs_unset(PHGeocacheAttrs *attrs,
+                             PHGeocacheAttrID id);
+gint64 ph_geocache_attrs_get_mask(const PHGeocacheAttrs *attrs,
+                                  gboolean value);
 
 /* Data structures {{{1 */
 
@@ -189,7 +204,7 @@ typedef struct _PHGeocache {
     PHGeocacheSize size;        /* container size */
     guint8 difficulty;          /* D rating times 10 */
     guint8 terrain;             /* T rating times 10 */
-    PHGeocacheAttrs *attributes; /* list of geocache attributes */
+    PHGeocacheAttrs attributes; /* geocache attributes */
     gboolean summary_html;      /* is summary in HTML format? */
     gchar *summary;             /* short description */
     gboolean description_html;  /* is description in HTML format? */
@@ -0,0 +1,348 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/* Includes {{{1 */
+
+#include "ph-import-chunk.h"
+#include "ph-import-source.h"
+#include <string.h>
+
+/* Constants {{{1 */
+
+/*
+ * Files are not split into chunks smaller than this many bytes.
+ */
+#define PH_IMPORT_CHUNK_MIN_SIZE (8 * 1024 * 1024)
+
+/* Data structures {{{1 */
+
+/*
+ * Segments making up the XML document seen by the parser of a chunk.
+ */
+enum {
+    PH_IMPORT_CHUNK_HEADER,     /* everything before the first <wpt> */
+    PH_IMPORT_CHUNK_BODY,       /* the <wpt> elements of the chunk */
+    PH_IMPORT_CHUNK_TRAILER,    /* closing tag of the root element */
+    PH_IMPORT_CHUNK_SEGMENTS
+};
+
+struct _PHImportChunk {
+    GMappedFile *file;          /* mapping of the entire file */
+    gchar *filename;            /* path, used in error messages */
+    gchar *trailer;             /* closing tag, or NULL */
+
+    const gchar *segments[PH_IMPORT_CHUNK_SEGMENTS];
+    gsize lengths[PH_IMPORT_CHUNK_SEGMENTS];
+
+    guint segment;              /* segment currently being read */
+    gsize position;             /* read position within the segment */
+};
+
+/* Forward declarations {{{1 */
+
+static const gchar *ph_import_chunk_find_wpt(const gchar *data,
+                                             const gchar *start,
+                                             const gchar *target,
+                                             const gchar *end,
+                                             gboolean first);
+static gchar *ph_import_chunk_trailer(const gchar *header,
+                                      const gchar *end);
+static PHImportChunk *ph_import_chunk_new(GMappedFile *file,
+                                          const gchar *filename,
+                                          const gchar *header_end,
+                                          const gchar *start,
+                                          const gchar *end,
+                                          const gchar *trailer);
+static int ph_import_chunk_read(void *context, char *buffer, int length);
+static int ph_import_chunk_close(void *context);
+
+/* Splitting files {{{1 */
+
+/*
+ * Split a GPX file into up to count chunks of roughly equal size, cutting
+ * only between two top-level <wpt> elements.  Each chunk is preceded by the
+ * header of the file (including the <author> element), so parsing the
+ * chunks one after the other yields exactly the same records as parsing
+ * the entire file.  Returns an array of PHImportChunk, or NULL if the file
+ * cannot be split (because it is compressed, for instance), splitting is not
+ * worth the effort or an error occurs, in which case error is set.
+ */
+GPtrArray *
+ph_import_chunk_split(const gchar *filename,
+                      guint count,
+                      GError **error)
+{
+    GPtrArray *result;
+    GMappedFile *file;
+    const gchar *data, *end, *header_end, *start, *next;
+    gchar *trailer;
+    gsize length;
+    guint i;
+
+    g_return_val_if_fail(filename != NULL, NULL);
+    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+    file = ph_import_source_map_file(filename, error);
+    if (file == NULL)
+        return NULL;
+
+    data = g_mapped_file_get_contents(file);
+    length = g_mapped_file_get_length(file);
+    end = data + length;
+
+    count = MIN(count, length / PH_IMPORT_CHUNK_MIN_SIZE);
+    if (count < 2 || ph_import_source_is_compressed(data, length)) {
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+
+    header_end = ph_import_chunk_find_wpt(data, data, data, end, TRUE);
+    trailer = (header_end == NULL)
+        ? NULL : ph_import_chunk_trailer(data, header_end);
+    if (trailer == NULL) {
+        /* no way to split the file */
+        g_mapped_file_unref(file);
+        return NULL;
+    }
+
+    result = g_ptr_array_new_with_free_func(
+            (GDestroyNotify) ph_import_chunk_free);
+
+    start = header_end;
+    for (i = 1; i < count; ++i) {
+        const gchar *target = header_end + (end - header_end) / count * i;
+
+        if (target <= start)
+            continue;
+        next = ph_import_chunk_find_wpt(data, start + 1, target, end, FALSE);
+        if (next == NULL)
+            break;
+
+        g_ptr_array_add(result, ph_import_chunk_new(file, filename,
+                    header_end, start, next, trailer));
+        start = next;
+    }
+
+    /* the last chunk contains the real end of the file */
+    g_ptr_array_add(result, ph_import_chunk_new(file, filename,
+                header_end, start, end, NULL));
+
+    g_mapped_file_unref(file);
+    g_free(trailer);
+    return result;
+}
+
+/*
+ * Find the first <wpt> start tag at or after target.  Scanning begins at
+ * start, which must not be inside a comment, CDATA section or processing
+ * instruction; those are skipped, since the same characters might appear
+ * there as text.  Everywhere else, '<' always starts markup, so the file can
+ * be scanned without parsing it.  Unless first is set, only tags directly
+ * following a </wpt> end tag are considered.  Returns NULL if there is no
+ * such tag.
+ */
+static const gchar *
+ph_import_chunk_find_wpt(const gchar *data,
+                         const gchar *start,
+                         const gchar *target,
+                         const gchar *end,
+                         gboolean first)
+{
+    const gchar *cur = start, *prev;
+
+    while (end - cur > 4) {
+        cur = memchr(cur, '<', end - cur - 4);
+        if (cur == NULL)
+            break;
+
+        if (cur[1] == '!' || cur[1] == '?') {
+            const gchar *terminator;
+
+            if (end - cur >= 9 && memcmp(cur, "<![CDATA[", 9) == 0)
+                terminator = "]]>";
+            else if (memcmp(cur, "<!--", 4) == 0)
+                terminator = "-->";
+            else if (cur[1] == '?')
+                terminator = "?>";
+            else
+                terminator = ">";       /* DOCTYPE and friends */
+
+            cur = g_strstr_len(cur + 2, end - cur - 2, terminator);
+            if (cur == NULL)
+                break;
+            continue;
+        }
+
+        if (cur >= target && memcmp(cur, "<wpt", 4) == 0 &&
+                (g_ascii_isspace(cur[4]) || cur[4] == '>')) {
+            if (first)
+                return cur;
+
+            /* skip back over whitespace to the preceding end tag */
+            for (prev = cur; prev > data && g_ascii_isspace(prev[-1]); --prev)
+                ;
+            if (prev - data >= 6 && memcmp(prev - 6, "</wpt>", 6) == 0)
+                return cur;
+        }
+
+        ++cur;
+    }
+
+    return NULL;
+}
+
+/*
+ * Build the closing tag of the root element, which is the first element
+ * found in the header.  Returns NULL if there is none.
+ */
+static gchar *
+ph_import_chunk_trailer(const gchar *header,
+                        const gchar *end)
+{
+    const gchar *cur, *name;
+
+    for (cur = header; cur < end; ++cur) {
+        if (cur[0] != '<' || cur + 1 == end)
+            continue;
+        if (cur[1] == '?' || cur[1] == '!')
+            continue;       /* XML declaration, comment or DOCTYPE */
+
+        name = cur + 1;
+        for (cur = name; cur < end && !g_ascii_isspace(*cur) &&
+                *cur != '>' && *cur != '/'; ++cur)
+            ;
+        if (cur == name)
+            return NULL;
+        return g_strdup_printf("</%.*s>", (int) (cur - name), name);
+    }
+
+    return NULL;
+}
+
+/* Chunk handling {{{1 */
+
+/*
+ * Create a chunk consisting of the file header (data up to header_end), the
+ * range from start to end, and an optional trailer.
+ */
+static PHImportChunk *
+ph_import_chunk_new(GMappedFile *file,
+                    const gchar *filename,
+                    const gchar *header_end,
+                    const gchar *start,
+                    const gchar *end,
+                    const gchar *trailer)
+{
+    PHImportChunk *result = g_new0(PHImportChunk, 1);
+    const gchar *data = g_mapped_file_get_contents(file);
+
+    result->file = g_mapped_file_ref(file);
+    result->filename = g_strdup(filename);
+    result->trailer = g_strdup(trailer);
+
+    result->segments[PH_IMPORT_CHUNK_HEADER] = data;
+    result->lengths[PH_IMPORT_CHUNK_HEADER] = header_end - data;
+    result->segments[PH_IMPORT_CHUNK_BODY] = start;
+    result->lengths[PH_IMPORT_CHUNK_BODY] = end - start;
+    result->segments[PH_IMPORT_CHUNK_TRAILER] = result->trailer;
+    result->lengths[PH_IMPORT_CHUNK_TRAILER] =
+        (trailer == NULL) ? 0 : strlen(trailer);
+
+    return result;
+}
+
+/*
+ * Create an XML reader for the chunk.  The chunk has to stay alive until the
+ * reader has been freed.  Returns NULL on error.
+ */
+xmlTextReaderPtr
+ph_import_chunk_open(PHImportChunk *chunk)
+{
+    g_return_val_if_fail(chunk != NULL, NULL);
+
+    chunk->segment = 0;
+    chunk->position = 0;
+
+    return xmlReaderForIO(ph_import_chunk_read, ph_import_chunk_close,
+            chunk, chunk->filename, NULL, 0);
+}
+
+/*
+ * Get the value to add to the byte count of a reader obtained from
+ * ph_import_chunk_open() to get the corresponding position in the file.
+ */
+glong
+ph_import_chunk_get_base(const PHImportChunk *chunk)
+{
+    g_return_val_if_fail(chunk != NULL, 0);
+
+    return (chunk->segments[PH_IMPORT_CHUNK_BODY] -
+            chunk->segments[PH_IMPORT_CHUNK_HEADER]) -
+        (glong) chunk->lengths[PH_IMPORT_CHUNK_HEADER];
+}
+
+/*
+ * Free a chunk.  No-op for NULL.
+ */
+void
+ph_import_chunk_free(PHImportChunk *chunk)
+{
+    if (chunk == NULL)
+        return;
+
+    g_mapped_file_unref(chunk->file);
+    g_free(chunk->filename);
+    g_free(chunk->trailer);
+    g_free(chunk);
+}
+
+/* Reader callbacks {{{1 */
+
+/*
+ * Copy the next bytes of the chunk to the buffer of the XML reader.
+ */
+static int
+ph_import_chunk_read(void *context,
+                     char *buffer,
+                     int length)
+{
+    PHImportChunk *chunk = (PHImportChunk *) context;
+    int result = 0;
+
+    while (result < length && chunk->segment < PH_IMPORT_CHUNK_SEGMENTS) {
+        gsize available = chunk->lengths[chunk->segment] - chunk->position;
+        gsize count = MIN(available, (gsize) (length - result));
+
+        memcpy(buffer + result,
+                chunk->segments[chunk->segment] + chunk->position, count);
+        result += count;
+        chunk->position += count;
+
+        if (chunk->position == chunk->lengths[chunk->segment]) {
+            ++chunk->segment;
+            chunk->position = 0;
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Nothing to do when the reader is closed; the mapping belongs to the chunk.
+ */
+static int
+ph_import_chunk_close(void *context)
+{
+    return 0;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
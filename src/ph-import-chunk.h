@@ -0,0 +1,42 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+#ifndef PH_IMPORT_CHUNK_H
+#define PH_IMPORT_CHUNK_H
+
+/* Includes {{{1 */
+
+#include <glib.h>
+#include <libxml/xmlreader.h>
+
+/* Data types {{{1 */
+
+/*
+ * Consecutive range of <wpt> elements of a GPX file, which can be parsed
+ * independently of the rest of the file.
+ */
+typedef struct _PHImportChunk PHImportChunk;
+
+/* Public interface {{{1 */
+
+GPtrArray *ph_import_chunk_split(const gchar *filename,
+                                 guint count,
+                                 GError **error);
+
+xmlTextReaderPtr ph_import_chunk_open(PHImportChunk *chunk);
+glong ph_import_chunk_get_base(const PHImportChunk *chunk);
+
+void ph_import_chunk_free(PHImportChunk *chunk);
+
+/* }}} */
+
+#endif
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -10,6 +10,7 @@
 
 /* Includes {{{1 */
 
+#include "ph-config.h"
 #include "ph-import-dialog.h"
 #include "ph-import-process.h"
 #include <glib/gi18n.h>
@@ -254,6 +255,8 @@ ph_import_dialog_create_process(PHProcessDialog *parent_dialog)
     if (path != NULL) {
         /* do not start without a path */
         process = ph_import_process_new(dialog->priv->database, path);
+        ph_import_process_set_log_retention(PH_IMPORT_PROCESS(process),
+                ph_config_get_log_retention());
         g_signal_connect(process, "filename-notify",
                 G_CALLBACK(ph_import_dialog_filename_notify), dialog);
     }
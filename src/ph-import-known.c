@@ -0,0 +1,195 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/* Includes {{{1 */
+
+#include "ph-import-known.h"
+
+/* Data structures {{{1 */
+
+/*
+ * Sorted 64-bit fingerprints of the (id, geocache_id) keys of all logs.
+ * Unlike a Bloom filter, whose false positives would make the importer drop
+ * new logs every now and then, a wrong answer requires two keys to share all
+ * 64 bits, which is negligible for any realistic number of logs.
+ */
+struct _PHImportKnown {
+    guint64 *keys;              /* fingerprints in ascending order */
+    guint count;                /* number of fingerprints */
+};
+
+/* Forward declarations {{{1 */
+
+static guint64 ph_import_known_key(const gchar *geocache_id, gint64 id);
+static gint ph_import_known_compare(gconstpointer a, gconstpointer b);
+
+/* Creation and destruction {{{1 */
+
+/*
+ * Read the keys of all logs in the database.  Returns NULL on error.
+ */
+PHImportKnown *
+ph_import_known_load(PHDatabase *database,
+                     GError **error)
+{
+    GArray *keys;
+    sqlite3_stmt *stmt;
+    PHImportKnown *result;
+    gint status;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), NULL);
+    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+    stmt = ph_database_prepare(database,
+            "SELECT geocache_id, id FROM logs", error);
+    if (stmt == NULL)
+        return NULL;
+
+    keys = g_array_new(FALSE, FALSE, sizeof(guint64));
+    while ((status = ph_database_step(database, stmt, error)) == SQLITE_ROW) {
+        guint64 key = ph_import_known_key(
+                (const gchar *) sqlite3_column_text(stmt, 0),
+                sqlite3_column_int64(stmt, 1));
+        g_array_append_val(keys, key);
+    }
+    (void) sqlite3_finalize(stmt);
+
+    if (status != SQLITE_DONE) {
+        g_array_free(keys, TRUE);
+        return NULL;
+    }
+
+    g_array_sort(keys, ph_import_known_compare);
+
+    result = g_new(PHImportKnown, 1);
+    result->count = keys->len;
+    result->keys = (guint64 *) g_array_free(keys, FALSE);
+    return result;
+}
+
+/*
+ * Free the set.  No-op for NULL.
+ */
+void
+ph_import_known_free(PHImportKnown *known)
+{
+    if (known == NULL)
+        return;
+
+    g_free(known->keys);
+    g_free(known);
+}
+
+/* Lookup {{{1 */
+
+/*
+ * Check whether the log with the given key has been in the database.
+ */
+gboolean
+ph_import_known_contains(const PHImportKnown *known,
+                         const gchar *geocache_id,
+                         gint64 id)
+{
+    guint64 key;
+    guint low = 0, high;
+
+    g_return_val_if_fail(known != NULL, FALSE);
+
+    key = ph_import_known_key(geocache_id, id);
+    high = known->count;
+    while (low < high) {
+        guint middle = low + (high - low) / 2;
+
+        if (known->keys[middle] < key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return (low < known->count && known->keys[low] == key);
+}
+
+/*
+ * Compute the fingerprint of a log key: FNV-1a over the geocache ID and the
+ * log ID, followed by a final mixing step.
+ */
+static guint64
+ph_import_known_key(const gchar *geocache_id,
+                    gint64 id)
+{
+    guint64 result = G_GUINT64_CONSTANT(14695981039346656037);
+    const guchar *cur = (const guchar *) geocache_id;
+    guint i;
+
+    for (; cur != NULL && *cur != '\0'; ++cur) {
+        result ^= *cur;
+        result *= G_GUINT64_CONSTANT(1099511628211);
+    }
+    for (i = 0; i < 64; i += 8) {
+        result ^= ((guint64) id >> i) & 0xff;
+        result *= G_GUINT64_CONSTANT(1099511628211);
+    }
+
+    result ^= result >> 33;
+    result *= G_GUINT64_CONSTANT(0xff51afd7ed558ccd);
+    result ^= result >> 33;
+    return result;
+}
+
+/*
+ * Order fingerprints for g_array_sort().
+ */
+static gint
+ph_import_known_compare(gconstpointer a,
+                        gconstpointer b)
+{
+    guint64 left = *(const guint64 *) a, right = *(const guint64 *) b;
+
+    return (left < right) ? -1 : (left > right);
+}
+
+/* Statistics {{{1 */
+
+/*
+ * Get the number of logs in the set.
+ */
+guint
+ph_import_known_get_count(const PHImportKnown *known)
+{
+    g_return_val_if_fail(known != NULL, 0);
+
+    return known->count;
+}
+
+/*
+ * Get the number of bytes used by the set.
+ */
+gsize
+ph_import_known_get_size(const PHImportKnown *known)
+{
+    g_return_val_if_fail(known != NULL, 0);
+
+    return sizeof(PHImportKnown) + known->count * sizeof(guint64);
+}
+
+/*
+ * Get the probability of mistaking a new log for a known one.
+ */
+gdouble
+ph_import_known_get_error_rate(const PHImportKnown *known)
+{
+    g_return_val_if_fail(known != NULL, 0);
+
+    return known->count / 18446744073709551616.0;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
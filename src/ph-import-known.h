@@ -0,0 +1,44 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+#ifndef PH_IMPORT_KNOWN_H
+#define PH_IMPORT_KNOWN_H
+
+/* Includes {{{1 */
+
+#include "ph-database.h"
+
+/* Data types {{{1 */
+
+/*
+ * Read-only set of the logs stored in the database before an import, which
+ * can be shared by any number of parser threads.
+ */
+typedef struct _PHImportKnown PHImportKnown;
+
+/* Public interface {{{1 */
+
+PHImportKnown *ph_import_known_load(PHDatabase *database,
+                                    GError **error);
+void ph_import_known_free(PHImportKnown *known);
+
+gboolean ph_import_known_contains(const PHImportKnown *known,
+                                  const gchar *geocache_id,
+                                  gint64 id);
+
+guint ph_import_known_get_count(const PHImportKnown *known);
+gsize ph_import_known_get_size(const PHImportKnown *known);
+gdouble ph_import_known_get_error_rate(const PHImportKnown *known);
+
+/* }}} */
+
+#endif
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
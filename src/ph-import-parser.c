@@ -0,0 +1,1160 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/* Includes {{{1 */
+
+#include "ph-gpx.h"
+#include "ph-import-parser.h"
+#include "ph-xml.h"
+#include <math.h>
+#include <string.h>
+
+/* Constants {{{1 */
+
+/*
+ * Parameters of the 64-bit FNV-1a hash function used for record hashes.
+ */
+#define PH_IMPORT_RECORD_HASH_BASIS G_GUINT64_CONSTANT(0xcbf29ce484222325)
+#define PH_IMPORT_RECORD_HASH_PRIME G_GUINT64_CONSTANT(0x100000001b3)
+
+/*
+ * Number of slots in the table mapping interned element names to their
+ * identifiers.  Must be a power of two well above the number of names.
+ */
+#define PH_IMPORT_PARSER_SLOTS 64
+
+/* Data structures {{{1 */
+
+/*
+ * Elements the parser knows about.  Everything else is skipped as a whole.
+ */
+typedef enum _PHImportElement {
+    PH_IMPORT_ELEMENT_UNKNOWN,
+    PH_IMPORT_ELEMENT_GPX,
+    PH_IMPORT_ELEMENT_METADATA,
+    PH_IMPORT_ELEMENT_EXTENSIONS,
+    PH_IMPORT_ELEMENT_AUTHOR,
+    PH_IMPORT_ELEMENT_WPT,
+    PH_IMPORT_ELEMENT_NAME,
+    PH_IMPORT_ELEMENT_TIME,
+    PH_IMPORT_ELEMENT_URL,
+    PH_IMPORT_ELEMENT_URLNAME,
+    PH_IMPORT_ELEMENT_SYM,
+    PH_IMPORT_ELEMENT_DESC,
+    PH_IMPORT_ELEMENT_CMT,
+    PH_IMPORT_ELEMENT_CACHE,
+    PH_IMPORT_ELEMENT_PLACED_BY,
+    PH_IMPORT_ELEMENT_OWNER,
+    PH_IMPORT_ELEMENT_TYPE,
+    PH_IMPORT_ELEMENT_CONTAINER,
+    PH_IMPORT_ELEMENT_DIFFICULTY,
+    PH_IMPORT_ELEMENT_TERRAIN,
+    PH_IMPORT_ELEMENT_SHORT_DESCRIPTION,
+    PH_IMPORT_ELEMENT_LONG_DESCRIPTION,
+    PH_IMPORT_ELEMENT_ENCODED_HINTS,
+    PH_IMPORT_ELEMENT_ATTRIBUTES,
+    PH_IMPORT_ELEMENT_ATTRIBUTE,
+    PH_IMPORT_ELEMENT_LOGS,
+    PH_IMPORT_ELEMENT_LOG,
+    PH_IMPORT_ELEMENT_DATE,
+    PH_IMPORT_ELEMENT_FINDER,
+    PH_IMPORT_ELEMENT_TEXT,
+    PH_IMPORT_ELEMENT_TRAVELBUGS,
+    PH_IMPORT_ELEMENT_TRAVELBUG,
+    PH_IMPORT_ELEMENT_COUNT
+} PHImportElement;
+
+/*
+ * Local names of the elements above, indexed by PHImportElement.
+ */
+static const gchar *ph_import_element_names[PH_IMPORT_ELEMENT_COUNT] = {
+    NULL, "gpx", "metadata", "extensions", "author", "wpt", "name", "time",
+    "url", "urlname", "sym", "desc", "cmt", "cache", "placed_by", "owner",
+    "type", "container", "difficulty", "terrain", "short_description",
+    "long_description", "encoded_hints", "attributes", "attribute", "logs",
+    "log", "date", "finder", "text", "travelbugs", "travelbug"
+};
+
+/*
+ * Entry of the open-addressing table mapping interned names to elements.
+ */
+typedef struct _PHImportParserSlot {
+    const xmlChar *name;        /* interned in the reader's dictionary */
+    PHImportElement element;
+} PHImportParserSlot;
+
+struct _PHImportParser {
+    xmlTextReaderPtr reader;    /* XML reader for the file */
+    PHGeocacheSite site;        /* originating listing site */
+    PHImportParserSlot slots[PH_IMPORT_PARSER_SLOTS];
+                                /* element names, keyed by address */
+
+    const PHImportKnown *known; /* logs which need not be read, or NULL */
+
+    PHImportProfile *profile;   /* receives the timings below, or NULL */
+    gint64 time[PH_IMPORT_ELEMENT_COUNT];
+                                /* microseconds spent per element type */
+    guint count[PH_IMPORT_ELEMENT_COUNT];
+                                /* number of elements per type */
+};
+
+struct _PHImportProfile {
+    GMutex mutex;               /* protects the fields below */
+    gint64 time[PH_IMPORT_ELEMENT_COUNT];
+                                /* microseconds spent per element type */
+    guint count[PH_IMPORT_ELEMENT_COUNT];
+                                /* number of elements per type */
+    gint64 store_time;          /* microseconds spent writing records */
+};
+
+/*
+ * The string tables from ph-gpx.h, compiled once and shared by all parsers.
+ */
+typedef struct _PHImportParserMatchers {
+    PHXmlStringMatcher *waypoint_types;
+    PHXmlStringMatcher *geocache_types;
+    PHXmlStringMatcher *geocache_sizes;
+    PHXmlStringMatcher *log_types;
+    PHXmlStringMatcher *geocache_sites;
+} PHImportParserMatchers;
+
+static PHImportParserMatchers ph_import_parser_matchers;
+
+/* Forward declarations {{{1 */
+
+static void ph_import_parser_init_matchers();
+static void ph_import_parser_init_slots(PHImportParser *parser);
+
+static guint ph_import_parser_slot(const xmlChar *name);
+
+static PHImportElement ph_import_parser_element(const PHImportParser *parser);
+static int ph_import_parser_advance(PHImportParser *parser, gboolean skip);
+static gint64 ph_import_parser_clock(const PHImportParser *parser);
+static void ph_import_parser_account(PHImportParser *parser,
+                                     PHImportElement element, gint64 start);
+
+static gboolean ph_import_parser_gpx_wpt(PHImportParser *parser,
+                                         PHImportRecord *record,
+                                         GError **error);
+static gboolean ph_import_parser_gpx_cache(PHImportParser *parser,
+                                           PHImportRecord *record,
+                                           gboolean logged,
+                                           GError **error);
+static gboolean ph_import_parser_gpx_logs(PHImportParser *parser,
+                                          PHImportRecord *record,
+                                          GError **error);
+static gboolean ph_import_parser_gpx_travelbugs(PHImportParser *parser,
+                                                PHImportRecord *record,
+                                                GError **error);
+static gboolean ph_import_parser_gpx_author(PHImportParser *parser,
+                                            GError **error);
+
+static guint64 ph_import_record_hash_int(guint64 hash, gint64 value);
+static guint64 ph_import_record_hash(const PHImportRecord *record);
+
+/* Parser creation {{{1 */
+
+/*
+ * Compile the string tables on first use.  The matchers are never freed.
+ */
+static void
+ph_import_parser_init_matchers()
+{
+    static gsize initialized = 0;
+    PHImportParserMatchers *matchers = &ph_import_parser_matchers;
+
+    if (g_once_init_enter(&initialized)) {
+        matchers->waypoint_types =
+            ph_xml_string_matcher_new(ph_gpx_waypoint_types);
+        matchers->geocache_types =
+            ph_xml_string_matcher_new(ph_gpx_geocache_types);
+        matchers->geocache_sizes =
+            ph_xml_string_matcher_new(ph_gpx_geocache_sizes);
+        matchers->log_types = ph_xml_string_matcher_new(ph_gpx_log_types);
+        matchers->geocache_sites =
+            ph_xml_string_matcher_new(ph_gpx_geocache_sites);
+        g_once_init_leave(&initialized, 1);
+    }
+}
+
+/*
+ * Intern the known element names in the dictionary of the reader, which is
+ * where the reader takes the names of the nodes from.  Afterwards, elements
+ * can be recognized by comparing addresses instead of strings.
+ */
+static void
+ph_import_parser_init_slots(PHImportParser *parser)
+{
+    PHImportElement element;
+
+    for (element = PH_IMPORT_ELEMENT_UNKNOWN + 1;
+            element < PH_IMPORT_ELEMENT_COUNT; ++element) {
+        const xmlChar *name = xmlTextReaderConstString(parser->reader,
+                (const xmlChar *) ph_import_element_names[element]);
+        guint slot = ph_import_parser_slot(name);
+
+        while (parser->slots[slot].name != NULL)
+            slot = (slot + 1) & (PH_IMPORT_PARSER_SLOTS - 1);
+        parser->slots[slot].name = name;
+        parser->slots[slot].element = element;
+    }
+}
+
+/*
+ * Create a parser reading from the given XML reader.  The parser takes
+ * ownership of the reader.
+ */
+PHImportParser *
+ph_import_parser_new(xmlTextReaderPtr reader)
+{
+    PHImportParser *result;
+
+    g_return_val_if_fail(reader != NULL, NULL);
+
+    ph_import_parser_init_matchers();
+
+    result = g_new0(PHImportParser, 1);
+    result->reader = reader;
+    result->site = PH_GEOCACHE_SITE_UNKNOWN;
+    ph_import_parser_init_slots(result);
+
+    return result;
+}
+
+/*
+ * Free the parser and its XML reader.  If a profile has been attached, the
+ * timings of the parser are added to it.  No-op for NULL.
+ */
+void
+ph_import_parser_free(PHImportParser *parser)
+{
+    PHImportProfile *profile;
+    guint i;
+
+    if (parser == NULL)
+        return;
+
+    profile = parser->profile;
+    if (profile != NULL) {
+        g_mutex_lock(&profile->mutex);
+        for (i = 0; i < PH_IMPORT_ELEMENT_COUNT; ++i) {
+            profile->time[i] += parser->time[i];
+            profile->count[i] += parser->count[i];
+        }
+        g_mutex_unlock(&profile->mutex);
+    }
+
+    xmlFreeTextReader(parser->reader);
+    g_free(parser);
+}
+
+/*
+ * Record the time spent on each kind of element in profile, which may be
+ * shared with other parsers.  Pass NULL to stop measuring.
+ */
+void
+ph_import_parser_set_profile(PHImportParser *parser,
+                             PHImportProfile *profile)
+{
+    g_return_if_fail(parser != NULL);
+
+    parser->profile = profile;
+}
+
+/*
+ * Skip the logs contained in known, which may be shared with other parsers,
+ * without reading their content.  Pass NULL to read all logs.
+ */
+void
+ph_import_parser_set_known(PHImportParser *parser,
+                           const PHImportKnown *known)
+{
+    g_return_if_fail(parser != NULL);
+
+    parser->known = known;
+}
+
+/* Element dispatch {{{1 */
+
+/*
+ * Map the address of an interned name to a slot of the name table
+ * (Fibonacci hashing, as the dictionary packs strings without alignment).
+ */
+static guint
+ph_import_parser_slot(const xmlChar *name)
+{
+    guint64 key = GPOINTER_TO_SIZE(name);
+
+    return (guint) ((key * G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)) >> 58)
+        & (PH_IMPORT_PARSER_SLOTS - 1);
+}
+
+/*
+ * Identify the node the reader is positioned on by the address of its local
+ * name.
+ */
+static PHImportElement
+ph_import_parser_element(const PHImportParser *parser)
+{
+    const xmlChar *name = xmlTextReaderConstLocalName(parser->reader);
+    guint slot = ph_import_parser_slot(name);
+
+    while (parser->slots[slot].name != NULL) {
+        if (parser->slots[slot].name == name)
+            return parser->slots[slot].element;
+        slot = (slot + 1) & (PH_IMPORT_PARSER_SLOTS - 1);
+    }
+
+    return PH_IMPORT_ELEMENT_UNKNOWN;
+}
+
+/*
+ * Move to the next node, like xmlTextReaderRead().  If skip is set, the
+ * current element has been found to be of no interest and its entire
+ * subtree is passed over.
+ */
+static int
+ph_import_parser_advance(PHImportParser *parser,
+                         gboolean skip)
+{
+    gint64 start;
+    int rc;
+
+    if (!skip)
+        return xmlTextReaderRead(parser->reader);
+
+    start = ph_import_parser_clock(parser);
+    rc = xmlTextReaderNext(parser->reader);
+    ph_import_parser_account(parser, PH_IMPORT_ELEMENT_UNKNOWN, start);
+    return rc;
+}
+
+/*
+ * Get the start time for ph_import_parser_account(), or 0 if the parser is
+ * not being profiled.
+ */
+static gint64
+ph_import_parser_clock(const PHImportParser *parser)
+{
+    return (parser->profile != NULL) ? g_get_monotonic_time() : 0;
+}
+
+/*
+ * Charge the time since start to the given kind of element.  Most elements
+ * take less than the resolution of the clock, but the rounding errors cancel
+ * out over many of them.
+ */
+static void
+ph_import_parser_account(PHImportParser *parser,
+                         PHImportElement element,
+                         gint64 start)
+{
+    if (parser->profile != NULL) {
+        parser->time[element] += g_get_monotonic_time() - start;
+        ++parser->count[element];
+    }
+}
+
+/* Reading records {{{1 */
+
+/*
+ * Advance to the next <wpt> element and read it into a newly allocated
+ * record, which the caller has to free with ph_import_record_free().  At the
+ * end of the input, record is set to NULL.  Returns FALSE on error.
+ */
+gboolean
+ph_import_parser_next(PHImportParser *parser,
+                      PHImportRecord **record,
+                      GError **error)
+{
+    int rc;
+    gboolean skip = FALSE;
+    gint64 start;
+
+    g_return_val_if_fail(parser != NULL, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    *record = NULL;
+
+    while ((rc = ph_import_parser_advance(parser, skip)) == 1) {
+        PHImportRecord *result;
+
+        skip = FALSE;
+        if (xmlTextReaderNodeType(parser->reader) != 1)
+            continue;       /* only consider element nodes */
+
+        start = ph_import_parser_clock(parser);
+        switch (ph_import_parser_element(parser)) {
+        case PH_IMPORT_ELEMENT_WPT:
+            result = g_new0(PHImportRecord, 1);
+            result->arena = ph_arena_new();
+            if (!ph_import_parser_gpx_wpt(parser, result, error)) {
+                ph_import_record_free(result);
+                return FALSE;
+            }
+
+            result->hash = ph_import_record_hash(result);
+            result->offset = ph_import_parser_get_offset(parser);
+            ph_import_parser_account(parser, PH_IMPORT_ELEMENT_WPT, start);
+            *record = result;
+            return TRUE;
+        case PH_IMPORT_ELEMENT_AUTHOR:
+            if (!ph_import_parser_gpx_author(parser, error))
+                return FALSE;
+            ph_import_parser_account(parser, PH_IMPORT_ELEMENT_AUTHOR, start);
+            break;
+        case PH_IMPORT_ELEMENT_GPX:
+        case PH_IMPORT_ELEMENT_METADATA:
+        case PH_IMPORT_ELEMENT_EXTENSIONS:
+            break;          /* look inside */
+        default:
+            skip = TRUE;
+        }
+    }
+
+    if (rc == -1)
+        return ph_xml_set_last_error(error);
+
+    return TRUE;
+}
+
+/*
+ * Get the number of input bytes the parser has consumed so far.
+ */
+glong
+ph_import_parser_get_offset(const PHImportParser *parser)
+{
+    g_return_val_if_fail(parser != NULL, 0);
+
+    return xmlTextReaderByteConsumed(parser->reader);
+}
+
+/* Importing GPX {{{1 */
+
+/* Waypoint {{{2 */
+
+/*
+ * Interpret a <wpt> element and store the information in the record.
+ * Returns FALSE on error.
+ */
+static gboolean
+ph_import_parser_gpx_wpt(PHImportParser *parser,
+                         PHImportRecord *record,
+                         GError **error)
+{
+    PHWaypoint *wpt = &record->waypoint;
+    xmlTextReaderPtr reader = parser->reader;
+    gboolean success = TRUE, skip = FALSE;
+    int rc = 1, depth;
+    PHImportElement element;
+    gint64 start;
+    double coord;
+    const gchar *prefix = ph_geocache_site_prefix(parser->site);
+    gboolean logged = FALSE;
+
+    /* we save lat and lon in 1/1000s of minutes */
+    if (!ph_xml_attrib_double(reader, (xmlChar *) "lat", &coord, error))
+        return FALSE;
+    wpt->latitude = (gint) round(60000 * coord);
+    if (!ph_xml_attrib_double(reader, (xmlChar *) "lon", &coord, error))
+        return FALSE;
+    wpt->longitude = (gint) round(60000 * coord);
+
+    depth = xmlTextReaderDepth(reader);
+    do {
+        rc = ph_import_parser_advance(parser, skip);
+        skip = FALSE;
+        if (rc != 1)
+            break;
+        else if (xmlTextReaderNodeType(reader) != 1)
+            continue;       /* only consider element nodes */
+
+        element = ph_import_parser_element(parser);
+        start = ph_import_parser_clock(parser);
+        switch (element) {
+        case PH_IMPORT_ELEMENT_NAME: {
+            gchar *tmp;
+            success = ph_xml_extract_text(reader, record->arena, &tmp, error);
+            if (!success)
+                wpt->id = wpt->geocache_id = NULL;
+            else if (strncmp(tmp, prefix,
+                        PH_GEOCACHE_SITE_PREFIX_LENGTH) != 0) {
+                /* not a geocache (extra waypoint) */
+                wpt->id = ph_arena_strconcat(record->arena,
+                        prefix, ",", tmp, NULL);
+                wpt->geocache_id = ph_arena_strconcat(record->arena,
+                        prefix, tmp + 2, NULL);
+            }
+            else {
+                /* waypoint representing an actual geocache */
+                wpt->id = tmp;
+                wpt->geocache_id = NULL;
+            }
+            break;
+        }
+        case PH_IMPORT_ELEMENT_TIME:
+            success = ph_xml_extract_time(reader, &wpt->placed, error);
+            break;
+        case PH_IMPORT_ELEMENT_URL:
+            success = ph_xml_extract_text(reader, record->arena, &wpt->url,
+                    error);
+            break;
+        case PH_IMPORT_ELEMENT_URLNAME:
+            success = ph_xml_extract_text(reader, record->arena, &wpt->name,
+                    error);
+            break;
+        case PH_IMPORT_ELEMENT_SYM: {
+            gchar *tmp;
+            success = ph_xml_extract_text(reader, record->arena, &tmp, error);
+            if (success) {
+                wpt->type = ph_xml_string_matcher_find(
+                        ph_import_parser_matchers.waypoint_types,
+                        (xmlChar *) tmp);
+                if (wpt->type == PH_WAYPOINT_TYPE_GEOCACHE)
+                    /* this will be used to process <cache> */
+                    logged = (xmlStrcasestr((xmlChar *) tmp,
+                                (xmlChar *) "found") != NULL);
+            }
+            break;
+        }
+        case PH_IMPORT_ELEMENT_DESC:
+            success = ph_xml_extract_text(reader, record->arena, &wpt->summary,
+                    error);
+            break;
+        case PH_IMPORT_ELEMENT_CMT:
+            success = ph_xml_extract_text(reader, record->arena,
+                    &wpt->description, error);
+            break;
+        case PH_IMPORT_ELEMENT_CACHE:
+            success = ph_import_parser_gpx_cache(parser, record, logged,
+                    error);
+            break;
+        case PH_IMPORT_ELEMENT_EXTENSIONS:
+            continue;       /* GPX 1.1 wraps <cache> in <extensions> */
+        default:
+            skip = TRUE;
+            continue;
+        }
+
+        ph_import_parser_account(parser, element, start);
+    } while (success && xmlTextReaderDepth(reader) > depth);
+
+    if (rc == -1)
+        success = ph_xml_set_last_error(error);
+
+    return success;
+}
+
+/* Geocache {{{2 */
+
+/*
+ * Read a <groundspeak:cache> element into the record.  Returns FALSE on
+ * error.
+ */
+static gboolean
+ph_import_parser_gpx_cache(PHImportParser *parser,
+                           PHImportRecord *record,
+                           gboolean logged,
+                           GError **error)
+{
+    PHGeocache *gc;
+    xmlTextReaderPtr reader = parser->reader;
+    gboolean success = TRUE, skip = FALSE;
+    PHImportElement element;
+    gint64 start;
+    int rc, depth;
+
+    if (record->geocache == NULL)
+        record->geocache = ph_arena_alloc0(record->arena, sizeof(PHGeocache));
+    gc = record->geocache;
+
+    gc->logged = logged;
+
+    gc->available = ph_xml_attrib_compare(reader, (xmlChar *) "available",
+            (xmlChar *) "true");
+    gc->archived = ph_xml_attrib_compare(reader, (xmlChar *) "archived",
+            (xmlChar *) "true");
+
+    depth = xmlTextReaderDepth(reader);
+    do {
+        rc = ph_import_parser_advance(parser, skip);
+        skip = FALSE;
+        if (rc != 1)
+            break;
+        else if (xmlTextReaderNodeType(reader) != 1)
+            continue;       /* only consider element nodes */
+
+        element = ph_import_parser_element(parser);
+        start = ph_import_parser_clock(parser);
+        switch (element) {
+        case PH_IMPORT_ELEMENT_NAME:
+            success = ph_xml_extract_text(reader, record->arena,
+                    &gc->name, error);
+            break;
+        case PH_IMPORT_ELEMENT_PLACED_BY:
+            success = ph_xml_extract_text(reader, record->arena,
+                    &gc->creator, error);
+            break;
+        case PH_IMPORT_ELEMENT_OWNER:
+            success = ph_xml_extract_text(reader, record->arena,
+                    &gc->owner, error);
+            break;
+        case PH_IMPORT_ELEMENT_TYPE:
+            success = ph_xml_extract_value(reader,
+                    ph_import_parser_matchers.geocache_types,
+                    (gint *) &gc->type, error);
+            break;
+        case PH_IMPORT_ELEMENT_CONTAINER:
+            success = ph_xml_extract_value(reader,
+                    ph_import_parser_matchers.geocache_sizes,
+                    (gint *) &gc->size, error);
+            break;
+        case PH_IMPORT_ELEMENT_DIFFICULTY: {
+            double tmp;
+            success = ph_xml_extract_double(reader, &tmp, error);
+            if (success)
+                gc->difficulty = (guint8) round(tmp * 10);
+            break;
+        }
+        case PH_IMPORT_ELEMENT_TERRAIN: {
+            double tmp;
+            success = ph_xml_extract_double(reader, &tmp, error);
+            if (success)
+                gc->terrain = (guint8) round(tmp * 10);
+            break;
+        }
+        case PH_IMPORT_ELEMENT_SHORT_DESCRIPTION:
+            gc->summary_html = ph_xml_attrib_compare(reader,
+                    (xmlChar *) "html", (xmlChar *) "true");
+            success = ph_xml_extract_text(reader, record->arena,
+                    &gc->summary, error);
+            break;
+        case PH_IMPORT_ELEMENT_LONG_DESCRIPTION:
+            gc->description_html = ph_xml_attrib_compare(reader,
+                    (xmlChar *) "html", (xmlChar *) "true");
+            success = ph_xml_extract_text(reader, record->arena,
+                    &gc->description, error);
+            break;
+        case PH_IMPORT_ELEMENT_ENCODED_HINTS:
+            success = ph_xml_extract_text(reader, record->arena, &gc->hint,
+                    error);
+            break;
+        case PH_IMPORT_ELEMENT_LOGS:
+            success = ph_import_parser_gpx_logs(parser, record, error);
+            break;
+        case PH_IMPORT_ELEMENT_ATTRIBUTES:
+            continue;       /* look at the <attribute> elements inside */
+        case PH_IMPORT_ELEMENT_ATTRIBUTE: {
+            gint id, value;
+            success = ph_xml_attrib_int(reader, (xmlChar *) "id", &id, error) &&
+                ph_xml_attrib_int(reader, (xmlChar *) "inc", &value, error);
+            if (success)
+                ph_geocache_attrs_set(&gc->attributes, id, value != 0);
+            break;
+        }
+        case PH_IMPORT_ELEMENT_TRAVELBUGS:
+            success = ph_import_parser_gpx_travelbugs(parser, record, error);
+            break;
+        default:
+            skip = TRUE;
+            continue;
+        }
+
+        ph_import_parser_account(parser, element, start);
+    } while (success && xmlTextReaderDepth(reader) > depth);
+
+    if (rc == -1)
+        success = ph_xml_set_last_error(error);
+
+    return success;
+}
+
+/* Logs {{{2 */
+
+/*
+ * Scan all <log> elements inside a <logs>...</logs> section of a geocache
+ * listing and append them to the record.  Returns FALSE on error.
+ */
+static gboolean
+ph_import_parser_gpx_logs(PHImportParser *parser,
+                          PHImportRecord *record,
+                          GError **error)
+{
+    PHLog log = {0};
+    xmlTextReaderPtr reader = parser->reader;
+    gboolean success = TRUE, skip = FALSE;
+    int rc, depth, type;
+    PHImportElement element;
+    gint64 start, log_start = 0;
+    gboolean in_log = FALSE;
+
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    if (xmlTextReaderIsEmptyElement(reader))
+        return TRUE;
+    if (record->logs == NULL) {
+        record->logs = g_array_new(FALSE, FALSE, sizeof(PHLog));
+        record->log_ids = PH_IMPORT_RECORD_HASH_BASIS;
+    }
+
+    depth = xmlTextReaderDepth(reader);
+    do {
+        rc = ph_import_parser_advance(parser, skip);
+        skip = FALSE;
+        if (rc != 1)
+            break;
+        type = xmlTextReaderNodeType(reader);
+        if (type != 1 && type != 15)
+            continue;       /* ignore all other non-element nodes */
+        element = ph_import_parser_element(parser);
+
+        if (element == PH_IMPORT_ELEMENT_LOG && type == 15) {
+            if (in_log) {
+                /* </log>: the strings already live in the record's arena */
+                g_array_append_val(record->logs, log);
+                in_log = FALSE;
+                ph_import_parser_account(parser, PH_IMPORT_ELEMENT_LOG,
+                        log_start);
+            }
+            continue;
+        }
+        else if (type != 1)
+            continue;
+        else if (!in_log && element == PH_IMPORT_ELEMENT_LOG) {
+            /* <log>: reset everything for the next log */
+            log_start = ph_import_parser_clock(parser);
+            memset(&log, 0, sizeof(log));
+            success = ph_xml_attrib_int(reader, (xmlChar *) "id",
+                    &log.id, error);
+            if (!success)
+                continue;
+
+            record->log_ids = ph_import_record_hash_int(record->log_ids,
+                    log.id);
+            if (parser->known != NULL && record->waypoint.id != NULL &&
+                    ph_import_known_contains(parser->known,
+                        record->waypoint.id, log.id)) {
+                /* stored by an earlier import, do not even read it */
+                ++record->known_logs;
+                skip = TRUE;
+            }
+            else
+                in_log = TRUE;
+            continue;
+        }
+        else if (!in_log) {
+            skip = TRUE;    /* ignore stuff outside <log>...</log> */
+            continue;
+        }
+
+        start = ph_import_parser_clock(parser);
+        switch (element) {
+        case PH_IMPORT_ELEMENT_DATE:
+            success = ph_xml_extract_time(reader, &log.logged, error);
+            break;
+        case PH_IMPORT_ELEMENT_TYPE:
+            success = ph_xml_extract_value(reader,
+                    ph_import_parser_matchers.log_types,
+                    (gint *) &log.type, error);
+            break;
+        case PH_IMPORT_ELEMENT_FINDER:
+            success = ph_xml_extract_text(reader, record->arena,
+                    &log.logger, error);
+            break;
+        case PH_IMPORT_ELEMENT_TEXT:
+            success = ph_xml_extract_text(reader, record->arena,
+                    &log.details, error);
+            break;
+        default:
+            skip = TRUE;
+            continue;
+        }
+
+        ph_import_parser_account(parser, element, start);
+    } while (success && xmlTextReaderDepth(reader) > depth);
+
+    if (rc == -1)
+        success = ph_xml_set_last_error(error);
+
+    return success;
+}
+
+/* Travelbugs {{{2 */
+
+/*
+ * Read the content of a <travelbugs> element.  The trackables listed there
+ * replace all trackables currently associated with the geocache.
+ */
+static gboolean
+ph_import_parser_gpx_travelbugs(PHImportParser *parser,
+                                PHImportRecord *record,
+                                GError **error)
+{
+    PHTrackable trackable = {0};
+    xmlTextReaderPtr reader = parser->reader;
+    gboolean success = TRUE, skip = FALSE;
+    int depth, rc, type;
+    PHImportElement element;
+    gint64 start, travelbug_start = 0;
+    gboolean in_travelbug = FALSE;
+
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    /* an empty list still removes the current trackables */
+    if (record->trackables == NULL)
+        record->trackables = g_array_new(FALSE, FALSE, sizeof(PHTrackable));
+
+    /* get list of new trackables */
+    if (xmlTextReaderIsEmptyElement(reader))
+        return TRUE;
+    depth = xmlTextReaderDepth(reader);
+    do {
+        rc = ph_import_parser_advance(parser, skip);
+        skip = FALSE;
+        if (rc != 1)
+            break;
+        type = xmlTextReaderNodeType(reader);
+        if (type != 1 && type != 15)
+            continue;       /* other than that, consider element nodes */
+        element = ph_import_parser_element(parser);
+
+        if (element == PH_IMPORT_ELEMENT_TRAVELBUG) {
+            if (!in_travelbug && type == 1) {
+                /* <travelbug>: prepare for next trackable */
+                travelbug_start = ph_import_parser_clock(parser);
+                trackable.name = trackable.id = NULL;
+                success = ph_xml_attrib_text(reader, record->arena,
+                        (xmlChar *) "ref", &trackable.id, error);
+                if (success)
+                    in_travelbug = TRUE;
+            }
+            else if (in_travelbug && type == 15) {
+                /* </travelbug>: the strings live in the record's arena */
+                g_array_append_val(record->trackables, trackable);
+                in_travelbug = FALSE;
+                ph_import_parser_account(parser, PH_IMPORT_ELEMENT_TRAVELBUG,
+                        travelbug_start);
+            }
+        }
+        else if (type != 1)
+            continue;
+        else if (in_travelbug && element == PH_IMPORT_ELEMENT_NAME) {
+            start = ph_import_parser_clock(parser);
+            success = ph_xml_extract_text(reader, record->arena,
+                    &trackable.name, error);
+            ph_import_parser_account(parser, element, start);
+        }
+        else
+            skip = TRUE;
+    } while (success && xmlTextReaderDepth(reader) > depth);
+
+    if (rc == -1)
+        success = ph_xml_set_last_error(error);
+
+    return success;
+}
+
+/* Author {{{2 */
+
+/*
+ * Interpret the geocache listing site information from an <author> element.
+ * This is needed to determine the ID of the geocache each extra waypoint
+ * belongs to.
+ */
+static gboolean
+ph_import_parser_gpx_author(PHImportParser *parser,
+                            GError **error)
+{
+    gint value;
+
+    if (ph_xml_extract_value(parser->reader,
+                ph_import_parser_matchers.geocache_sites, &value, error)) {
+        parser->site = (PHGeocacheSite) value;
+        return TRUE;
+    }
+    else
+        return FALSE;
+}
+
+/* Profiling {{{1 */
+
+/*
+ * Create an empty profile to be attached to parsers with
+ * ph_import_parser_set_profile().
+ */
+PHImportProfile *
+ph_import_profile_new()
+{
+    PHImportProfile *result = g_new0(PHImportProfile, 1);
+
+    g_mutex_init(&result->mutex);
+
+    return result;
+}
+
+/*
+ * Free a profile.  All parsers using it must have been freed before.  No-op
+ * for NULL.
+ */
+void
+ph_import_profile_free(PHImportProfile *profile)
+{
+    if (profile == NULL)
+        return;
+
+    g_mutex_clear(&profile->mutex);
+    g_free(profile);
+}
+
+/*
+ * Write the collected timings to the debug log.  The time of an element
+ * includes the elements nested inside it, so <wpt> covers nearly everything.
+ */
+void
+ph_import_profile_log(PHImportProfile *profile)
+{
+    PHImportElement element;
+
+    g_return_if_fail(profile != NULL);
+
+    g_mutex_lock(&profile->mutex);
+
+    g_debug("Time spent per GPX element, including nested elements:");
+    for (element = PH_IMPORT_ELEMENT_UNKNOWN;
+            element < PH_IMPORT_ELEMENT_COUNT; ++element) {
+        guint count = profile->count[element];
+        gdouble seconds = profile->time[element] / 1e6;
+
+        if (count == 0)
+            continue;
+        if (element == PH_IMPORT_ELEMENT_UNKNOWN)
+            g_debug("  %-20s %9u skipped   %8.3f s  %8.2f us each",
+                    "(other elements)", count, seconds, seconds * 1e6 / count);
+        else
+            g_debug("  %-20s %9u elements  %8.3f s  %8.2f us each",
+                    ph_import_element_names[element], count, seconds,
+                    seconds * 1e6 / count);
+    }
+    g_debug("Time spent storing records: %.3f s", profile->store_time / 1e6);
+
+    g_mutex_unlock(&profile->mutex);
+}
+
+/*
+ * Charge the given number of microseconds to storing records in the
+ * database.
+ */
+void
+ph_import_profile_add_store_time(PHImportProfile *profile,
+                                 gint64 time)
+{
+    g_return_if_fail(profile != NULL);
+
+    g_mutex_lock(&profile->mutex);
+    profile->store_time += time;
+    g_mutex_unlock(&profile->mutex);
+}
+
+/*
+ * Get the number of seconds spent parsing the GPX elements which have been
+ * read, summed up over all parsers.
+ */
+gdouble
+ph_import_profile_get_parse_time(PHImportProfile *profile)
+{
+    gint64 result;
+
+    g_return_val_if_fail(profile != NULL, 0);
+
+    g_mutex_lock(&profile->mutex);
+    result = profile->time[PH_IMPORT_ELEMENT_WPT] +
+        profile->time[PH_IMPORT_ELEMENT_AUTHOR];
+    g_mutex_unlock(&profile->mutex);
+
+    return result / 1e6;
+}
+
+/*
+ * Get the number of seconds spent on the elements whose text is looked up in
+ * a string table.  This is part of the parse time.
+ */
+gdouble
+ph_import_profile_get_lookup_time(PHImportProfile *profile)
+{
+    gint64 result;
+
+    g_return_val_if_fail(profile != NULL, 0);
+
+    g_mutex_lock(&profile->mutex);
+    result = profile->time[PH_IMPORT_ELEMENT_SYM] +
+        profile->time[PH_IMPORT_ELEMENT_TYPE] +
+        profile->time[PH_IMPORT_ELEMENT_CONTAINER] +
+        profile->time[PH_IMPORT_ELEMENT_AUTHOR];
+    g_mutex_unlock(&profile->mutex);
+
+    return result / 1e6;
+}
+
+/*
+ * Get the number of seconds spent storing records in the database.
+ */
+gdouble
+ph_import_profile_get_store_time(PHImportProfile *profile)
+{
+    gint64 result;
+
+    g_return_val_if_fail(profile != NULL, 0);
+
+    g_mutex_lock(&profile->mutex);
+    result = profile->store_time;
+    g_mutex_unlock(&profile->mutex);
+
+    return result / 1e6;
+}
+
+/* Records {{{1 */
+
+/*
+ * Feed a number of bytes into a running FNV-1a hash.
+ */
+static guint64
+ph_import_record_hash_bytes(guint64 hash,
+                            gconstpointer data,
+                            gsize length)
+{
+    const guchar *cur = (const guchar *) data, *end = cur + length;
+
+    for (; cur < end; ++cur) {
+        hash ^= *cur;
+        hash *= PH_IMPORT_RECORD_HASH_PRIME;
+    }
+
+    return hash;
+}
+
+/*
+ * Feed an integer into a running hash.
+ */
+static guint64
+ph_import_record_hash_int(guint64 hash,
+                          gint64 value)
+{
+    return ph_import_record_hash_bytes(hash, &value, sizeof(value));
+}
+
+/*
+ * Feed a string into a running hash.  The terminating NUL is included, so
+ * consecutive strings cannot run into each other; NULL hashes differently
+ * from the empty string.
+ */
+static guint64
+ph_import_record_hash_string(guint64 hash,
+                             const gchar *text)
+{
+    if (text == NULL)
+        return ph_import_record_hash_int(hash, -1);
+    else
+        return ph_import_record_hash_bytes(hash, text, strlen(text) + 1);
+}
+
+/*
+ * Compute a fingerprint of everything stored for a record, so that a record
+ * which has not changed since the last import can be recognized without
+ * comparing it to the database field by field.
+ */
+static guint64
+ph_import_record_hash(const PHImportRecord *record)
+{
+    const PHWaypoint *wpt = &record->waypoint;
+    guint64 hash = PH_IMPORT_RECORD_HASH_BASIS;
+    guint i;
+
+    hash = ph_import_record_hash_string(hash, wpt->id);
+    hash = ph_import_record_hash_string(hash, wpt->geocache_id);
+    hash = ph_import_record_hash_string(hash, wpt->name);
+    hash = ph_import_record_hash_string(hash, wpt->url);
+    hash = ph_import_record_hash_int(hash, wpt->placed);
+    hash = ph_import_record_hash_string(hash, wpt->summary);
+    hash = ph_import_record_hash_string(hash, wpt->description);
+    hash = ph_import_record_hash_int(hash, wpt->type);
+    hash = ph_import_record_hash_int(hash, wpt->latitude);
+    hash = ph_import_record_hash_int(hash, wpt->longitude);
+
+    if (record->geocache != NULL) {
+        const PHGeocache *gc = record->geocache;
+
+        hash = ph_import_record_hash_string(hash, gc->name);
+        hash = ph_import_record_hash_string(hash, gc->creator);
+        hash = ph_import_record_hash_string(hash, gc->owner);
+        hash = ph_import_record_hash_int(hash, gc->type);
+        hash = ph_import_record_hash_int(hash, gc->size);
+        hash = ph_import_record_hash_int(hash, gc->difficulty);
+        hash = ph_import_record_hash_int(hash, gc->terrain);
+        for (i = 0; i < PH_GEOCACHE_ATTRS_WORDS; ++i) {
+            hash = ph_import_record_hash_int(hash, gc->attributes.yes[i]);
+            hash = ph_import_record_hash_int(hash, gc->attributes.no[i]);
+        }
+        hash = ph_import_record_hash_int(hash, gc->summary_html);
+        hash = ph_import_record_hash_string(hash, gc->summary);
+        hash = ph_import_record_hash_int(hash, gc->description_html);
+        hash = ph_import_record_hash_string(hash, gc->description);
+        hash = ph_import_record_hash_string(hash, gc->hint);
+        hash = ph_import_record_hash_int(hash, gc->logged);
+        hash = ph_import_record_hash_int(hash, gc->available);
+        hash = ph_import_record_hash_int(hash, gc->archived);
+    }
+
+    /* logs known to be stored are not read at all, so only the IDs of the
+     * logs tell whether there are new ones */
+    hash = ph_import_record_hash_int(hash,
+            (record->logs == NULL) ? -1 :
+                (gint64) (record->logs->len + record->known_logs));
+    hash = ph_import_record_hash_int(hash, (gint64) record->log_ids);
+
+    /* a missing <travelbugs> element leaves the trackables alone, while an
+     * empty one removes them */
+    hash = ph_import_record_hash_int(hash, (record->trackables == NULL)
+            ? -1 : (gint64) record->trackables->len);
+    if (record->trackables != NULL) {
+        for (i = 0; i < record->trackables->len; ++i) {
+            const PHTrackable *trackable =
+                &g_array_index(record->trackables, PHTrackable, i);
+
+            hash = ph_import_record_hash_string(hash, trackable->id);
+            hash = ph_import_record_hash_string(hash, trackable->name);
+        }
+    }
+
+    return hash;
+}
+
+/*
+ * Free a record obtained from ph_import_parser_next(), releasing all of its
+ * strings at once together with the arena.  No-op for NULL.
+ */
+void
+ph_import_record_free(PHImportRecord *record)
+{
+    if (record == NULL)
+        return;
+
+    if (record->logs != NULL)
+        g_array_free(record->logs, TRUE);
+    if (record->trackables != NULL)
+        g_array_free(record->trackables, TRUE);
+
+    /* all strings and the geocache itself */
+    ph_arena_free(record->arena);
+    g_free(record);
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
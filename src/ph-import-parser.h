@@ -0,0 +1,84 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+#ifndef PH_IMPORT_PARSER_H
+#define PH_IMPORT_PARSER_H
+
+/* Includes {{{1 */
+
+#include "ph-arena.h"
+#include "ph-geocache.h"
+#include "ph-import-known.h"
+#include "ph-log.h"
+#include "ph-trackable.h"
+#include "ph-waypoint.h"
+#include <libxml/xmlreader.h>
+
+/* Data types {{{1 */
+
+/*
+ * Everything read from a single <wpt> element.  The geocache shares its ID
+ * with the waypoint.  All strings and the geocache are allocated from the
+ * arena of the record.
+ */
+typedef struct _PHImportRecord {
+    PHWaypoint waypoint;        /* the waypoint itself */
+    PHGeocache *geocache;       /* geocache details, or NULL */
+    GArray *logs;               /* array of PHLog, or NULL */
+    GArray *trackables;         /* array of PHTrackable; NULL if the listing
+                                 * contains no <travelbugs> element */
+    PHArena *arena;             /* memory for the strings above */
+    guint64 log_ids;            /* fingerprint of the IDs of all logs */
+    guint known_logs;           /* logs skipped as already stored */
+    guint64 hash;               /* fingerprint of all of the above */
+    glong offset;               /* input bytes consumed after the record */
+} PHImportRecord;
+
+/*
+ * Parsing state associated with an XML reader.
+ */
+typedef struct _PHImportParser PHImportParser;
+
+/*
+ * Time spent on each kind of GPX element, collected from any number of
+ * parsers.
+ */
+typedef struct _PHImportProfile PHImportProfile;
+
+/* Public interface {{{1 */
+
+PHImportParser *ph_import_parser_new(xmlTextReaderPtr reader);
+void ph_import_parser_free(PHImportParser *parser);
+
+gboolean ph_import_parser_next(PHImportParser *parser,
+                               PHImportRecord **record,
+                               GError **error);
+glong ph_import_parser_get_offset(const PHImportParser *parser);
+void ph_import_parser_set_profile(PHImportParser *parser,
+                                  PHImportProfile *profile);
+void ph_import_parser_set_known(PHImportParser *parser,
+                                const PHImportKnown *known);
+
+PHImportProfile *ph_import_profile_new();
+void ph_import_profile_free(PHImportProfile *profile);
+void ph_import_profile_log(PHImportProfile *profile);
+void ph_import_profile_add_store_time(PHImportProfile *profile,
+                                      gint64 time);
+gdouble ph_import_profile_get_parse_time(PHImportProfile *profile);
+gdouble ph_import_profile_get_lookup_time(PHImportProfile *profile);
+gdouble ph_import_profile_get_store_time(PHImportProfile *profile);
+
+void ph_import_record_free(PHImportRecord *record);
+
+/* }}} */
+
+#endif
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
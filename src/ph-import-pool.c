@@ -0,0 +1,566 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/* Includes {{{1 */
+
+#include "ph-import-chunk.h"
+#include "ph-import-pool.h"
+#include "ph-import-source.h"
+#include "ph-xml.h"
+#include <sys/stat.h>
+
+/* Constants {{{1 */
+
+/*
+ * Maximum number of parsed records waiting to be stored per file.  Workers
+ * block when their queue is full.
+ */
+#define PH_IMPORT_POOL_QUEUE_LENGTH 64
+
+/*
+ * Minimum change in the progress fraction before another progress event is
+ * sent to the main loop.
+ */
+#define PH_IMPORT_POOL_PROGRESS_STEP 0.005
+
+/*
+ * Minimum number of bytes read from a file of unknown size before another
+ * progress event is sent.
+ */
+#define PH_IMPORT_POOL_BYTES_STEP (1 << 20)
+
+/* Data structures {{{1 */
+
+/*
+ * A single file, or a chunk of a large file, to be imported.  Everything
+ * except the first four fields is protected by the pool mutex.
+ */
+typedef struct _PHImportJob {
+    gchar *filename;            /* path of the file */
+    goffset total;              /* length of the file in bytes, or 0 */
+    PHImportChunk *chunk;       /* part of the file to parse, or NULL */
+    gboolean announce;          /* is this the first job for the file? */
+    GQueue records;             /* parsed records waiting to be stored */
+    gboolean finished;          /* has the worker read the entire file? */
+    GError *error;              /* reason why parsing failed */
+} PHImportJob;
+
+struct _PHImportPool {
+    PHImportWriter *writer;     /* used exclusively by the writer thread */
+    gdouble fraction;           /* progress last reported by the writer */
+    goffset offset;             /* position in the file back then */
+    GPtrArray *jobs;            /* list of PHImportJob, in import order */
+    PHImportProfile *profile;   /* element timings of all parsers, or NULL */
+    const PHImportKnown *known; /* logs the parsers skip, or NULL */
+    GAsyncQueue *events;        /* events for the main loop */
+
+    GMutex mutex;               /* protects the fields below and the jobs */
+    GCond produced;             /* a record has been queued or a job ended */
+    GCond consumed;             /* a record has been taken from a queue */
+    guint next_job;             /* index of the next job to be parsed */
+    gboolean cancelled;         /* should all threads stop immediately? */
+
+    GThread **workers;          /* parser threads */
+    guint worker_count;         /* number of parser threads */
+    GThread *writer_thread;     /* thread storing the records */
+};
+
+/* Forward declarations {{{1 */
+
+static gpointer ph_import_pool_work(gpointer data);
+static void ph_import_pool_parse(PHImportPool *pool, PHImportJob *job);
+static gboolean ph_import_pool_parse_reader(PHImportPool *pool,
+                                            PHImportJob *job,
+                                            xmlTextReaderPtr reader,
+                                            PHImportSource *source,
+                                            glong base, GError **error);
+static gboolean ph_import_pool_push(PHImportPool *pool, PHImportJob *job,
+                                    PHImportRecord *record);
+static gpointer ph_import_pool_write(gpointer data);
+static gboolean ph_import_pool_write_job(PHImportPool *pool,
+                                         PHImportJob *job);
+static gboolean ph_import_pool_switch_file(PHImportPool *pool,
+                                           const gchar *filename);
+static void ph_import_pool_send(PHImportPool *pool, PHImportEventType type,
+                                const gchar *filename, gdouble fraction,
+                                goffset offset, GError *error);
+static void ph_import_pool_cancel(PHImportPool *pool);
+static void ph_import_pool_add_jobs(PHImportPool *pool,
+                                    const gchar *filename, guint threads);
+static void ph_import_job_free(PHImportJob *job);
+
+/* Pool creation {{{1 */
+
+/*
+ * Start importing the given files using the specified number of parser
+ * threads.  Large files are split into chunks to be parsed in parallel as
+ * well.  The records are stored using writer, which must not be used by
+ * anyone else until the pool has been freed.  Progress is reported through
+ * ph_import_pool_pop_event().  If profile is not NULL, the parsers record
+ * their timings in it.  Logs contained in known, if not NULL, are skipped.
+ */
+PHImportPool *
+ph_import_pool_new(PHImportWriter *writer,
+                   gchar **filenames,
+                   guint threads,
+                   PHImportProfile *profile,
+                   const PHImportKnown *known)
+{
+    PHImportPool *result;
+    gchar **filename;
+    guint i;
+
+    g_return_val_if_fail(writer != NULL, NULL);
+    g_return_val_if_fail(filenames != NULL, NULL);
+    g_return_val_if_fail(threads > 0, NULL);
+
+    /* libxml2 has to be initialized before it is used from several threads */
+    xmlInitParser();
+
+    result = g_new0(PHImportPool, 1);
+    result->writer = writer;
+    result->profile = profile;
+    result->known = known;
+    result->jobs = g_ptr_array_new_with_free_func(
+            (GDestroyNotify) ph_import_job_free);
+    result->events = g_async_queue_new_full(
+            (GDestroyNotify) ph_import_event_free);
+
+    g_mutex_init(&result->mutex);
+    g_cond_init(&result->produced);
+    g_cond_init(&result->consumed);
+
+    for (filename = filenames; *filename != NULL; ++filename)
+        ph_import_pool_add_jobs(result, *filename, threads);
+
+    result->worker_count = MIN(threads, MAX(result->jobs->len, 1));
+    result->workers = g_new0(GThread *, result->worker_count);
+    for (i = 0; i < result->worker_count; ++i)
+        result->workers[i] = g_thread_new("import-parser",
+                ph_import_pool_work, result);
+    result->writer_thread = g_thread_new("import-writer",
+            ph_import_pool_write, result);
+
+    return result;
+}
+
+/*
+ * Stop all threads, wait for them to exit and free the pool.  No-op for NULL.
+ */
+void
+ph_import_pool_free(PHImportPool *pool)
+{
+    guint i;
+
+    if (pool == NULL)
+        return;
+
+    ph_import_pool_cancel(pool);
+
+    for (i = 0; i < pool->worker_count; ++i)
+        (void) g_thread_join(pool->workers[i]);
+    (void) g_thread_join(pool->writer_thread);
+    g_free(pool->workers);
+
+    g_ptr_array_free(pool->jobs, TRUE);
+    g_async_queue_unref(pool->events);
+
+    g_mutex_clear(&pool->mutex);
+    g_cond_clear(&pool->produced);
+    g_cond_clear(&pool->consumed);
+
+    g_free(pool);
+}
+
+/*
+ * Create the jobs for a single file, splitting it into chunks if it is large
+ * enough.
+ */
+static void
+ph_import_pool_add_jobs(PHImportPool *pool,
+                        const gchar *filename,
+                        guint threads)
+{
+    GPtrArray *chunks = NULL;
+    struct stat info;
+    goffset total = 0;
+    guint i, count;
+
+    if (stat(filename, &info) == 0)
+        total = info.st_size;
+
+    /* files which cannot be mapped or split are left to a single parser,
+     * which will report any problem at the right time; pipes must not even
+     * be opened before that */
+    if (threads > 1 && !ph_import_source_is_stream(filename))
+        chunks = ph_import_chunk_split(filename, threads, NULL);
+    count = (chunks == NULL) ? 1 : chunks->len;
+
+    for (i = 0; i < count; ++i) {
+        PHImportJob *job = g_new0(PHImportJob, 1);
+
+        job->filename = g_strdup(filename);
+        job->total = total;
+        job->announce = (i == 0);
+        if (chunks != NULL)
+            job->chunk = g_ptr_array_index(chunks, i);
+        g_queue_init(&job->records);
+        g_ptr_array_add(pool->jobs, job);
+    }
+
+    if (chunks != NULL) {
+        /* the jobs own the chunks now */
+        g_ptr_array_set_free_func(chunks, NULL);
+        g_ptr_array_free(chunks, TRUE);
+    }
+}
+
+/*
+ * Free a job together with any records which have not been stored.
+ */
+static void
+ph_import_job_free(PHImportJob *job)
+{
+    PHImportRecord *record;
+
+    g_free(job->filename);
+    ph_import_chunk_free(job->chunk);
+    while ((record = g_queue_pop_head(&job->records)) != NULL)
+        ph_import_record_free(record);
+    if (job->error != NULL)
+        g_error_free(job->error);
+    g_free(job);
+}
+
+/*
+ * Ask all threads to stop as soon as possible.
+ */
+static void
+ph_import_pool_cancel(PHImportPool *pool)
+{
+    g_mutex_lock(&pool->mutex);
+    pool->cancelled = TRUE;
+    g_cond_broadcast(&pool->produced);
+    g_cond_broadcast(&pool->consumed);
+    g_mutex_unlock(&pool->mutex);
+}
+
+/* Parser threads {{{1 */
+
+/*
+ * Main function of the parser threads: parse one file after another until
+ * all files have been assigned to a thread.
+ */
+static gpointer
+ph_import_pool_work(gpointer data)
+{
+    PHImportPool *pool = (PHImportPool *) data;
+    PHImportJob *job;
+
+    for (;;) {
+        g_mutex_lock(&pool->mutex);
+        if (pool->cancelled || pool->next_job >= pool->jobs->len)
+            job = NULL;
+        else
+            job = g_ptr_array_index(pool->jobs, pool->next_job++);
+        g_mutex_unlock(&pool->mutex);
+
+        if (job == NULL)
+            break;
+        ph_import_pool_parse(pool, job);
+    }
+
+    return NULL;
+}
+
+/*
+ * Parse a single file or chunk and queue its records for the writer thread.
+ */
+static void
+ph_import_pool_parse(PHImportPool *pool,
+                     PHImportJob *job)
+{
+    PHImportSource *source;
+    xmlTextReaderPtr reader;
+    GError *error = NULL;
+
+    if (job->chunk != NULL) {
+        reader = ph_import_chunk_open(job->chunk);
+        if (reader == NULL)
+            (void) ph_xml_set_last_error(&error);
+        else
+            (void) ph_import_pool_parse_reader(pool, job, reader, NULL,
+                    ph_import_chunk_get_base(job->chunk), &error);
+    }
+    else {
+        /* a file may contain several documents if it is an archive */
+        source = ph_import_source_open(job->filename, &error);
+        while (source != NULL &&
+                (reader = ph_import_source_next_reader(source, &error)) !=
+                NULL &&
+                ph_import_pool_parse_reader(pool, job, reader, source, 0,
+                    &error))
+            ;
+        ph_import_source_free(source);
+    }
+
+    g_mutex_lock(&pool->mutex);
+    job->finished = TRUE;
+    job->error = error;
+    g_cond_broadcast(&pool->produced);
+    g_mutex_unlock(&pool->mutex);
+}
+
+/*
+ * Parse a single document and queue its records.  The offset of each record
+ * is made relative to the start of the file, either by adding base or, for
+ * documents read from source, by letting the source translate it.  Returns
+ * FALSE on error or if the pool has been cancelled.
+ */
+static gboolean
+ph_import_pool_parse_reader(PHImportPool *pool,
+                            PHImportJob *job,
+                            xmlTextReaderPtr reader,
+                            PHImportSource *source,
+                            glong base,
+                            GError **error)
+{
+    PHImportParser *parser = ph_import_parser_new(reader);
+    PHImportRecord *record = NULL;
+    gboolean success;
+
+    ph_import_parser_set_profile(parser, pool->profile);
+    ph_import_parser_set_known(parser, pool->known);
+
+    do {
+        success = ph_import_parser_next(parser, &record, error);
+        if (success && record != NULL) {
+            if (source != NULL)
+                record->offset = ph_import_source_get_offset(source,
+                        record->offset);
+            else
+                record->offset += base;
+            success = ph_import_pool_push(pool, job, record);
+        }
+    } while (success && record != NULL);
+
+    if (!success && source != NULL)
+        (void) ph_import_source_take_error(source, error);
+    ph_import_parser_free(parser);
+    return success;
+}
+
+/*
+ * Append a record to the queue of a job, waiting for the writer thread if
+ * the queue is full.  Returns FALSE (and frees the record) if the pool has
+ * been cancelled.
+ */
+static gboolean
+ph_import_pool_push(PHImportPool *pool,
+                    PHImportJob *job,
+                    PHImportRecord *record)
+{
+    gboolean cancelled;
+
+    g_mutex_lock(&pool->mutex);
+    while (!pool->cancelled &&
+            job->records.length >= PH_IMPORT_POOL_QUEUE_LENGTH)
+        g_cond_wait(&pool->consumed, &pool->mutex);
+
+    cancelled = pool->cancelled;
+    if (!cancelled) {
+        g_queue_push_tail(&job->records, record);
+        g_cond_broadcast(&pool->produced);
+    }
+    g_mutex_unlock(&pool->mutex);
+
+    if (cancelled)
+        ph_import_record_free(record);
+    return !cancelled;
+}
+
+/* Writer thread {{{1 */
+
+/*
+ * Main function of the writer thread: store the records of all jobs in
+ * order, one file after the other.
+ */
+static gpointer
+ph_import_pool_write(gpointer data)
+{
+    PHImportPool *pool = (PHImportPool *) data;
+    PHImportJob *job;
+    guint i;
+
+    for (i = 0; i < pool->jobs->len; ++i) {
+        job = g_ptr_array_index(pool->jobs, i);
+        if (job->announce && !ph_import_pool_switch_file(pool, job->filename))
+            return NULL;
+        if (!ph_import_pool_write_job(pool, job))
+            return NULL;
+    }
+    if (!ph_import_pool_switch_file(pool, NULL))
+        return NULL;
+
+    ph_import_pool_send(pool, PH_IMPORT_EVENT_DONE, NULL, 1.0, 0, NULL);
+    return NULL;
+}
+
+/*
+ * Store all records of a single job.  Returns FALSE if the import has failed
+ * or has been cancelled.
+ */
+static gboolean
+ph_import_pool_write_job(PHImportPool *pool,
+                         PHImportJob *job)
+{
+    PHImportRecord *record;
+    GError *error = NULL;
+    gdouble fraction;
+    goffset offset;
+    gboolean success;
+
+    if (job->announce) {
+        ph_import_pool_send(pool, PH_IMPORT_EVENT_FILENAME, job->filename,
+                0.0, 0, NULL);
+        pool->fraction = 0.0;
+        pool->offset = 0;
+    }
+
+    for (;;) {
+        g_mutex_lock(&pool->mutex);
+        while (!pool->cancelled && job->records.length == 0 && !job->finished)
+            g_cond_wait(&pool->produced, &pool->mutex);
+
+        if (pool->cancelled) {
+            g_mutex_unlock(&pool->mutex);
+            return FALSE;
+        }
+
+        record = g_queue_pop_head(&job->records);
+        if (record != NULL)
+            g_cond_broadcast(&pool->consumed);
+        else {
+            /* the worker is done with this file */
+            error = job->error;
+            job->error = NULL;
+        }
+        g_mutex_unlock(&pool->mutex);
+
+        if (record == NULL)
+            break;
+
+        success = ph_import_writer_store_record(pool->writer, record, &error);
+        offset = record->offset;
+        fraction = (job->total != 0) ? ((gdouble) offset) / job->total : 0.0;
+        ph_import_record_free(record);
+
+        if (!success)
+            break;
+        if (fraction - pool->fraction >= PH_IMPORT_POOL_PROGRESS_STEP ||
+                (job->total == 0 &&
+                 offset - pool->offset >= PH_IMPORT_POOL_BYTES_STEP)) {
+            ph_import_pool_send(pool, PH_IMPORT_EVENT_PROGRESS, NULL,
+                    fraction, offset, NULL);
+            pool->fraction = fraction;
+            pool->offset = offset;
+        }
+    }
+
+    if (error != NULL) {
+        /* stop the parser threads as well */
+        ph_import_pool_cancel(pool);
+        ph_import_pool_send(pool, PH_IMPORT_EVENT_ERROR, NULL, 0.0, 0,
+                error);
+        return FALSE;
+    }
+    else
+        return TRUE;
+}
+
+/*
+ * Tell the writer that the previous file has been stored completely and that
+ * the records of filename, unless it is NULL, follow.  Returns FALSE if the
+ * import has failed.
+ */
+static gboolean
+ph_import_pool_switch_file(PHImportPool *pool,
+                           const gchar *filename)
+{
+    GError *error = NULL;
+
+    if (ph_import_writer_end_file(pool->writer, &error) &&
+            (filename == NULL ||
+             ph_import_writer_begin_file(pool->writer, filename, &error)))
+        return TRUE;
+
+    ph_import_pool_cancel(pool);
+    ph_import_pool_send(pool, PH_IMPORT_EVENT_ERROR, NULL, 0.0, 0, error);
+    return FALSE;
+}
+
+/* Events {{{1 */
+
+/*
+ * Queue an event for the main loop.  Takes ownership of error.
+ */
+static void
+ph_import_pool_send(PHImportPool *pool,
+                    PHImportEventType type,
+                    const gchar *filename,
+                    gdouble fraction,
+                    goffset offset,
+                    GError *error)
+{
+    PHImportEvent *event = g_new0(PHImportEvent, 1);
+
+    event->type = type;
+    event->filename = g_strdup(filename);
+    event->fraction = fraction;
+    event->offset = offset;
+    event->error = error;
+
+    g_async_queue_push(pool->events, event);
+}
+
+/*
+ * Get the next event reported by the writer thread, waiting at most timeout
+ * milliseconds.  Events are returned in the order they happened.  Returns
+ * NULL if no event is available; otherwise, the caller has to free the event
+ * using ph_import_event_free().
+ */
+PHImportEvent *
+ph_import_pool_pop_event(PHImportPool *pool,
+                         guint timeout)
+{
+    g_return_val_if_fail(pool != NULL, NULL);
+
+    return g_async_queue_timeout_pop(pool->events,
+            ((guint64) timeout) * 1000);
+}
+
+/*
+ * Free an event obtained from ph_import_pool_pop_event().  No-op for NULL.
+ */
+void
+ph_import_event_free(PHImportEvent *event)
+{
+    if (event == NULL)
+        return;
+
+    g_free(event->filename);
+    if (event->error != NULL)
+        g_error_free(event->error);
+    g_free(event);
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
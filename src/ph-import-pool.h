@@ -0,0 +1,66 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+#ifndef PH_IMPORT_POOL_H
+#define PH_IMPORT_POOL_H
+
+/* Includes {{{1 */
+
+#include "ph-import-writer.h"
+
+/* Events {{{1 */
+
+/*
+ * Types of events reported by an import pool.
+ */
+typedef enum _PHImportEventType {
+    PH_IMPORT_EVENT_FILENAME,   /* started storing the records of a file */
+    PH_IMPORT_EVENT_PROGRESS,   /* progress within the current file */
+    PH_IMPORT_EVENT_ERROR,      /* the import failed */
+    PH_IMPORT_EVENT_DONE        /* all files have been imported */
+} PHImportEventType;
+
+/*
+ * Event passed from the writer thread to the main loop.
+ */
+typedef struct _PHImportEvent {
+    PHImportEventType type;
+    gchar *filename;            /* file name for FILENAME */
+    gdouble fraction;           /* progress for PROGRESS */
+    goffset offset;             /* bytes read from the file for PROGRESS */
+    GError *error;              /* failure reason for ERROR */
+} PHImportEvent;
+
+/* Data types {{{1 */
+
+/*
+ * Set of threads parsing files in parallel and a single thread storing the
+ * results in file order.
+ */
+typedef struct _PHImportPool PHImportPool;
+
+/* Public interface {{{1 */
+
+PHImportPool *ph_import_pool_new(PHImportWriter *writer,
+                                 gchar **filenames,
+                                 guint threads,
+                                 PHImportProfile *profile,
+                                 const PHImportKnown *known);
+void ph_import_pool_free(PHImportPool *pool);
+
+PHImportEvent *ph_import_pool_pop_event(PHImportPool *pool,
+                                        guint timeout);
+void ph_import_event_free(PHImportEvent *event);
+
+/* }}} */
+
+#endif
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -10,30 +10,66 @@
 
 /* Includes {{{1 */
 
-#include "ph-geocache.h"
-#include "ph-gpx.h"
+#include "ph-import-parser.h"
+#include "ph-import-pool.h"
 #include "ph-import-process.h"
-#include "ph-log.h"
-#include "ph-trackable.h"
-#include "ph-waypoint.h"
-#include "ph-xml.h"
+#include "ph-import-source.h"
+#include "ph-import-writer.h"
 #include <glib/gi18n.h>
-#include <libxml/xmlreader.h>
-#include <math.h>
 #include <sys/stat.h>
 
+/* Constants {{{1 */
+
+/*
+ * Maximum time in milliseconds a single step waits for the import threads.
+ */
+#define PH_IMPORT_PROCESS_POLL_TIMEOUT 50
+
+/*
+ * Maximum number of changed geocaches announced one by one.  Beyond that,
+ * listeners are told to reload everything instead.
+ */
+#define PH_IMPORT_PROCESS_ANNOUNCE_LIMIT 256
+
+/*
+ * Assumed number of uncompressed GPX bytes per waypoint, logs included.
+ * Pocket queries tend to have more, so the estimate errs on the low side.
+ */
+#define PH_IMPORT_PROCESS_WAYPOINT_SIZE 2048
+
+/*
+ * Minimum estimated number of waypoints for which dropping the indexes and
+ * their triggers and building them again is worth the effort.
+ */
+#define PH_IMPORT_PROCESS_BULK_MINIMUM 20000
+
+/*
+ * Number of bytes read from a pipe between two bytes-notify signals, which
+ * replace the progress fraction when the size of a file is unknown.
+ */
+#define PH_IMPORT_PROCESS_BYTES_STEP (16 << 20)
+
+/*
+ * Time in milliseconds the import thread waits for the user interface to
+ * finish writing a note.
+ */
+#define PH_IMPORT_PROCESS_BUSY_TIMEOUT 5000
+
 /* Properties {{{1 */
 
 enum {
     PH_IMPORT_PROCESS_PROP_0,
     PH_IMPORT_PROCESS_PROP_PATH,
-    PH_IMPORT_PROCESS_PROP_DATABASE
+    PH_IMPORT_PROCESS_PROP_DATABASE,
+    PH_IMPORT_PROCESS_PROP_THREADS,
+    PH_IMPORT_PROCESS_PROP_PROFILE
 };
 
 /* Signals {{{1 */
 
 enum {
     PH_IMPORT_PROCESS_SIGNAL_FILENAME_NOTIFY,
+    PH_IMPORT_PROCESS_SIGNAL_BYTES_NOTIFY,
     PH_IMPORT_PROCESS_SIGNAL_COUNT
 };
 
@@ -49,17 +85,48 @@ static guint ph_import_process_signals[PH_IMPORT_PROCESS_SIGNAL_COUNT];
  */
 struct _PHImportProcessPrivate {
     PHDatabase *database;           /* target database */
+    PHDatabase *connection;         /* own connection to it for the thread */
     gchar *path;                    /* path specified at instantiation */
+    guint threads;                  /* number of parser threads */
+    gboolean profiling;             /* log time spent per GPX element? */
+    PHLogRetention *retention;      /* logs to remove afterwards, or NULL */
 
-    GDir *dir;                      /* directory cursor */
+    gchar **files;                  /* paths of all files to be imported */
+    guint next_file;                /* index of the next file to open */
     gchar *filename;                /* file currently being imported */
-    goffset total;                  /* length of the current file in bytes */
-    PHGeocacheSite site;            /* originating listing site */
-    xmlTextReaderPtr xml_reader;    /* XML reader for the file */
+    gboolean streaming;             /* is it a pipe of unknown size? */
+    goffset bytes;                  /* bytes of it announced so far */
+    PHImportSource *source;         /* the file, possibly compressed */
+    PHImportParser *parser;         /* GPX parser for the current document */
+
+    PHImportWriter *writer;         /* prepared statements for storage */
+    PHImportPool *pool;             /* threads for a parallel import */
+    gdouble fraction;               /* last progress reported by the pool */
+    GTimer *timer;                  /* measures the duration of the import */
+    PHImportProfile *profile;       /* element timings, if profiling */
+    PHImportKnown *known;           /* logs stored before, or NULL */
+    gboolean bulk;                  /* have the indexes been dropped? */
+    GHashTable *changed;            /* geocaches to announce after commit */
 
     gboolean success;               /* has the entire process succeeded? */
 };
 
+/*
+ * Name of a file to be announced in the main thread.
+ */
+typedef struct _PHImportProcessFilename {
+    PHImportProcess *process;
+    gchar *filename;
+} PHImportProcessFilename;
+
+/*
+ * Number of bytes read from a pipe, to be announced in the main thread.
+ */
+typedef struct _PHImportProcessBytes {
+    PHImportProcess *process;
+    guint64 bytes;
+} PHImportProcessBytes;
+
 /* Forward declarations {{{1 */
 
 static void ph_import_process_class_init(PHImportProcessClass *cls);
@@ -75,28 +142,41 @@ static gboolean ph_import_process_setup(PHProcess *parent_process,
                                         GError **error);
 static gboolean ph_import_process_step(PHProcess *parent_process,
                                        gdouble *fraction, GError **error);
+static gboolean ph_import_process_step_parallel(PHImportProcess *process,
+                                                gdouble *fraction,
+                                                GError **error);
 static gboolean ph_import_process_next_file(PHImportProcess *process,
                                             GError **error);
+static gboolean ph_import_process_next_document(PHImportProcess *process,
+                                                GError **error);
+static gchar **ph_import_process_list_files(PHImportProcess *process,
+                                            GDir *dir);
+static gboolean ph_import_process_skip_applied(PHImportProcess *process,
+                                               GError **error);
+static gboolean ph_import_process_choose_bulk(PHImportProcess *process,
+                                              GError **error);
+static gboolean ph_import_process_load_known(PHImportProcess *process,
+                                             GError **error);
 static gboolean ph_import_process_finish(PHProcess *parent_process,
                                          GError **error);
+static gboolean ph_import_process_rebuild_indexes(PHImportProcess *process,
+                                                  GError **error);
+static gboolean ph_import_process_apply_retention(PHImportProcess *process,
+                                                  GError **error);
+static gboolean ph_import_process_announce(gpointer data);
+static void ph_import_process_stop_notify(PHProcess *parent_process);
+
+static void ph_import_process_notify_filename(PHImportProcess *process);
+static gboolean ph_import_process_emit_filename(gpointer data);
+static void ph_import_process_filename_free(gpointer data);
+static void ph_import_process_notify_bytes(PHImportProcess *process,
+                                           goffset offset);
+static gboolean ph_import_process_emit_bytes(gpointer data);
+static void ph_import_process_bytes_free(gpointer data);
 
 static void ph_import_process_prefix_error(PHImportProcess *process,
                                            GError **error);
 
-static gboolean ph_import_process_gpx_wpt(PHImportProcess *process,
-                                          GError **error);
-static gboolean ph_import_process_gpx_cache(PHImportProcess *process,
-                                            const PHWaypoint *wpt,
-                                            gboolean logged, GError **error);
-static gboolean ph_import_process_gpx_logs(PHImportProcess *process,
-                                           const PHGeocache *gc,
-                                           GError **error);
-static gboolean ph_import_process_gpx_travelbugs(PHImportProcess *process,
-                                                 const PHGeocache *gc,
-                                                 GError **error);
-static gboolean ph_import_process_gpx_author(PHImportProcess *process,
-                                             GError **error);
-
 /* Standard GObject code {{{1 */
 
 G_DEFINE_TYPE(PHImportProcess, ph_import_process, PH_TYPE_PROCESS)
@@ -115,9 +195,11 @@ ph_import_process_class_init(PHImportProcessClass *cls)
     g_obj_cls->set_property = ph_import_process_set_property;
     g_obj_cls->get_property = ph_import_process_get_property;
 
+    process_cls->threaded = TRUE;
     process_cls->setup = ph_import_process_setup;
     process_cls->step = ph_import_process_step;
     process_cls->finish = ph_import_process_finish;
+    process_cls->stop_notify = ph_import_process_stop_notify;
 
     g_type_class_add_private(cls, sizeof(PHImportProcessPrivate));
 
@@ -133,6 +215,18 @@ ph_import_process_class_init(PHImportProcessClass *cls)
                 "database to store imported geocache information",
                 PH_TYPE_DATABASE,
                 G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+    g_object_class_install_property(g_obj_cls,
+            PH_IMPORT_PROCESS_PROP_THREADS,
+            g_param_spec_uint("threads", "parser threads",
+                "number of threads parsing the imported files",
+                1, G_MAXUINT, 1,
+                G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
+    g_object_class_install_property(g_obj_cls,
+            PH_IMPORT_PROCESS_PROP_PROFILE,
+            g_param_spec_boolean("profile", "profile parsing",
+                "whether to log the time spent on each kind of GPX element",
+                FALSE,
+                G_PARAM_READWRITE | G_PARAM_CONSTRUCT));
 
     ph_import_process_signals[PH_IMPORT_PROCESS_SIGNAL_FILENAME_NOTIFY] =
         g_signal_new("filename-notify", PH_TYPE_IMPORT_PROCESS,
@@ -141,6 +235,13 @@ ph_import_process_class_init(PHImportProcessClass *cls)
                 NULL, NULL,
                 g_cclosure_marshal_VOID__STRING,
                 G_TYPE_NONE, 1, G_TYPE_STRING);
+    ph_import_process_signals[PH_IMPORT_PROCESS_SIGNAL_BYTES_NOTIFY] =
+        g_signal_new("bytes-notify", PH_TYPE_IMPORT_PROCESS,
+                G_SIGNAL_RUN_LAST,
+                G_STRUCT_OFFSET(PHImportProcessClass, bytes_notify),
+                NULL, NULL,
+                g_cclosure_marshal_generic,
+                G_TYPE_NONE, 1, G_TYPE_UINT64);
 }
 
 /*
@@ -166,6 +267,10 @@ ph_import_process_dispose(GObject *object)
         g_object_unref(process->priv->database);
         process->priv->database = NULL;
     }
+    if (process->priv->connection != NULL) {
+        g_object_unref(process->priv->connection);
+        process->priv->connection = NULL;
+    }
 
     if (G_OBJECT_CLASS(ph_import_process_parent_class)->dispose != NULL)
         G_OBJECT_CLASS(ph_import_process_parent_class)->dispose(object);
@@ -181,12 +286,25 @@ ph_import_process_finalize(GObject *object)
 
     if (process->priv->path != NULL)
         g_free(process->priv->path);
-    if (process->priv->dir != NULL)
-        g_dir_close(process->priv->dir);
+    g_strfreev(process->priv->files);
     if (process->priv->filename != NULL)
         g_free(process->priv->filename);
-    if (process->priv->xml_reader != NULL)
-        xmlFreeTextReader(process->priv->xml_reader);
+    if (process->priv->parser != NULL)
+        ph_import_parser_free(process->priv->parser);
+    if (process->priv->source != NULL)
+        ph_import_source_free(process->priv->source);
+    if (process->priv->pool != NULL)
+        ph_import_pool_free(process->priv->pool);
+    if (process->priv->writer != NULL)
+        ph_import_writer_free(process->priv->writer);
+    if (process->priv->timer != NULL)
+        g_timer_destroy(process->priv->timer);
+    if (process->priv->profile != NULL)
+        ph_import_profile_free(process->priv->profile);
+    ph_import_known_free(process->priv->known);
+    if (process->priv->changed != NULL)
+        g_hash_table_unref(process->priv->changed);
+    ph_log_retention_free(process->priv->retention);
 
     if (G_OBJECT_CLASS(ph_import_process_parent_class)->finalize != NULL)
         G_OBJECT_CLASS(ph_import_process_parent_class)->finalize(object);
@@ -214,6 +332,12 @@ ph_import_process_set_property(GObject *object,
             g_object_unref(process->priv->database);
         process->priv->database = PH_DATABASE(g_value_dup_object(value));
         break;
+    case PH_IMPORT_PROCESS_PROP_THREADS:
+        process->priv->threads = g_value_get_uint(value);
+        break;
+    case PH_IMPORT_PROCESS_PROP_PROFILE:
+        process->priv->profiling = g_value_get_boolean(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
     }
@@ -237,6 +361,12 @@ ph_import_process_get_property(GObject *object,
     case PH_IMPORT_PROCESS_PROP_DATABASE:
         g_value_set_object(value, process->priv->database);
         break;
+    case PH_IMPORT_PROCESS_PROP_THREADS:
+        g_value_set_uint(value, process->priv->threads);
+        break;
+    case PH_IMPORT_PROCESS_PROP_PROFILE:
+        g_value_set_boolean(value, process->priv->profiling);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
     }
@@ -245,23 +375,74 @@ ph_import_process_get_property(GObject *object,
 /* Setup {{{1 */
 
 /*
- * Prepare the process for reading the (first) file.
+ * Prepare the process for reading the (first) file.  Like the other stages,
+ * this runs in the thread of the process.
  */
 static gboolean
 ph_import_process_setup(PHProcess *parent_process,
                         GError **error)
 {
     PHImportProcess *process = PH_IMPORT_PROCESS(parent_process);
+    GDir *dir = NULL;
 
-    if (!ph_database_begin(process->priv->database, error))
+    /* with a connection of its own, the import does not block the user
+     * interface, which keeps seeing the old data until the commit */
+    process->priv->connection = ph_database_new(
+            ph_database_get_filename(process->priv->database), FALSE, error);
+    if (process->priv->connection == NULL)
+        return FALSE;
+    ph_database_set_busy_timeout(process->priv->connection,
+            PH_IMPORT_PROCESS_BUSY_TIMEOUT);
+    ph_database_set_compress_texts(process->priv->connection,
+            ph_database_get_compress_texts(process->priv->database));
+
+    /* the whole import is one big transaction on this connection */
+    if (!ph_database_set_profile(process->priv->connection,
+                PH_DATABASE_PROFILE_BULK_IMPORT, error))
+        return FALSE;
+    if (!ph_database_begin(process->priv->connection, error))
         return FALSE;
 
     if (g_file_test(process->priv->path, G_FILE_TEST_IS_DIR)) {
         /* open as a directory */
-        process->priv->dir = g_dir_open(process->priv->path, 0, error);
-        if (process->priv->dir == NULL)
+        dir = g_dir_open(process->priv->path, 0, error);
+        if (dir == NULL)
             return FALSE;
     }
+    process->priv->files = ph_import_process_list_files(process, dir);
+    if (dir != NULL)
+        g_dir_close(dir);
+
+    if (!ph_import_process_skip_applied(process, error))
+        return FALSE;
+
+    /* indexes have to be dropped before the writer prepares statements */
+    if (!ph_import_process_choose_bulk(process, error))
+        return FALSE;
+
+    process->priv->writer = ph_import_writer_new(process->priv->connection,
+            error);
+    if (process->priv->writer == NULL)
+        return FALSE;
+    ph_import_writer_set_log_retention(process->priv->writer,
+            process->priv->retention);
+    if (!ph_import_process_load_known(process, error))
+        return FALSE;
+    process->priv->timer = g_timer_new();
+    if (process->priv->profiling) {
+        process->priv->profile = ph_import_profile_new();
+        ph_import_writer_set_profile(process->priv->writer,
+                process->priv->profile);
+    }
+
+    if (process->priv->threads > 1) {
+        /* parse several files (or chunks of large files) at once and store
+         * them in a single writer thread */
+        process->priv->pool = ph_import_pool_new(process->priv->writer,
+                process->priv->files, process->priv->threads,
+                process->priv->profile, process->priv->known);
+        return TRUE;
+    }
 
     if (ph_import_process_next_file(process, error))
         return TRUE;
@@ -273,545 +454,670 @@ ph_import_process_setup(PHProcess *parent_process,
 
 /* Step {{{1 */
 
+/*
+ * Store the next waypoint in the database.
+ */
 static gboolean
 ph_import_process_step(PHProcess *parent_process,
                        gdouble *fraction,
                        GError **error)
 {
     PHImportProcess *process = PH_IMPORT_PROCESS(parent_process);
-    int rc;
-    const xmlChar *name;
-    gboolean success = TRUE;
+    PHImportRecord *record = NULL;
+    gboolean success;
+
+    if (process->priv->pool != NULL)
+        return ph_import_process_step_parallel(process, fraction, error);
 
-    if (process->priv->xml_reader == NULL) {
+    if (process->priv->parser == NULL) {
         /* finished successfully */
         *fraction = 1.0;
         process->priv->success = TRUE;
         return FALSE;
     }
 
-    rc = xmlTextReaderRead(process->priv->xml_reader);
-    if (rc == 0) {
-        /* end of file */
-        *fraction = 0.0;
-        if (ph_import_process_next_file(process, error))
-            return TRUE;
-        else {
-            ph_import_process_prefix_error(process, error);
-            return FALSE;
-        }
+    success = ph_import_parser_next(process->priv->parser, &record, error);
+    if (success && record == NULL) {
+        /* end of document */
+        *fraction = ph_import_source_get_fraction(process->priv->source,
+                ph_import_parser_get_offset(process->priv->parser));
+        success = ph_import_process_next_document(process, error);
+    }
+    else if (success) {
+        success = ph_import_writer_store_record(process->priv->writer,
+                record, error);
+        *fraction = ph_import_source_get_fraction(process->priv->source,
+                record->offset);
+        ph_import_process_notify_bytes(process, ph_import_source_get_offset(
+                    process->priv->source, record->offset));
+        ph_import_record_free(record);
     }
-    else if (rc == -1) {
-        /* an error has occurred */
-        (void) ph_xml_set_last_error(error);
+
+    if (!success) {
+        if (process->priv->source != NULL)
+            (void) ph_import_source_take_error(process->priv->source, error);
         ph_import_process_prefix_error(process, error);
-        return FALSE;
     }
 
-    name = xmlTextReaderConstLocalName(process->priv->xml_reader);
-    if (xmlStrcmp(name, (xmlChar *) "wpt") == 0)
-        success = ph_import_process_gpx_wpt(process, error);
-    else if (xmlStrcmp(name, (xmlChar *) "author") == 0)
-        success = ph_import_process_gpx_author(process, error);
+    return success;
+}
+
+/*
+ * Forward the events of a parallel import to the main loop, emitting
+ * filename-notify and returning progress in the order the files are stored.
+ */
+static gboolean
+ph_import_process_step_parallel(PHImportProcess *process,
+                                gdouble *fraction,
+                                GError **error)
+{
+    PHImportEvent *event;
+    gboolean still_running = TRUE;
 
-    if (success) {
-        long nread = xmlTextReaderByteConsumed(process->priv->xml_reader);
-        if (process->priv->total != 0)
-            *fraction = ((gdouble) nread) / process->priv->total;
-        else
-            *fraction = 0.0;
+    event = ph_import_pool_pop_event(process->priv->pool,
+            PH_IMPORT_PROCESS_POLL_TIMEOUT);
+
+    if (event == NULL) {
+        /* nothing happened, keep the current progress */
+        *fraction = process->priv->fraction;
+        return TRUE;
     }
-    else
+
+    switch (event->type) {
+    case PH_IMPORT_EVENT_FILENAME:
+        g_free(process->priv->filename);
+        process->priv->filename = g_strdup(event->filename);
+        process->priv->fraction = 0.0;
+        ph_import_process_notify_filename(process);
+        break;
+    case PH_IMPORT_EVENT_PROGRESS:
+        process->priv->fraction = event->fraction;
+        ph_import_process_notify_bytes(process, event->offset);
+        break;
+    case PH_IMPORT_EVENT_ERROR:
+        g_propagate_error(error, event->error);
+        event->error = NULL;
         ph_import_process_prefix_error(process, error);
+        still_running = FALSE;
+        break;
+    case PH_IMPORT_EVENT_DONE:
+        process->priv->fraction = 1.0;
+        process->priv->success = TRUE;
+        still_running = FALSE;
+        break;
+    }
 
-    return success;
+    ph_import_event_free(event);
+    *fraction = process->priv->fraction;
+    return still_running;
 }
 
 /*
  * Open the next (or only) file for reading.  Returns FALSE on error and TRUE in
  * all other cases, including the case where there are no more files; in the
- * latter case, priv->xml_reader will be NULL.
+ * latter case, priv->parser will be NULL.
  */
 static gboolean
 ph_import_process_next_file(PHImportProcess *process,
                             GError **error)
 {
-    /* close the old reader */
-    if (process->priv->xml_reader != NULL) {
-        xmlFreeTextReader(process->priv->xml_reader);
-        process->priv->xml_reader = NULL;
+    /* close the old parser and file */
+    if (process->priv->parser != NULL) {
+        ph_import_parser_free(process->priv->parser);
+        process->priv->parser = NULL;
     }
-
-    process->priv->site = PH_GEOCACHE_SITE_UNKNOWN;
-
-    if (process->priv->dir != NULL) {
-        /* if operating on a directory, get the next file */
-        const gchar *name = g_dir_read_name(process->priv->dir);
-
-        g_free(process->priv->filename);
-        if (name != NULL)
-            process->priv->filename = g_build_filename(process->priv->path,
-                    name, NULL);
-        else
-            process->priv->filename = NULL;
+    if (process->priv->source != NULL) {
+        ph_import_source_free(process->priv->source);
+        process->priv->source = NULL;
     }
-    else if (process->priv->filename == NULL)
-        /* single file, not imported yet */
-        process->priv->filename = g_strdup(process->priv->path);
-    else {
-        /* single file, already processed */
-        g_free(process->priv->filename);
-        process->priv->filename = NULL;
-    }
-
-    if (process->priv->filename != NULL) {
-        struct stat info;
+    if (!ph_import_writer_end_file(process->priv->writer, error))
+        return FALSE;
 
-        g_signal_emit(process, ph_import_process_signals[
-                    PH_IMPORT_PROCESS_SIGNAL_FILENAME_NOTIFY],
-                0, process->priv->filename);
+    g_free(process->priv->filename);
+    process->priv->filename = g_strdup(
+            process->priv->files[process->priv->next_file]);
+    if (process->priv->filename != NULL)
+        ++process->priv->next_file;
 
-        if (stat(process->priv->filename, &info) == 0)
-            process->priv->total = info.st_size;
-        else
-            process->priv->total = 0;
+    if (process->priv->filename != NULL) {
+        ph_import_process_notify_filename(process);
 
-        process->priv->xml_reader = xmlReaderForFile(process->priv->filename,
-                NULL, 0);
-        if (process->priv->xml_reader == NULL)
-            return ph_xml_set_last_error(error);
+        if (!ph_import_writer_begin_file(process->priv->writer,
+                    process->priv->filename, error))
+            return FALSE;
+        process->priv->source = ph_import_source_open(
+                process->priv->filename, error);
+        if (process->priv->source == NULL)
+            return FALSE;
+        return ph_import_process_next_document(process, error);
     }
 
     return TRUE;
 }
 
-/* Cleanup {{{1 */
-
 /*
- * Perform the final steps.  In particular, close open files and commit or
- * rollback the database transaction.
+ * Start parsing the next GPX document of the current file, which may contain
+ * several of them if it is an archive.  Moves on to the next file when there
+ * are no more documents.  Returns FALSE on error.
  */
 static gboolean
-ph_import_process_finish(PHProcess *parent_process,
-                         GError **error)
+ph_import_process_next_document(PHImportProcess *process,
+                                GError **error)
 {
-    PHImportProcess *process = PH_IMPORT_PROCESS(parent_process);
+    xmlTextReaderPtr reader;
+    GError *source_error = NULL;
 
-    if (process->priv->xml_reader != NULL) {
-        xmlFreeTextReader(process->priv->xml_reader);
-        process->priv->xml_reader = NULL;
+    if (process->priv->parser != NULL) {
+        ph_import_parser_free(process->priv->parser);
+        process->priv->parser = NULL;
     }
 
-    if (process->priv->dir != NULL) {
-        g_dir_close(process->priv->dir);
-        process->priv->dir = NULL;
+    reader = ph_import_source_next_reader(process->priv->source,
+            &source_error);
+    if (reader != NULL) {
+        process->priv->parser = ph_import_parser_new(reader);
+        ph_import_parser_set_profile(process->priv->parser,
+                process->priv->profile);
+        ph_import_parser_set_known(process->priv->parser,
+                process->priv->known);
+        return TRUE;
+    }
+    else if (source_error != NULL) {
+        g_propagate_error(error, source_error);
+        return FALSE;
     }
-
-    if (process->priv->success)
-        return ph_database_commit_notify(process->priv->database, error);
     else
-        return ph_database_rollback(process->priv->database, error);
+        return ph_import_process_next_file(process, error);
 }
 
-/* Error reporting {{{1 */
-
 /*
- * If the process is currently dealing with a file, prepend its name to the
- * error message to provide some context to the user.
+ * Get the paths of all files to be imported: either the path itself or, if
+ * it is a directory, the files in dir in the order g_dir_read_name() returns
+ * them.
  */
-static void
-ph_import_process_prefix_error(PHImportProcess *process,
-                               GError **error)
+static gchar **
+ph_import_process_list_files(PHImportProcess *process,
+                             GDir *dir)
 {
-    if (process->priv->filename != NULL)
-        g_prefix_error(error, _("Importing file “%s” failed: "),
-                process->priv->filename);
-}
+    GPtrArray *result = g_ptr_array_new();
+    const gchar *name;
 
-/* Importing GPX {{{1 */
+    if (dir == NULL)
+        g_ptr_array_add(result, g_strdup(process->priv->path));
+    else {
+        while ((name = g_dir_read_name(dir)) != NULL)
+            g_ptr_array_add(result,
+                    g_build_filename(process->priv->path, name, NULL));
+    }
+    g_ptr_array_add(result, NULL);
 
-/* Waypoint {{{2 */
+    return (gchar **) g_ptr_array_free(result, FALSE);
+}
 
 /*
- * Interpret a <wpt> element and store the information in the "waypoints",
- * "geocaches" and "logs" tables of the database.  Returns FALSE on error.
+ * Leave out the files which an earlier import has stored completely before
+ * it failed or was cancelled, according to the import journal, unless they
+ * have changed since.  Returns FALSE on error.
  */
 static gboolean
-ph_import_process_gpx_wpt(PHImportProcess *process,
-                          GError **error)
+ph_import_process_skip_applied(PHImportProcess *process,
+                               GError **error)
 {
-    PHWaypoint wpt = {0};
-    xmlTextReaderPtr reader = process->priv->xml_reader;
+    sqlite3_stmt *stmt;
+    struct stat info;
+    gchar **file, **kept;
     gboolean success = TRUE;
-    int rc = 1, depth;
-    const xmlChar *elname;
-    double coord;
-    const gchar *prefix = ph_geocache_site_prefix(process->priv->site);
-    gboolean logged = FALSE;
-
-    /* we save lat and lon in 1/1000s of minutes */
-    if (!ph_xml_attrib_double(reader, (xmlChar *) "lat", &coord, error))
-        return FALSE;
-    wpt.latitude = (gint) round(60000 * coord);
-    if (!ph_xml_attrib_double(reader, (xmlChar *) "lon", &coord, error))
+    gint status = SQLITE_DONE;
+
+    stmt = ph_database_prepare(process->priv->connection,
+            "SELECT 1 FROM import_journal "
+            "WHERE filename = ? AND size = ? AND mtime = ?", error);
+    if (stmt == NULL)
         return FALSE;
-    wpt.longitude = (gint) round(60000 * coord);
-
-    depth = xmlTextReaderDepth(reader);
-    do {
-        rc = xmlTextReaderRead(reader);
-        if (rc != 1)
-            break;
-        else if (xmlTextReaderNodeType(reader) != 1)
-            continue;       /* only consider element nodes */
-        elname = xmlTextReaderConstLocalName(reader);
-
-        if (xmlStrcmp(elname, (xmlChar *) "name") == 0) {
-            xmlChar *tmp = NULL;
-            success = ph_xml_extract_text(reader, &tmp, error);
-            if (!success)
-                ;
-            else if (xmlStrncmp(tmp, (xmlChar *) prefix,
-                        PH_GEOCACHE_SITE_PREFIX_LENGTH) != 0) {
-                /* not a geocache (extra waypoint) */
-                wpt.id = g_strdup_printf("%s,%s", prefix, tmp);
-                wpt.geocache_id = g_strdup_printf("%s%s", prefix, tmp + 2);
-            }
-            else {
-                /* waypoint representing an actual geocache */
-                wpt.id = g_strdup((gchar *) tmp);
-                wpt.geocache_id = NULL;
-            }
-            xmlFree(tmp);
-        }
-        else if (xmlStrcmp(elname, (xmlChar *) "time") == 0)
-            success = ph_xml_extract_time(reader, &wpt.placed, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "url") == 0)
-            success = ph_xml_extract_text(reader, (xmlChar **) &wpt.url,
-                    error);
-        else if (xmlStrcmp(elname, (xmlChar *) "urlname") == 0)
-            success = ph_xml_extract_text(reader, (xmlChar **) &wpt.name,
+
+    kept = process->priv->files;
+    for (file = process->priv->files; *file != NULL; ++file) {
+        if (success && stat(*file, &info) == 0 && S_ISREG(info.st_mode)) {
+            (void) sqlite3_bind_text(stmt, 1, *file, -1, SQLITE_STATIC);
+            (void) sqlite3_bind_int64(stmt, 2, info.st_size);
+            (void) sqlite3_bind_int64(stmt, 3, info.st_mtime);
+            status = ph_database_step(process->priv->connection, stmt,
                     error);
-        else if (xmlStrcmp(elname, (xmlChar *) "sym") == 0) {
-            xmlChar *tmp = NULL;
-            success = ph_xml_extract_text(reader, &tmp, error);
-            if (success) {
-                wpt.type = ph_xml_find_string(ph_gpx_waypoint_types, tmp);
-                if (wpt.type == PH_WAYPOINT_TYPE_GEOCACHE)
-                    /* this will be used to process <cache> */
-                    logged = (xmlStrcasestr(tmp, (xmlChar *) "found") != NULL);
-            }
-            xmlFree(tmp);
+            success = (status == SQLITE_ROW || status == SQLITE_DONE);
+            (void) sqlite3_reset(stmt);
         }
-        else if (xmlStrcmp(elname, (xmlChar *) "desc") == 0)
-            success = ph_xml_extract_text(reader, (xmlChar **) &wpt.summary,
-                    error);
-        else if (xmlStrcmp(elname, (xmlChar *) "cmt") == 0)
-            success = ph_xml_extract_text(reader,
-                    (xmlChar **) &wpt.description, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "cache") == 0)
-            success = ph_import_process_gpx_cache(process, &wpt, logged, error);
-    } while (success && xmlTextReaderDepth(reader) > depth);
-
-    if (rc == -1)
-        success = ph_xml_set_last_error(error);
-
-    if (success)
-        success = ph_waypoint_store(&wpt, process->priv->database, error);
 
-    g_free(wpt.id);
-    g_free(wpt.geocache_id);
-    xmlFree(wpt.name);
-    xmlFree(wpt.url);
-    xmlFree(wpt.summary);
-    xmlFree(wpt.description);
+        if (success && status == SQLITE_ROW) {
+            g_message("Skipping %s, which has been imported before", *file);
+            g_free(*file);
+            status = SQLITE_DONE;
+        }
+        else
+            *kept++ = *file;
+    }
+    *kept = NULL;
+    (void) sqlite3_finalize(stmt);
 
     return success;
 }
 
-/* Geocache {{{2 */
-
 /*
- * Import a <groundspeak:cache> element into the "geocaches" database.
- * Returns FALSE on error.
+ * Drop the secondary indexes and the triggers maintaining the spatial and
+ * full-text indexes for the duration of the import if it is going to add at
+ * least as many waypoints as the database already contains, so that they
+ * are built in one go at the end instead of row by row.  The
+ * number of incoming waypoints is estimated from the uncompressed size of
+ * the files.  Returns FALSE on error.
  */
 static gboolean
-ph_import_process_gpx_cache(PHImportProcess *process,
-                            const PHWaypoint *wpt,
-                            gboolean logged,
-                            GError **error)
+ph_import_process_choose_bulk(PHImportProcess *process,
+                              GError **error)
 {
-    PHGeocache gc = {0};
-    xmlTextReaderPtr reader = process->priv->xml_reader;
-    gboolean success = TRUE;
-    const xmlChar *elname;
-    int rc, depth;
-
-    gc.id = wpt->id;
-    gc.logged = logged;
-
-    gc.available = ph_xml_attrib_compare(reader, (xmlChar *) "available",
-            (xmlChar *) "true");
-    gc.archived = ph_xml_attrib_compare(reader, (xmlChar *) "archived",
-            (xmlChar *) "true");
-
-    depth = xmlTextReaderDepth(reader);
-    do {
-        rc = xmlTextReaderRead(reader);
-        if (rc != 1)
-            break;
-        else if (xmlTextReaderNodeType(reader) != 1)
-            continue;       /* only consider element nodes */
-        elname = xmlTextReaderConstLocalName(reader);
-
-        if (xmlStrcmp(elname, (xmlChar *) "name") == 0)
-            success = ph_xml_extract_text(reader,
-                    (xmlChar **) &gc.name, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "placed_by") == 0)
-            success = ph_xml_extract_text(reader,
-                    (xmlChar **) &gc.creator, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "owner") == 0)
-            success = ph_xml_extract_text(reader,
-                    (xmlChar **) &gc.owner, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "type") == 0)
-            success = ph_xml_extract_value(reader, ph_gpx_geocache_types,
-                    (gint *) &gc.type, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "container") == 0)
-            success = ph_xml_extract_value(reader, ph_gpx_geocache_sizes,
-                    (gint *) &gc.size, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "difficulty") == 0) {
-            double tmp;
-            success = ph_xml_extract_double(reader, &tmp, error);
-            if (success)
-                gc.difficulty = (guint8) round(tmp * 10);
-        }
-        else if (xmlStrcmp(elname, (xmlChar *) "terrain") == 0) {
-            double tmp;
-            success = ph_xml_extract_double(reader, &tmp, error);
-            if (success)
-                gc.terrain = (guint8) round(tmp * 10);
-        }
-        else if (xmlStrcmp(elname, (xmlChar *) "short_description") == 0) {
-            gc.summary_html = ph_xml_attrib_compare(reader,
-                    (xmlChar *) "html", (xmlChar *) "true");
-            success = ph_xml_extract_text(reader,
-                    (xmlChar **) &gc.summary, error);
+    PHImportSource *source;
+    goffset content = 0;
+    gint64 incoming, existing;
+    gchar **file;
+
+    for (file = process->priv->files; *file != NULL; ++file) {
+        /* pipes can only be read once, and their size is unknown */
+        if (ph_import_source_is_stream(*file))
+            continue;
+
+        /* problems are reported when the file is actually imported */
+        source = ph_import_source_open(*file, NULL);
+        if (source != NULL) {
+            content += ph_import_source_get_content_size(source);
+            ph_import_source_free(source);
         }
-        else if (xmlStrcmp(elname, (xmlChar *) "long_description") == 0) {
-            gc.description_html = ph_xml_attrib_compare(reader,
-                    (xmlChar *) "html", (xmlChar *) "true");
-            success = ph_xml_extract_text(reader,
-                    (xmlChar **) &gc.description, error);
-        }
-        else if (xmlStrcmp(elname, (xmlChar *) "encoded_hints") == 0)
-            success = ph_xml_extract_text(reader, (xmlChar **) &gc.hint,
-                    error);
-        else if (xmlStrcmp(elname, (xmlChar *) "logs") == 0)
-            success = ph_import_process_gpx_logs(process, &gc, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "attribute") == 0) {
-            gint id, value;
-            success = ph_xml_attrib_int(reader, (xmlChar *) "id", &id, error) &&
-                ph_xml_attrib_int(reader, (xmlChar *) "inc", &value, error);
-            if (success)
-                gc.attributes = ph_geocache_attrs_prepend(gc.attributes,
-                        id, value != 0);
-        }
-        else if (xmlStrcmp(elname, (xmlChar *) "travelbugs") == 0)
-            success = ph_import_process_gpx_travelbugs(process, &gc, error);
-    } while (success && xmlTextReaderDepth(reader) > depth);
+    }
 
-    if (rc == -1)
-        success = ph_xml_set_last_error(error);
+    incoming = content / PH_IMPORT_PROCESS_WAYPOINT_SIZE;
+    if (incoming < PH_IMPORT_PROCESS_BULK_MINIMUM)
+        return TRUE;
 
-    if (success)
-        success = ph_geocache_store(&gc, process->priv->database, error);
+    existing = ph_database_count_rows(process->priv->connection,
+            PH_DATABASE_TABLE_WAYPOINTS, error);
+    if (existing < 0)
+        return FALSE;
+    else if (incoming < existing)
+        return TRUE;
 
-    ph_geocache_attrs_free(gc.attributes);
-    xmlFree(gc.name);
-    xmlFree(gc.creator);
-    xmlFree(gc.owner);
-    xmlFree(gc.summary);
-    xmlFree(gc.description);
-    xmlFree(gc.hint);
+    g_message("Expecting about %" G_GINT64_FORMAT " waypoints in addition "
+            "to %" G_GINT64_FORMAT ", dropping indexes until the import is "
+            "done", incoming, existing);
+    process->priv->bulk = TRUE;
+    return ph_database_drop_indexes(process->priv->connection, error) &&
+        ph_database_drop_triggers(process->priv->connection, error);
+}
 
-    return success;
+/*
+ * Load the keys of the logs already in the database, so that the parsers can
+ * skip them.  Importing the same pocket query again mostly repeats logs
+ * which have been seen before.  Returns FALSE on error.
+ */
+static gboolean
+ph_import_process_load_known(PHImportProcess *process,
+                             GError **error)
+{
+    PHImportKnown *known;
+
+    known = ph_import_known_load(process->priv->connection, error);
+    if (known == NULL)
+        return FALSE;
+
+    if (ph_import_known_get_count(known) == 0) {
+        /* nothing to look up */
+        ph_import_known_free(known);
+        return TRUE;
+    }
+
+    g_message("Loaded the keys of %u stored logs in %" G_GSIZE_FORMAT " KiB, "
+            "false positive rate %.1e",
+            ph_import_known_get_count(known),
+            ph_import_known_get_size(known) / 1024,
+            ph_import_known_get_error_rate(known));
+    process->priv->known = known;
+    return TRUE;
 }
 
-/* Logs {{{2 */
+/* Cleanup {{{1 */
 
 /*
- * Scan all <log> elements inside a <logs>...</logs> section of a geocache
- * listing and store them in the database.  Returns FALSE on error.
+ * Perform the final steps.  In particular, close open files and commit or
+ * rollback the database transaction.  If the import has failed or has been
+ * cancelled, the files stored completely are committed nonetheless, so that
+ * importing the same path again resumes after them.  Changed geocaches are
+ * announced in the main thread once the changes are visible to other
+ * connections.
  */
 static gboolean
-ph_import_process_gpx_logs(PHImportProcess *process,
-                           const PHGeocache *gc,
-                           GError **error)
+ph_import_process_finish(PHProcess *parent_process,
+                         GError **error)
 {
-    PHLog log = {0};
-    xmlTextReaderPtr reader = process->priv->xml_reader;
-    gboolean success = TRUE;
-    int rc, depth;
-    const xmlChar *elname;
-    gboolean in_log = FALSE;
+    PHImportProcess *process = PH_IMPORT_PROCESS(parent_process);
+    GHashTable *changed = NULL;
+    GError *cleanup_error = NULL;
+    gboolean keep, success;
+
+    if (process->priv->parser != NULL) {
+        ph_import_parser_free(process->priv->parser);
+        process->priv->parser = NULL;
+    }
+    if (process->priv->source != NULL) {
+        ph_import_source_free(process->priv->source);
+        process->priv->source = NULL;
+    }
 
-    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+    if (process->priv->pool != NULL) {
+        /* waits for the threads to exit */
+        ph_import_pool_free(process->priv->pool);
+        process->priv->pool = NULL;
+    }
+    ph_import_known_free(process->priv->known);
+    process->priv->known = NULL;
 
-    if (xmlTextReaderIsEmptyElement(reader))
+    if (process->priv->connection == NULL)
+        /* setup failed before anything was started */
         return TRUE;
-    depth = xmlTextReaderDepth(reader);
-    do {
-        rc = xmlTextReaderRead(reader);
-        if (rc != 1)
-            break;
-        elname = xmlTextReaderConstLocalName(reader);
-
-        if (in_log && xmlTextReaderNodeType(reader) == 15 &&
-                xmlStrcmp(elname, (xmlChar *) "log") == 0) {
-            /* </log>: store log in database */
-            log.geocache_id = gc->id;
-            success = ph_log_store(&log, process->priv->database, error);
-            /* prepare for the next log */
-            xmlFree(log.logger); log.logger = NULL;
-            xmlFree(log.details); log.details = NULL;
-            in_log = FALSE;
-        }
-        else if (xmlTextReaderNodeType(reader) != 1)
-            continue;       /* ignore all other non-element nodes */
-        else if (!in_log && xmlStrcmp(elname, (xmlChar *) "log") == 0) {
-            /* <log>: reset everything for the next log */
-            memset(&log, 0, sizeof(log));
-            in_log = TRUE;
-            success = ph_xml_attrib_int(reader, (xmlChar *) "id",
-                    &log.id, error);
+
+    /* commit what has been stored? */
+    keep = process->priv->success;
+    if (!keep && process->priv->writer != NULL &&
+            ph_import_writer_get_files(process->priv->writer) > 0)
+        keep = ph_import_writer_abort_file(process->priv->writer, NULL);
+
+    if (keep && process->priv->success &&
+            !ph_import_process_apply_retention(process, &cleanup_error))
+        keep = process->priv->success = FALSE;
+    if (keep && process->priv->bulk &&
+            !ph_import_process_rebuild_indexes(process, &cleanup_error))
+        /* rolling back restores the old indexes */
+        keep = process->priv->success = FALSE;
+    if (keep && process->priv->success &&
+            !ph_database_exec(process->priv->connection,
+                "DELETE FROM import_journal", &cleanup_error))
+        keep = process->priv->success = FALSE;
+
+    if (process->priv->writer != NULL) {
+        if (keep && !process->priv->success)
+            g_message("Keeping %u files imported completely, importing "
+                    "again resumes after them",
+                    ph_import_writer_get_files(process->priv->writer));
+        if (keep)
+            changed = g_hash_table_ref(
+                    ph_import_writer_get_changed(process->priv->writer));
+
+        if (process->priv->success) {
+            guint rows = ph_import_writer_get_rows(process->priv->writer);
+            gdouble elapsed = g_timer_elapsed(process->priv->timer, NULL);
+
+            g_message("Imported %u rows in %.2f s (%.0f rows/s)",
+                    rows, elapsed, (elapsed > 0) ? rows / elapsed : 0.0);
+            g_message("%u rows inserted, %u updated, %u unchanged, "
+                    "%u expired logs left out",
+                    ph_import_writer_get_inserted(process->priv->writer),
+                    ph_import_writer_get_updated(process->priv->writer),
+                    ph_import_writer_get_unchanged(process->priv->writer),
+                    ph_import_writer_get_expired(process->priv->writer));
+            g_message("%u geocaches changed, %u unchanged records skipped",
+                    g_hash_table_size(changed),
+                    ph_import_writer_get_skipped(process->priv->writer));
+            g_message("%u allocations from record arenas, "
+                    "largest arena %" G_GSIZE_FORMAT " bytes",
+                    ph_import_writer_get_arena_allocations(
+                        process->priv->writer),
+                    ph_import_writer_get_arena_peak(process->priv->writer));
+            if (process->priv->profile != NULL)
+                ph_import_profile_log(process->priv->profile);
         }
-        else if (!in_log)
-            continue;       /* ignore stuff outside <log>...</log> */
-        else if (xmlStrcmp(elname, (xmlChar *) "date") == 0)
-            success = ph_xml_extract_time(reader, &log.logged, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "type") == 0)
-            success = ph_xml_extract_value(reader, ph_gpx_log_types,
-                    (gint *) &log.type, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "finder") == 0)
-            success = ph_xml_extract_text(reader,
-                    (xmlChar **) &log.logger, error);
-        else if (xmlStrcmp(elname, (xmlChar *) "text") == 0)
-            success = ph_xml_extract_text(reader,
-                    (xmlChar **) &log.details, error);
-    } while (success && xmlTextReaderDepth(reader) > depth);
-
-    if (rc == -1)
-        success = ph_xml_set_last_error(error);
-
-    if (in_log) {
-        xmlFree(log.logger);
-        xmlFree(log.details);
+
+        ph_import_writer_free(process->priv->writer);
+        process->priv->writer = NULL;
+    }
+
+    if (cleanup_error != NULL) {
+        (void) ph_database_rollback(process->priv->connection, NULL);
+        g_propagate_error(error, cleanup_error);
+        success = FALSE;
+    }
+    else if (!keep)
+        success = ph_database_rollback(process->priv->connection, error);
+    else
+        success = ph_database_commit(process->priv->connection, error);
+
+    if (success && changed != NULL) {
+        process->priv->changed = changed;
+        g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+                ph_import_process_announce, g_object_ref(process),
+                g_object_unref);
     }
+    else if (changed != NULL)
+        g_hash_table_unref(changed);
+
+    /* checkpoint and close the connection in the thread which has used it */
+    (void) ph_database_set_profile(process->priv->connection,
+            PH_DATABASE_PROFILE_INTERACTIVE, NULL);
+    g_object_unref(process->priv->connection);
+    process->priv->connection = NULL;
 
     return success;
 }
 
-/* Travelbugs {{{2 */
-
 /*
- * First remove all trackables associated with the given geocache; then read
- * and store the content of a <travelbugs> element to determine the current
- * status.
+ * Build the indexes and triggers dropped by ph_import_process_choose_bulk()
+ * again.  Returns FALSE on error.
  */
 static gboolean
-ph_import_process_gpx_travelbugs(PHImportProcess *process,
-                                 const PHGeocache *gc,
-                                 GError **error)
+ph_import_process_rebuild_indexes(PHImportProcess *process,
+                                  GError **error)
 {
-    PHTrackable trackable = {0};
-    xmlTextReaderPtr reader = process->priv->xml_reader;
+    GTimer *timer = g_timer_new();
     gboolean success;
-    int depth, rc;
-    const xmlChar *elname;
-    gboolean in_travelbug = FALSE;
-    char *query;
-
-    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-
-    /* remove current trackables */
-    query = sqlite3_mprintf("DELETE FROM trackables WHERE geocache_id = %Q",
-            gc->id);
-    success = ph_database_exec(process->priv->database, query, error);
-    sqlite3_free(query);
-    if (!success)
-        return FALSE;
 
-    trackable.geocache_id = gc->id;
+    success = ph_database_create_indexes(process->priv->connection, error) &&
+        ph_database_create_triggers(process->priv->connection, error);
+    if (success)
+        g_message("Rebuilt indexes in %.2f s", g_timer_elapsed(timer, NULL));
+
+    g_timer_destroy(timer);
+    return success;
+}
+
+/*
+ * Remove the logs the retention rules do not keep, within the import
+ * transaction, and report the number of removed logs together with the space
+ * they have freed.  The geocaches which have lost logs are announced along
+ * with the changed ones.  Returns FALSE on error.
+ */
+static gboolean
+ph_import_process_apply_retention(PHImportProcess *process,
+                                  GError **error)
+{
+    gint64 before, after;
+    gint deleted;
 
-    /* get list of new trackables */
-    if (xmlTextReaderIsEmptyElement(reader))
+    if (process->priv->retention == NULL)
         return TRUE;
-    depth = xmlTextReaderDepth(reader);
-    do {
-        rc = xmlTextReaderRead(reader);
-        if (rc != 1)
-            break;
-        elname = xmlTextReaderConstLocalName(reader);
-
-        if (xmlStrcmp(elname, (xmlChar *) "travelbug") == 0) {
-            if (!in_travelbug && xmlTextReaderNodeType(reader) == 1) {
-                /* <travelbug>: prepare for next trackable */
-                trackable.name = trackable.id = NULL;
-                success = ph_xml_attrib_text(reader, (xmlChar *) "ref",
-                        (xmlChar **) &trackable.id, error);
-                if (success)
-                    in_travelbug = TRUE;
-            }
-            else if (in_travelbug && xmlTextReaderNodeType(reader) == 15) {
-                /* </travelbug>: store in DB */
-                success = ph_trackable_store(&trackable,
-                        process->priv->database, error);
-                xmlFree(trackable.id); trackable.id = NULL;
-                xmlFree(trackable.name); trackable.name = NULL;
-                in_travelbug = FALSE;
-            }
-        }
-        else if (xmlTextReaderNodeType(reader) != 1)
-            continue;       /* other than that, consider element nodes */
-        else if (in_travelbug && xmlStrcmp(elname, (xmlChar *) "name") == 0)
-            success = ph_xml_extract_text(reader, (xmlChar **) &trackable.name,
-                    error);
-    } while (success && xmlTextReaderDepth(reader) > depth);
 
-    if (rc == -1)
-        success = ph_xml_set_last_error(error);
+    before = ph_database_get_free_space(process->priv->connection, error);
+    if (before < 0)
+        return FALSE;
 
-    if (in_travelbug) {
-        xmlFree(trackable.id);
-        xmlFree(trackable.name);
-    }
+    deleted = ph_logs_apply_retention(process->priv->connection,
+            process->priv->retention, (process->priv->writer != NULL) ?
+            ph_import_writer_get_changed(process->priv->writer) : NULL,
+            error);
+    if (deleted < 0)
+        return FALSE;
+
+    after = ph_database_get_free_space(process->priv->connection, error);
+    if (after < 0)
+        return FALSE;
 
+    g_message("Removed %d old logs, reclaiming %" G_GINT64_FORMAT " KiB",
+            deleted, MAX(after - before, 0) / 1024);
     return TRUE;
 }
 
-/* Author {{{2 */
-
 /*
- * Interpret the geocache listing site information from an <author> element.
- * This is needed to determine the ID of the geocache each extra waypoint
- * belongs to.
+ * Tell listeners about the geocaches which have actually been changed by the
+ * import, in the main thread.  If there are many of them, a single
+ * "bulk-updated" signal is cheaper than reloading each of them on its own.
  */
 static gboolean
-ph_import_process_gpx_author(PHImportProcess *process,
-                             GError **error)
+ph_import_process_announce(gpointer data)
 {
-    xmlTextReaderPtr reader = process->priv->xml_reader;
-    gint value;
+    PHImportProcess *process = PH_IMPORT_PROCESS(data);
+    GHashTable *changed = process->priv->changed;
+    GHashTableIter iter;
+    gpointer id;
 
-    if (ph_xml_extract_value(reader, ph_gpx_geocache_sites, &value, error)) {
-        process->priv->site = (PHGeocacheSite) value;
-        return TRUE;
+    process->priv->changed = NULL;
+
+    if (g_hash_table_size(changed) > PH_IMPORT_PROCESS_ANNOUNCE_LIMIT)
+        ph_database_notify_bulk_update(process->priv->database);
+    else {
+        g_hash_table_iter_init(&iter, changed);
+        while (g_hash_table_iter_next(&iter, &id, NULL)) {
+            g_debug("Geocache %s has changed", (const gchar *) id);
+            ph_database_notify_geocache_update(process->priv->database,
+                    (const gchar *) id);
+        }
     }
-    else
-        return FALSE;
+
+    g_hash_table_unref(changed);
+    return FALSE;
 }
 
-/* }}} */
+/*
+ * The import has stopped and released the write lock, after announcing its
+ * changes.  Let writes which failed in the meantime be tried again.
+ */
+static void
+ph_import_process_stop_notify(PHProcess *parent_process)
+{
+    PHImportProcess *process = PH_IMPORT_PROCESS(parent_process);
+
+    if (process->priv->database != NULL)
+        ph_database_notify_import_stop(process->priv->database);
+}
+
+/* Notification {{{1 */
+
+/*
+ * Emit filename-notify for the current file in the main thread.  Also find
+ * out whether its progress is measured in bytes instead of a fraction.
+ */
+static void
+ph_import_process_notify_filename(PHImportProcess *process)
+{
+    PHImportProcessFilename *notification =
+        g_new(PHImportProcessFilename, 1);
+
+    process->priv->streaming =
+        ph_import_source_is_stream(process->priv->filename);
+    process->priv->bytes = 0;
+
+    /* progress within the previous file goes out before the new name */
+    ph_process_flush_progress(PH_PROCESS(process));
+
+    notification->process = g_object_ref(process);
+    notification->filename = g_strdup(process->priv->filename);
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+            ph_import_process_emit_filename, notification,
+            ph_import_process_filename_free);
+}
+
+/*
+ * Emit filename-notify.  Called in the main thread.
+ */
+static gboolean
+ph_import_process_emit_filename(gpointer data)
+{
+    PHImportProcessFilename *notification = (PHImportProcessFilename *) data;
+
+    g_signal_emit(notification->process, ph_import_process_signals[
+                PH_IMPORT_PROCESS_SIGNAL_FILENAME_NOTIFY],
+            0, notification->filename);
+    return FALSE;
+}
+
+/*
+ * Free a filename notification after it has been emitted.
+ */
+static void
+ph_import_process_filename_free(gpointer data)
+{
+    PHImportProcessFilename *notification = (PHImportProcessFilename *) data;
+
+    g_object_unref(notification->process);
+    g_free(notification->filename);
+    g_free(notification);
+}
+
+/*
+ * Emit bytes-notify in the main thread if the current file is a pipe and
+ * enough has been read from it since the last time.
+ */
+static void
+ph_import_process_notify_bytes(PHImportProcess *process,
+                               goffset offset)
+{
+    PHImportProcessBytes *notification;
+
+    if (!process->priv->streaming ||
+            offset - process->priv->bytes < PH_IMPORT_PROCESS_BYTES_STEP)
+        return;
+    process->priv->bytes = offset;
+
+    notification = g_new(PHImportProcessBytes, 1);
+    notification->process = g_object_ref(process);
+    notification->bytes = offset;
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+            ph_import_process_emit_bytes, notification,
+            ph_import_process_bytes_free);
+}
+
+/*
+ * Emit bytes-notify.  Called in the main thread.
+ */
+static gboolean
+ph_import_process_emit_bytes(gpointer data)
+{
+    PHImportProcessBytes *notification = (PHImportProcessBytes *) data;
+
+    g_signal_emit(notification->process, ph_import_process_signals[
+                PH_IMPORT_PROCESS_SIGNAL_BYTES_NOTIFY],
+            0, notification->bytes);
+    return FALSE;
+}
+
+/*
+ * Free a bytes notification after it has been emitted.
+ */
+static void
+ph_import_process_bytes_free(gpointer data)
+{
+    PHImportProcessBytes *notification = (PHImportProcessBytes *) data;
+
+    g_object_unref(notification->process);
+    g_free(notification);
+}
+
+/* Error reporting {{{1 */
+
+/*
+ * If the process is currently dealing with a file, prepend its name to the
+ * error message to provide some context to the user.
+ */
+static void
+ph_import_process_prefix_error(PHImportProcess *process,
+                               GError **error)
+{
+    if (process->priv->filename != NULL)
+        g_prefix_error(error, _("Importing file “%s” failed: "),
+                process->priv->filename);
+}
 
 /* Public interface {{{1 */
 
@@ -832,6 +1138,34 @@ ph_import_process_new(PHDatabase *database,
                 NULL));
 }
 
+/*
+ * Get the timings collected by a process created with the "profile" property
+ * set, or NULL.  They are complete once the process has stopped.
+ */
+PHImportProfile *
+ph_import_process_get_profile(PHImportProcess *process)
+{
+    g_return_val_if_fail(process != NULL && PH_IS_IMPORT_PROCESS(process),
+            NULL);
+
+    return process->priv->profile;
+}
+
+/*
+ * Remove logs according to the given rules after the import has succeeded,
+ * or keep all of them if retention is NULL.  The process takes ownership of
+ * the rules.
+ */
+void
+ph_import_process_set_log_retention(PHImportProcess *process,
+                                    PHLogRetention *retention)
+{
+    g_return_if_fail(process != NULL && PH_IS_IMPORT_PROCESS(process));
+
+    ph_log_retention_free(process->priv->retention);
+    process->priv->retention = retention;
+}
+
 /* }}} */
 
 /* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
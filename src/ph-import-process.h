@@ -14,6 +14,8 @@
 /* Includes {{{1 */
 
 #include "ph-database.h"
+#include "ph-import-parser.h"
+#include "ph-log.h"
 #include "ph-process.h"
 
 /* GObject boilerplate {{{1 */
@@ -48,12 +50,16 @@ struct _PHImportProcessClass {
 
     /* signals */
     void (*filename_notify)(PHImportProcess *process, gchar *filename);
+    void (*bytes_notify)(PHImportProcess *process, guint64 bytes);
 };
 
 /* Public interface {{{1 */
 
 PHProcess *ph_import_process_new(PHDatabase *database,
                                  const gchar *path);
+PHImportProfile *ph_import_process_get_profile(PHImportProcess *process);
+void ph_import_process_set_log_retention(PHImportProcess *process,
+                                         PHLogRetention *retention);
 
 /* }}} */
 
@@ -0,0 +1,910 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/* Includes {{{1 */
+
+#include "ph-import-source.h"
+#include "ph-xml.h"
+#include <errno.h>
+#include <glib/gi18n.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#ifdef G_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+/* Constants {{{1 */
+
+/*
+ * Number of compressed bytes handed to the decompressor at once.
+ */
+#define PH_IMPORT_SOURCE_BUFFER_SIZE 65536
+
+/*
+ * Size of the "end of central directory" record of a ZIP file, and the
+ * maximum distance of its start from the end of the file (due to the
+ * trailing archive comment).
+ */
+#define PH_IMPORT_SOURCE_ZIP_END_SIZE 22
+#define PH_IMPORT_SOURCE_ZIP_END_SEARCH (PH_IMPORT_SOURCE_ZIP_END_SIZE + 65535)
+
+/*
+ * Fixed sizes of the ZIP central directory entry and local file header.
+ */
+#define PH_IMPORT_SOURCE_ZIP_ENTRY_SIZE 46
+#define PH_IMPORT_SOURCE_ZIP_LOCAL_SIZE 30
+
+/* Data structures {{{1 */
+
+/*
+ * Container formats.
+ */
+typedef enum _PHImportSourceKind {
+    PH_IMPORT_SOURCE_PLAIN,     /* uncompressed GPX */
+    PH_IMPORT_SOURCE_GZIP,      /* gzip-compressed GPX */
+    PH_IMPORT_SOURCE_ZIP        /* ZIP archive containing GPX files */
+} PHImportSourceKind;
+
+/*
+ * GPX file stored in a ZIP archive.
+ */
+typedef struct _PHImportSourceEntry {
+    goffset offset;             /* position of the local file header */
+    goffset size;               /* compressed size */
+    goffset length;             /* uncompressed size */
+    gboolean deflated;          /* compressed with deflate (or stored)? */
+} PHImportSourceEntry;
+
+struct _PHImportSource {
+    gchar *filename;            /* path of the file */
+    GMappedFile *mapping;       /* mapping of the entire file, or NULL */
+    const guchar *data;         /* contents of the mapping */
+    FILE *file;                 /* open file if it could not be mapped */
+    gboolean streaming;         /* is the file a pipe, which cannot seek? */
+    guchar lookahead[4];        /* stream: bytes read to detect the format */
+    gsize lookahead_length;     /* stream: number of bytes in lookahead */
+    gsize lookahead_used;       /* stream: number of bytes passed on */
+    goffset total;              /* size of the file in bytes, 0 for streams */
+    goffset position;           /* number of bytes read from the file */
+    goffset content;            /* uncompressed size of all documents */
+    PHImportSourceKind kind;    /* container format */
+
+    GArray *entries;            /* ZIP: list of PHImportSourceEntry */
+    guint next_entry;           /* ZIP: index of the next entry to read */
+    gboolean started;           /* plain, gzip: has the document been read? */
+
+    goffset start;              /* where the current document begins */
+    gboolean deflated;          /* is the current document compressed? */
+    goffset remaining;          /* bytes left in the current document */
+    gboolean finished;          /* has the current document ended? */
+    GError *error;              /* reason why reading the document failed */
+    gboolean stream_ready;      /* has the z_stream been initialized? */
+    z_stream stream;            /* decompressor state */
+    guchar buffer[PH_IMPORT_SOURCE_BUFFER_SIZE];    /* unmapped files only */
+};
+
+/* Forward declarations {{{1 */
+
+static PHImportSourceKind ph_import_source_detect(const guchar *data,
+                                                  gsize length);
+static void ph_import_source_advise(GMappedFile *mapping);
+static gsize ph_import_source_fread(PHImportSource *source, guchar *buffer,
+                                    gsize count);
+static void ph_import_source_close_file(PHImportSource *source);
+static goffset ph_import_source_gzip_size(PHImportSource *source);
+static gboolean ph_import_source_read_zip(PHImportSource *source,
+                                          GError **error);
+static const guchar *ph_import_source_peek(PHImportSource *source,
+                                           goffset offset,
+                                           gsize length,
+                                           guchar **copy,
+                                           GError **error);
+static gboolean ph_import_source_seek(PHImportSource *source,
+                                      goffset offset,
+                                      GError **error);
+static gboolean ph_import_source_begin(PHImportSource *source,
+                                       gboolean deflated,
+                                       gint window_bits,
+                                       goffset length,
+                                       GError **error);
+static gboolean ph_import_source_fill(PHImportSource *source);
+static int ph_import_source_read(void *context, char *buffer, int length);
+static int ph_import_source_close(void *context);
+static gboolean ph_import_source_set_io_error(PHImportSource *source,
+                                              GError **error);
+static gboolean ph_import_source_set_eof_error(PHImportSource *source,
+                                               GError **error);
+
+/* Utility functions {{{1 */
+
+/*
+ * Decode little-endian integers as used in ZIP headers.
+ */
+static guint
+ph_import_source_le16(const guchar *data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+static guint32
+ph_import_source_le32(const guchar *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) |
+        ((guint32) data[3] << 24);
+}
+
+/*
+ * Determine the container format from the first bytes of a file.
+ */
+static PHImportSourceKind
+ph_import_source_detect(const guchar *data,
+                        gsize length)
+{
+    if (length >= 2 && data[0] == 0x1f && data[1] == 0x8b)
+        return PH_IMPORT_SOURCE_GZIP;
+    else if (length >= 4 && memcmp(data, "PK\3\4", 4) == 0)
+        return PH_IMPORT_SOURCE_ZIP;
+    else
+        return PH_IMPORT_SOURCE_PLAIN;
+}
+
+/*
+ * Check if the given data is the beginning of a compressed file.
+ */
+gboolean
+ph_import_source_is_compressed(const gchar *data,
+                               gsize length)
+{
+    return ph_import_source_detect((const guchar *) data, length) !=
+        PH_IMPORT_SOURCE_PLAIN;
+}
+
+/* Opening files {{{1 */
+
+/*
+ * Open a GPX, .gpx.gz or .zip file, or standard input for
+ * PH_IMPORT_SOURCE_STDIN.  The format is determined from the content, not
+ * the file name.  The file is mapped into memory if possible, so that the
+ * XML parser and the decompressor can read it without copying it first;
+ * otherwise, it is read with stdio.  Pipes are read from start to end
+ * without knowing their size, which rules out ZIP archives.  Returns NULL
+ * on error.
+ */
+PHImportSource *
+ph_import_source_open(const gchar *filename,
+                      GError **error)
+{
+    PHImportSource *result;
+    guchar magic[4];
+    gsize length;
+
+    g_return_val_if_fail(filename != NULL, NULL);
+    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+    result = g_new0(PHImportSource, 1);
+    result->filename = g_strdup(filename);
+    if (strcmp(filename, PH_IMPORT_SOURCE_STDIN) == 0)
+        result->file = stdin;
+    else
+        result->file = fopen(filename, "rb");
+    if (result->file == NULL) {
+        (void) ph_import_source_set_io_error(result, error);
+        ph_import_source_free(result);
+        return NULL;
+    }
+
+    /* empty files and files which cannot be mapped are read as before */
+    result->streaming = ph_import_source_is_stream(filename);
+    if (!result->streaming)
+        result->mapping = g_mapped_file_new_from_fd(fileno(result->file),
+                FALSE, NULL);
+    if (result->mapping != NULL &&
+            g_mapped_file_get_length(result->mapping) > 0) {
+        result->data = (const guchar *)
+            g_mapped_file_get_contents(result->mapping);
+        result->total = g_mapped_file_get_length(result->mapping);
+        ph_import_source_advise(result->mapping);
+        ph_import_source_close_file(result);
+
+        length = MIN(sizeof(magic), (gsize) result->total);
+        result->kind = ph_import_source_detect(result->data, length);
+    }
+    else if (result->streaming) {
+        /* the bytes needed to detect the format are passed on later */
+        result->lookahead_length = fread(result->lookahead, 1,
+                sizeof(result->lookahead), result->file);
+        result->kind = ph_import_source_detect(result->lookahead,
+                result->lookahead_length);
+        if (result->kind == PH_IMPORT_SOURCE_ZIP) {
+            g_set_error(error, PH_IMPORT_SOURCE_ERROR,
+                    PH_IMPORT_SOURCE_ERROR_UNSUPPORTED,
+                    _("ZIP archives cannot be read from a pipe (“%s”)"),
+                    filename);
+            ph_import_source_free(result);
+            return NULL;
+        }
+    }
+    else {
+        if (result->mapping != NULL) {
+            g_mapped_file_unref(result->mapping);
+            result->mapping = NULL;
+        }
+
+        if (fseeko(result->file, 0, SEEK_END) == 0)
+            result->total = ftello(result->file);
+        rewind(result->file);
+
+        length = fread(magic, 1, sizeof(magic), result->file);
+        result->kind = ph_import_source_detect(magic, length);
+        rewind(result->file);
+    }
+
+    if (result->kind == PH_IMPORT_SOURCE_ZIP &&
+            !ph_import_source_read_zip(result, error)) {
+        ph_import_source_free(result);
+        return NULL;
+    }
+    else if (result->kind == PH_IMPORT_SOURCE_GZIP && !result->streaming)
+        result->content = ph_import_source_gzip_size(result);
+    else if (result->kind == PH_IMPORT_SOURCE_PLAIN)
+        result->content = result->total;
+
+    return result;
+}
+
+/*
+ * Get the uncompressed size of a gzip file from its trailer.  This is exact
+ * for files with a single member below 4 GiB, which is all that gzip can
+ * tell without decompressing.
+ */
+static goffset
+ph_import_source_gzip_size(PHImportSource *source)
+{
+    const guchar *trailer;
+    guchar *copy;
+    goffset result;
+
+    if (source->total < 18)
+        return 0;
+
+    trailer = ph_import_source_peek(source, source->total - 4, 4, &copy,
+            NULL);
+    if (trailer == NULL)
+        return 0;
+
+    result = ph_import_source_le32(trailer);
+    g_free(copy);
+    return result;
+}
+
+/*
+ * Read the central directory of a ZIP archive and remember where the GPX
+ * files are stored.  Returns FALSE on error.
+ */
+static gboolean
+ph_import_source_read_zip(PHImportSource *source,
+                          GError **error)
+{
+    const guchar *tail, *directory, *cur, *end;
+    guchar *copy = NULL;
+    goffset tail_length, directory_offset, directory_size;
+    guint count, i;
+    gboolean success = TRUE;
+
+    source->entries = g_array_new(FALSE, FALSE, sizeof(PHImportSourceEntry));
+
+    /* find the end of central directory record */
+    tail_length = MIN(source->total, PH_IMPORT_SOURCE_ZIP_END_SEARCH);
+    tail = ph_import_source_peek(source, source->total - tail_length,
+            tail_length, &copy, error);
+    if (tail == NULL)
+        return FALSE;
+
+    for (cur = tail + tail_length - PH_IMPORT_SOURCE_ZIP_END_SIZE;
+            cur >= tail && memcmp(cur, "PK\5\6", 4) != 0; --cur)
+        ;
+    if (cur < tail) {
+        g_free(copy);
+        g_set_error(error, PH_IMPORT_SOURCE_ERROR,
+                PH_IMPORT_SOURCE_ERROR_FORMAT,
+                _("“%s” is not a valid ZIP archive"), source->filename);
+        return FALSE;
+    }
+
+    count = ph_import_source_le16(cur + 10);
+    directory_size = ph_import_source_le32(cur + 12);
+    directory_offset = ph_import_source_le32(cur + 16);
+    g_free(copy);
+    copy = NULL;
+
+    /* read the central directory */
+    directory = ph_import_source_peek(source, directory_offset,
+            directory_size, &copy, error);
+    if (directory == NULL)
+        return FALSE;
+
+    cur = directory;
+    end = directory + directory_size;
+    for (i = 0; success && i < count; ++i) {
+        PHImportSourceEntry entry;
+        guint method, name_length;
+        const gchar *name;
+
+        if (end - cur < PH_IMPORT_SOURCE_ZIP_ENTRY_SIZE ||
+                memcmp(cur, "PK\1\2", 4) != 0) {
+            g_set_error(error, PH_IMPORT_SOURCE_ERROR,
+                    PH_IMPORT_SOURCE_ERROR_FORMAT,
+                    _("Corrupt central directory in ZIP archive “%s”"),
+                    source->filename);
+            success = FALSE;
+            break;
+        }
+
+        method = ph_import_source_le16(cur + 10);
+        name_length = ph_import_source_le16(cur + 28);
+        name = (const gchar *) cur + PH_IMPORT_SOURCE_ZIP_ENTRY_SIZE;
+
+        entry.offset = ph_import_source_le32(cur + 42);
+        entry.size = ph_import_source_le32(cur + 20);
+        entry.length = ph_import_source_le32(cur + 24);
+        entry.deflated = (method == Z_DEFLATED);
+
+        /* only look at GPX files */
+        if (name_length > 4 && name + name_length <= (const gchar *) end &&
+                g_ascii_strncasecmp(name + name_length - 4, ".gpx", 4) == 0) {
+            if ((ph_import_source_le16(cur + 8) & 0x1) != 0 ||
+                    (method != 0 && method != Z_DEFLATED)) {
+                g_set_error(error, PH_IMPORT_SOURCE_ERROR,
+                        PH_IMPORT_SOURCE_ERROR_UNSUPPORTED,
+                        _("“%.*s” in ZIP archive “%s” is encrypted or uses "
+                            "an unsupported compression method"),
+                        (int) name_length, name, source->filename);
+                success = FALSE;
+            }
+            else {
+                g_array_append_val(source->entries, entry);
+                source->content += entry.length;
+            }
+        }
+
+        cur += PH_IMPORT_SOURCE_ZIP_ENTRY_SIZE + name_length +
+            ph_import_source_le16(cur + 30) + ph_import_source_le16(cur + 32);
+    }
+
+    g_free(copy);
+    return success;
+}
+
+/*
+ * Get length bytes of the file starting at offset.  For mapped files, this
+ * points into the mapping; otherwise, the data is read into a buffer which
+ * is returned in copy and has to be freed.  Returns NULL on error.
+ */
+static const guchar *
+ph_import_source_peek(PHImportSource *source,
+                      goffset offset,
+                      gsize length,
+                      guchar **copy,
+                      GError **error)
+{
+    *copy = NULL;
+
+    if (source->data != NULL) {
+        if (offset < 0 || offset > source->total ||
+                length > (gsize) (source->total - offset)) {
+            (void) ph_import_source_set_eof_error(source, error);
+            return NULL;
+        }
+        return source->data + offset;
+    }
+
+    *copy = g_malloc(length);
+    if (fseeko(source->file, offset, SEEK_SET) != 0 ||
+            fread(*copy, 1, length, source->file) != length) {
+        g_free(*copy);
+        *copy = NULL;
+        (void) ph_import_source_set_io_error(source, error);
+        return NULL;
+    }
+    return *copy;
+}
+
+/*
+ * Continue reading the file at the given offset.  Returns FALSE on error.
+ */
+static gboolean
+ph_import_source_seek(PHImportSource *source,
+                      goffset offset,
+                      GError **error)
+{
+    if (source->data != NULL) {
+        if (offset < 0 || offset > source->total)
+            return ph_import_source_set_eof_error(source, error);
+    }
+    else if (fseeko(source->file, offset, SEEK_SET) != 0)
+        return ph_import_source_set_io_error(source, error);
+
+    source->position = offset;
+    return TRUE;
+}
+
+/*
+ * Tell the kernel that a mapped file is going to be read from start to end,
+ * so that it reads ahead aggressively and drops pages behind the reader.
+ */
+static void
+ph_import_source_advise(GMappedFile *mapping)
+{
+#ifdef MADV_SEQUENTIAL
+    if (g_mapped_file_get_length(mapping) > 0)
+        (void) madvise(g_mapped_file_get_contents(mapping),
+                g_mapped_file_get_length(mapping), MADV_SEQUENTIAL);
+#endif
+}
+
+/*
+ * Check whether a file is a pipe, a terminal or anything else that can only
+ * be read once from start to end.
+ */
+gboolean
+ph_import_source_is_stream(const gchar *filename)
+{
+    struct stat info;
+    gint status;
+
+    g_return_val_if_fail(filename != NULL, FALSE);
+
+    if (strcmp(filename, PH_IMPORT_SOURCE_STDIN) == 0)
+        status = fstat(fileno(stdin), &info);
+    else
+        status = stat(filename, &info);
+
+    return status == 0 && !S_ISREG(info.st_mode);
+}
+
+/*
+ * Read from the file with stdio, passing on the bytes read ahead from a
+ * stream first.  Returns the number of bytes read, which is less than count
+ * at the end of the file or on error.
+ */
+static gsize
+ph_import_source_fread(PHImportSource *source,
+                       guchar *buffer,
+                       gsize count)
+{
+    gsize result = MIN(count,
+            source->lookahead_length - source->lookahead_used);
+
+    memcpy(buffer, source->lookahead + source->lookahead_used, result);
+    source->lookahead_used += result;
+
+    if (result < count)
+        result += fread(buffer + result, 1, count - result, source->file);
+    return result;
+}
+
+/*
+ * Close the file opened for the source.  Standard input stays open.
+ */
+static void
+ph_import_source_close_file(PHImportSource *source)
+{
+    if (source->file != NULL && source->file != stdin)
+        fclose(source->file);
+    source->file = NULL;
+}
+
+/*
+ * Map a file into memory for sequential reading, like g_mapped_file_new().
+ */
+GMappedFile *
+ph_import_source_map_file(const gchar *filename,
+                          GError **error)
+{
+    GMappedFile *result;
+
+    g_return_val_if_fail(filename != NULL, NULL);
+    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+    result = g_mapped_file_new(filename, FALSE, error);
+    if (result != NULL)
+        ph_import_source_advise(result);
+    return result;
+}
+
+/*
+ * Close the file and free the source.  No-op for NULL.
+ */
+void
+ph_import_source_free(PHImportSource *source)
+{
+    if (source == NULL)
+        return;
+
+    if (source->stream_ready)
+        (void) inflateEnd(&source->stream);
+    if (source->mapping != NULL)
+        g_mapped_file_unref(source->mapping);
+    ph_import_source_close_file(source);
+    if (source->entries != NULL)
+        g_array_free(source->entries, TRUE);
+    if (source->error != NULL)
+        g_error_free(source->error);
+    g_free(source->filename);
+    g_free(source);
+}
+
+/* Reading documents {{{1 */
+
+/*
+ * If reading the current document failed, replace the error reported by the
+ * XML parser, which does not know the reason, and return TRUE.
+ */
+gboolean
+ph_import_source_take_error(PHImportSource *source,
+                            GError **error)
+{
+    g_return_val_if_fail(source != NULL, FALSE);
+
+    if (source->error == NULL)
+        return FALSE;
+
+    g_clear_error(error);
+    g_propagate_error(error, source->error);
+    source->error = NULL;
+    return TRUE;
+}
+
+/*
+ * Create an XML reader for the next GPX document in the file.  The reader
+ * has to be freed before this function is called again.  Returns NULL if
+ * there are no more documents, or on error.
+ */
+xmlTextReaderPtr
+ph_import_source_next_reader(PHImportSource *source,
+                             GError **error)
+{
+    xmlTextReaderPtr reader;
+    gboolean success = FALSE;
+
+    g_return_val_if_fail(source != NULL, NULL);
+    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+    /* the XML reader sees read errors as the end of the file, so they are
+     * only reported here */
+    if (source->error != NULL) {
+        g_propagate_error(error, source->error);
+        source->error = NULL;
+        return NULL;
+    }
+
+    switch (source->kind) {
+    case PH_IMPORT_SOURCE_PLAIN:
+    case PH_IMPORT_SOURCE_GZIP:
+        if (source->started)
+            return NULL;
+        source->started = TRUE;
+        /* 16 + 15: gzip header, maximum window size */
+        success = ph_import_source_begin(source,
+                source->kind == PH_IMPORT_SOURCE_GZIP, 16 + MAX_WBITS,
+                source->streaming ? G_MAXOFFSET : source->total, error);
+        break;
+    case PH_IMPORT_SOURCE_ZIP: {
+        PHImportSourceEntry *entry;
+        const guchar *header;
+        guchar *copy;
+        goffset start;
+
+        if (source->next_entry >= source->entries->len)
+            return NULL;
+        entry = &g_array_index(source->entries, PHImportSourceEntry,
+                source->next_entry++);
+
+        /* skip the local header, whose variable part may differ from the
+         * central directory */
+        header = ph_import_source_peek(source, entry->offset,
+                PH_IMPORT_SOURCE_ZIP_LOCAL_SIZE, &copy, error);
+        if (header == NULL)
+            return NULL;
+        if (memcmp(header, "PK\3\4", 4) != 0) {
+            g_free(copy);
+            g_set_error(error, PH_IMPORT_SOURCE_ERROR,
+                    PH_IMPORT_SOURCE_ERROR_FORMAT,
+                    _("Corrupt local header in ZIP archive “%s”"),
+                    source->filename);
+            return NULL;
+        }
+        start = entry->offset + PH_IMPORT_SOURCE_ZIP_LOCAL_SIZE +
+            ph_import_source_le16(header + 26) +
+            ph_import_source_le16(header + 28);
+        g_free(copy);
+        if (!ph_import_source_seek(source, start, error))
+            return NULL;
+
+        /* negative window bits: raw deflate data without header */
+        success = ph_import_source_begin(source, entry->deflated,
+                -MAX_WBITS, entry->size, error);
+        break;
+    }
+    }
+
+    if (!success)
+        return NULL;
+
+    /* uncompressed documents in mapped files are parsed right where they
+     * are, unless they are too large for libxml2 */
+    if (source->data != NULL && !source->deflated &&
+            source->remaining <= G_MAXINT)
+        reader = xmlReaderForMemory(
+                (const char *) source->data + source->start,
+                source->remaining, source->filename, NULL, 0);
+    else
+        reader = xmlReaderForIO(ph_import_source_read,
+                ph_import_source_close, source, source->filename, NULL, 0);
+    if (reader == NULL)
+        (void) ph_xml_set_last_error(error);
+    return reader;
+}
+
+/*
+ * Prepare for reading a document of the given (compressed) length from the
+ * current position.  Returns FALSE on error.
+ */
+static gboolean
+ph_import_source_begin(PHImportSource *source,
+                       gboolean deflated,
+                       gint window_bits,
+                       goffset length,
+                       GError **error)
+{
+    gint rc;
+
+    source->start = source->position;
+    source->deflated = deflated;
+    source->remaining = length;
+    source->finished = FALSE;
+
+    if (!deflated)
+        return TRUE;
+
+    if (source->stream_ready) {
+        (void) inflateEnd(&source->stream);
+        source->stream_ready = FALSE;
+    }
+
+    memset(&source->stream, 0, sizeof(source->stream));
+    rc = inflateInit2(&source->stream, window_bits);
+    if (rc != Z_OK) {
+        g_set_error(error, PH_IMPORT_SOURCE_ERROR,
+                PH_IMPORT_SOURCE_ERROR_UNSUPPORTED,
+                _("Could not initialize decompression: %s"),
+                zError(rc));
+        return FALSE;
+    }
+    source->stream_ready = TRUE;
+
+    return TRUE;
+}
+
+/*
+ * Hand more compressed data to the decompressor, directly from the mapping
+ * if there is one.  Data is passed in portions of limited size even then,
+ * so that the position keeps track of the progress.  Returns FALSE if no
+ * more data can be read.
+ */
+static gboolean
+ph_import_source_fill(PHImportSource *source)
+{
+    gsize count = MIN(sizeof(source->buffer), (gsize) source->remaining);
+    gsize nread;
+
+    if (count == 0)
+        return FALSE;
+
+    if (source->data != NULL) {
+        nread = MIN(count, (gsize) (source->total - source->position));
+        source->stream.next_in = (Bytef *) source->data + source->position;
+    }
+    else {
+        nread = ph_import_source_fread(source, source->buffer, count);
+        source->stream.next_in = source->buffer;
+    }
+
+    if (nread == 0) {
+        source->remaining = 0;
+        return FALSE;
+    }
+
+    source->position += nread;
+    source->remaining -= nread;
+    source->stream.avail_in = nread;
+
+    return TRUE;
+}
+
+/*
+ * Get the position in the file which corresponds to the given number of
+ * bytes consumed by the XML reader of the current document.  This is exact
+ * for uncompressed documents; for compressed ones, the amount of compressed
+ * data read so far is all that is known.
+ */
+goffset
+ph_import_source_get_offset(const PHImportSource *source,
+                            glong consumed)
+{
+    g_return_val_if_fail(source != NULL, 0);
+
+    if (source->deflated)
+        return source->position;
+    else
+        return source->start + MAX(consumed, 0);
+}
+
+/*
+ * Get the total uncompressed size of the GPX documents in the file, as far
+ * as it can be determined without decompressing anything.
+ */
+goffset
+ph_import_source_get_content_size(const PHImportSource *source)
+{
+    g_return_val_if_fail(source != NULL, 0);
+
+    return source->content;
+}
+
+/*
+ * Get the fraction of the file which has been read so far, given the number
+ * of bytes consumed by the XML reader of the current document.  Returns 0
+ * for streams, whose size is not known; ph_import_source_get_offset() still
+ * tells how much has been read.
+ */
+gdouble
+ph_import_source_get_fraction(const PHImportSource *source,
+                              glong consumed)
+{
+    g_return_val_if_fail(source != NULL, 0.0);
+
+    if (source->total == 0)
+        return 0.0;
+    else
+        return ((gdouble) ph_import_source_get_offset(source, consumed)) /
+            source->total;
+}
+
+/* Reader callbacks {{{1 */
+
+/*
+ * Supply the XML reader with the next bytes of the current document.
+ * Returns -1 on error, which is remembered for ph_import_source_next_reader().
+ */
+static int
+ph_import_source_read(void *context,
+                      char *buffer,
+                      int length)
+{
+    PHImportSource *source = (PHImportSource *) context;
+    z_stream *stream = &source->stream;
+    gint rc;
+
+    if (!source->deflated && source->data != NULL) {
+        gsize count = MIN((gsize) length, (gsize) source->remaining);
+
+        memcpy(buffer, source->data + source->position, count);
+        source->position += count;
+        source->remaining -= count;
+        return count;
+    }
+    else if (!source->deflated) {
+        gsize count = MIN((gsize) length, (gsize) source->remaining);
+        gsize nread = ph_import_source_fread(source, (guchar *) buffer,
+                count);
+
+        source->position += nread;
+        source->remaining -= nread;
+        if (nread < count && ferror(source->file)) {
+            (void) ph_import_source_set_io_error(source, &source->error);
+            return -1;
+        }
+        return nread;
+    }
+
+    stream->next_out = (Bytef *) buffer;
+    stream->avail_out = length;
+
+    while (stream->avail_out > 0 && !source->finished) {
+        if (stream->avail_in == 0 && !ph_import_source_fill(source)) {
+            g_set_error(&source->error, PH_IMPORT_SOURCE_ERROR,
+                    PH_IMPORT_SOURCE_ERROR_FORMAT,
+                    _("Unexpected end of compressed data in “%s”"),
+                    source->filename);
+            return -1;
+        }
+
+        rc = inflate(stream, Z_NO_FLUSH);
+        if (rc == Z_STREAM_END) {
+            /* gzip files may consist of several members */
+            if (source->kind == PH_IMPORT_SOURCE_GZIP &&
+                    (stream->avail_in > 0 || ph_import_source_fill(source)))
+                (void) inflateReset(stream);
+            else
+                source->finished = TRUE;
+        }
+        else if (rc != Z_OK) {
+            g_set_error(&source->error, PH_IMPORT_SOURCE_ERROR,
+                    PH_IMPORT_SOURCE_ERROR_FORMAT,
+                    _("Corrupt compressed data in “%s”: %s"),
+                    source->filename,
+                    (stream->msg != NULL) ? stream->msg : zError(rc));
+            return -1;
+        }
+    }
+
+    return length - stream->avail_out;
+}
+
+/*
+ * Nothing to do when the reader is closed; the file belongs to the source.
+ */
+static int
+ph_import_source_close(void *context)
+{
+    return 0;
+}
+
+/* Error reporting {{{1 */
+
+/*
+ * Unique identifier for import source errors.
+ */
+GQuark
+ph_import_source_error_quark()
+{
+    return g_quark_from_static_string("ph-import-source-error");
+}
+
+/*
+ * Report the current value of errno as an error accessing the file.  Returns
+ * FALSE for reasons of convenience.
+ */
+static gboolean
+ph_import_source_set_io_error(PHImportSource *source,
+                              GError **error)
+{
+    gint code = errno;
+
+    if (code == 0)
+        return ph_import_source_set_eof_error(source, error);
+
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(code),
+            _("Could not read “%s”: %s"), source->filename,
+            g_strerror(code));
+    return FALSE;
+}
+
+/*
+ * Report that the file ended before the data it describes.  Returns FALSE
+ * for reasons of convenience.
+ */
+static gboolean
+ph_import_source_set_eof_error(PHImportSource *source,
+                               GError **error)
+{
+    g_set_error(error, PH_IMPORT_SOURCE_ERROR,
+            PH_IMPORT_SOURCE_ERROR_FORMAT,
+            _("Unexpected end of file “%s”"), source->filename);
+    return FALSE;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
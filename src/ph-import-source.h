@@ -0,0 +1,70 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+#ifndef PH_IMPORT_SOURCE_H
+#define PH_IMPORT_SOURCE_H
+
+/* Includes {{{1 */
+
+#include <glib.h>
+#include <libxml/xmlreader.h>
+
+/* Constants {{{1 */
+
+/*
+ * File name standing for standard input.
+ */
+#define PH_IMPORT_SOURCE_STDIN "-"
+
+/* Data types {{{1 */
+
+/*
+ * Input file containing one or more GPX documents, either directly or
+ * compressed as .gz or .zip.
+ */
+typedef struct _PHImportSource PHImportSource;
+
+/* Public interface {{{1 */
+
+PHImportSource *ph_import_source_open(const gchar *filename,
+                                      GError **error);
+void ph_import_source_free(PHImportSource *source);
+gboolean ph_import_source_is_stream(const gchar *filename);
+
+xmlTextReaderPtr ph_import_source_next_reader(PHImportSource *source,
+                                              GError **error);
+gboolean ph_import_source_take_error(PHImportSource *source,
+                                     GError **error);
+
+goffset ph_import_source_get_offset(const PHImportSource *source,
+                                    glong consumed);
+gdouble ph_import_source_get_fraction(const PHImportSource *source,
+                                      glong consumed);
+goffset ph_import_source_get_content_size(const PHImportSource *source);
+
+GMappedFile *ph_import_source_map_file(const gchar *filename,
+                                       GError **error);
+gboolean ph_import_source_is_compressed(const gchar *data,
+                                        gsize length);
+
+/* Error reporting {{{1 */
+
+#define PH_IMPORT_SOURCE_ERROR (ph_import_source_error_quark())
+GQuark ph_import_source_error_quark();
+typedef enum {
+    PH_IMPORT_SOURCE_ERROR_FORMAT,
+    PH_IMPORT_SOURCE_ERROR_UNSUPPORTED
+} PHImportSourceError;
+
+/* }}} */
+
+#endif
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -0,0 +1,966 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+/* Includes {{{1 */
+
+#include "ph-import-writer.h"
+#include <sys/stat.h>
+
+/* Constants {{{1 */
+
+/*
+ * Maximum number of logs written by a single multi-row INSERT statement.  Six
+ * parameters per row keep this well below SQLite's default host parameter
+ * limit of 999.
+ */
+#define PH_IMPORT_WRITER_BATCH_SIZE 32
+
+/*
+ * Name of the savepoint around the records of a single file.
+ */
+#define PH_IMPORT_WRITER_SAVEPOINT "import_file"
+
+/*
+ * Columns of the tables written by the importer, each starting with the
+ * primary key, in the order of the statement parameters.
+ */
+static const gchar *const ph_import_writer_waypoint_columns[] = {
+    "id", "geocache_id", "name", "placed", "type", "url", "summary",
+    "description", "latitude", "longitude", NULL
+};
+
+static const gchar *const ph_import_writer_geocache_columns[] = {
+    "id", "name", "creator", "owner", "type", "size", "difficulty",
+    "terrain", "attributes", "summary_html", "summary", "description_html",
+    "description", "hint", "logged", "archived", "available", "content_hash",
+    "attributes_yes", "attributes_no", NULL
+};
+
+static const gchar *const ph_import_writer_log_columns[] = {
+    "id", "geocache_id", "type", "logger", "logged", "details", NULL
+};
+
+static const gchar *const ph_import_writer_trackable_columns[] = {
+    "id", "name", "geocache_id", NULL
+};
+
+/* Data structures {{{1 */
+
+struct _PHImportWriter {
+    PHDatabase *database;           /* target database */
+
+    /* upserts, which leave unchanged rows alone */
+    sqlite3_stmt *waypoint;         /* INSERT INTO waypoints */
+    sqlite3_stmt *geocache;         /* INSERT INTO geocaches */
+    sqlite3_stmt *trackable;        /* INSERT INTO trackables */
+    sqlite3_stmt *geocache_hash;    /* SELECT content_hash FROM geocaches */
+    sqlite3_stmt *clear_trackables; /* DELETE FROM trackables */
+    sqlite3_stmt *journal;          /* INSERT INTO import_journal */
+
+    gchar *filename;                /* file being stored, or NULL */
+    gint64 size;                    /* its size when it was started */
+    gint64 mtime;                   /* its modification time back then */
+    guint files;                    /* number of files stored completely */
+
+    /* INSERT INTO logs for 1, 2, ... PH_IMPORT_WRITER_BATCH_SIZE rows,
+     * prepared on demand */
+    sqlite3_stmt *logs[PH_IMPORT_WRITER_BATCH_SIZE];
+    PHLog pending[PH_IMPORT_WRITER_BATCH_SIZE];
+    guint pending_count;            /* number of logs waiting to be written */
+    sqlite3_int64 log_rowid;        /* highest rowid in the logs table */
+
+    guint rows;                     /* number of rows written so far */
+    guint inserted;                 /* number of new rows */
+    guint updated;                  /* number of changed rows */
+    guint unchanged;                /* number of rows left as they were */
+    guint skipped;                  /* number of unchanged records */
+    gsize arena_peak;               /* largest record arena seen */
+    guint arena_allocations;        /* objects allocated from the arenas */
+    GHashTable *changed;            /* IDs of geocaches written so far */
+    const PHLogRetention *retention; /* drops logs it would remove, or NULL */
+    guint expired;                  /* number of logs dropped that way */
+
+    PHImportProfile *profile;       /* receives the time below, or NULL */
+    gint64 time;                    /* microseconds spent storing records */
+};
+
+/* Forward declarations {{{1 */
+
+static sqlite3_stmt *ph_import_writer_prepare_upsert(
+    PHImportWriter *writer, const gchar *table, const gchar *const *columns,
+    guint keys, guint count, GError **error);
+static sqlite3_int64 ph_import_writer_max_rowid(PHImportWriter *writer,
+                                                const gchar *table,
+                                                GError **error);
+static sqlite3_stmt *ph_import_writer_log_statement(PHImportWriter *writer,
+                                                    guint count,
+                                                    GError **error);
+static gboolean ph_import_writer_run(PHImportWriter *writer,
+                                     sqlite3_stmt *stmt,
+                                     guint rows,
+                                     sqlite3_int64 *max_rowid,
+                                     GError **error);
+static void ph_import_writer_bind_text(sqlite3_stmt *stmt,
+                                       gint index,
+                                       const gchar *text);
+static void ph_import_writer_bind_waypoint(sqlite3_stmt *stmt,
+                                           const PHWaypoint *waypoint);
+static gint ph_import_writer_unchanged(PHImportWriter *writer,
+                                       const PHImportRecord *record,
+                                       gboolean *known,
+                                       GError **error);
+
+static gboolean ph_import_writer_store(PHImportWriter *writer,
+                                       const PHImportRecord *record,
+                                       GError **error);
+
+static gboolean ph_import_writer_store_waypoint(PHImportWriter *writer,
+                                                const PHWaypoint *waypoint,
+                                                GError **error);
+static gboolean ph_import_writer_store_geocache(PHImportWriter *writer,
+                                                const PHGeocache *gc,
+                                                guint64 hash,
+                                                GError **error);
+static gboolean ph_import_writer_add_log(PHImportWriter *writer,
+                                         const PHLog *log,
+                                         GError **error);
+static guint ph_import_writer_log_rank(const GArray *logs, guint i);
+static gboolean ph_import_writer_flush(PHImportWriter *writer,
+                                       GError **error);
+static gboolean ph_import_writer_clear_trackables(PHImportWriter *writer,
+                                                  const gchar *geocache_id,
+                                                  GError **error);
+static gboolean ph_import_writer_store_trackable(PHImportWriter *writer,
+                                                 const PHTrackable *trackable,
+                                                 GError **error);
+
+/* Memory management {{{1 */
+
+/*
+ * Create a writer for the given database and prepare the statements needed
+ * for a GPX import.  Returns NULL on error.
+ */
+PHImportWriter *
+ph_import_writer_new(PHDatabase *database,
+                     GError **error)
+{
+    PHImportWriter *result;
+
+    g_return_val_if_fail(database != NULL && PH_IS_DATABASE(database), NULL);
+    g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+    result = g_new0(PHImportWriter, 1);
+    result->database = g_object_ref(database);
+    result->changed = g_hash_table_new_full(g_str_hash, g_str_equal,
+            g_free, NULL);
+
+    result->waypoint = ph_import_writer_prepare_upsert(result, "waypoints",
+            ph_import_writer_waypoint_columns, 1, 1, error);
+    if (result->waypoint != NULL)
+        result->geocache = ph_import_writer_prepare_upsert(result,
+                "geocaches", ph_import_writer_geocache_columns, 1, 1, error);
+    if (result->geocache != NULL)
+        result->trackable = ph_import_writer_prepare_upsert(result,
+                "trackables", ph_import_writer_trackable_columns, 1, 1,
+                error);
+    if (result->trackable != NULL)
+        result->geocache_hash = ph_database_prepare(database,
+                "SELECT content_hash FROM geocaches WHERE id = ?", error);
+    if (result->geocache_hash != NULL)
+        result->clear_trackables = ph_database_prepare(database,
+                "DELETE FROM trackables WHERE geocache_id = ?", error);
+    if (result->clear_trackables != NULL)
+        result->journal = ph_database_prepare(database,
+                "INSERT OR REPLACE INTO import_journal "
+                "(filename, size, mtime) VALUES (?, ?, ?)", error);
+    result->log_rowid = (result->journal != NULL) ?
+        ph_import_writer_max_rowid(result, "logs", error) : -1;
+
+    if (result->log_rowid < 0) {
+        ph_import_writer_free(result);
+        return NULL;
+    }
+
+    return result;
+}
+
+/*
+ * Finalize all statements and free the writer.  Logs which have not been
+ * flushed yet are discarded.  No-op for NULL.
+ */
+void
+ph_import_writer_free(PHImportWriter *writer)
+{
+    guint i;
+
+    if (writer == NULL)
+        return;
+
+    if (writer->profile != NULL)
+        ph_import_profile_add_store_time(writer->profile, writer->time);
+
+    (void) sqlite3_finalize(writer->waypoint);
+    (void) sqlite3_finalize(writer->geocache);
+    (void) sqlite3_finalize(writer->trackable);
+    (void) sqlite3_finalize(writer->geocache_hash);
+    (void) sqlite3_finalize(writer->clear_trackables);
+    (void) sqlite3_finalize(writer->journal);
+    for (i = 0; i < PH_IMPORT_WRITER_BATCH_SIZE; ++i)
+        (void) sqlite3_finalize(writer->logs[i]);
+
+    g_free(writer->filename);
+    g_hash_table_destroy(writer->changed);
+    g_object_unref(writer->database);
+    g_free(writer);
+}
+
+/*
+ * Measure the time spent storing records and add it to profile when the
+ * writer is freed.
+ */
+void
+ph_import_writer_set_profile(PHImportWriter *writer,
+                             PHImportProfile *profile)
+{
+    g_return_if_fail(writer != NULL);
+
+    writer->profile = profile;
+}
+
+/*
+ * Leave out the logs which the retention rules would remove after the
+ * import anyway.  Otherwise, they would be stored again by every import
+ * which contains them.  The rules have to stay valid until the writer is
+ * freed; NULL keeps all logs.
+ */
+void
+ph_import_writer_set_log_retention(PHImportWriter *writer,
+                                   const PHLogRetention *retention)
+{
+    g_return_if_fail(writer != NULL);
+
+    writer->retention = retention;
+}
+
+/* Statement execution {{{1 */
+
+/*
+ * Prepare an upsert of count rows into the given table, with one parameter
+ * per column and row.  The first keys columns identify a row.  Returns NULL
+ * on error.
+ */
+static sqlite3_stmt *
+ph_import_writer_prepare_upsert(PHImportWriter *writer,
+                                const gchar *table,
+                                const gchar *const *columns,
+                                guint keys,
+                                guint count,
+                                GError **error)
+{
+    GString *query = g_string_new(NULL), *row = g_string_new("(");
+    sqlite3_stmt *result;
+    gchar *names, *upsert;
+    guint i;
+
+    for (i = 0; columns[i] != NULL; ++i)
+        g_string_append(row, (i == 0) ? "?" : ", ?");
+    g_string_append_c(row, ')');
+
+    names = g_strjoinv(", ", (gchar **) columns);
+    g_string_printf(query, "INSERT INTO %s (%s) VALUES ", table, names);
+    for (i = 0; i < count; ++i) {
+        if (i > 0)
+            g_string_append(query, ", ");
+        g_string_append(query, row->str);
+    }
+    upsert = ph_database_upsert_clause(columns, keys);
+    g_string_append(query, upsert);
+
+    result = ph_database_prepare(writer->database, query->str, error);
+
+    g_free(upsert);
+    g_free(names);
+    g_string_free(row, TRUE);
+    g_string_free(query, TRUE);
+    return result;
+}
+
+/*
+ * Get the highest rowid currently used in a table, or 0 if it is empty.
+ * Returns -1 on error.
+ */
+static sqlite3_int64
+ph_import_writer_max_rowid(PHImportWriter *writer,
+                           const gchar *table,
+                           GError **error)
+{
+    sqlite3_stmt *stmt;
+    gchar *query;
+    sqlite3_int64 result = -1;
+
+    query = g_strdup_printf("SELECT MAX(rowid) FROM %s", table);
+    stmt = ph_database_prepare(writer->database, query, error);
+    g_free(query);
+    if (stmt == NULL)
+        return -1;
+
+    if (ph_database_step(writer->database, stmt, error) == SQLITE_ROW)
+        result = sqlite3_column_int64(stmt, 0);
+    (void) sqlite3_finalize(stmt);
+
+    return result;
+}
+
+/*
+ * Bind a string parameter without copying it.  The string has to stay valid
+ * until the statement has been executed.  NULL is stored as SQL NULL.
+ */
+static void
+ph_import_writer_bind_text(sqlite3_stmt *stmt,
+                           gint index,
+                           const gchar *text)
+{
+    (void) sqlite3_bind_text(stmt, index, text, -1, SQLITE_STATIC);
+}
+
+/*
+ * Bind the columns of a waypoint to the first ten parameters of a statement.
+ */
+static void
+ph_import_writer_bind_waypoint(sqlite3_stmt *stmt,
+                               const PHWaypoint *waypoint)
+{
+    ph_import_writer_bind_text(stmt, 1, waypoint->id);
+    ph_import_writer_bind_text(stmt, 2, (waypoint->geocache_id == NULL)
+            ? waypoint->id : waypoint->geocache_id);
+    ph_import_writer_bind_text(stmt, 3, waypoint->name);
+    (void) sqlite3_bind_int64(stmt, 4, waypoint->placed);
+    (void) sqlite3_bind_int(stmt, 5, waypoint->type);
+    ph_import_writer_bind_text(stmt, 6, waypoint->url);
+    ph_import_writer_bind_text(stmt, 7, waypoint->summary);
+    ph_import_writer_bind_text(stmt, 8, waypoint->description);
+    (void) sqlite3_bind_int(stmt, 9, waypoint->latitude);
+    (void) sqlite3_bind_int(stmt, 10, waypoint->longitude);
+}
+
+/*
+ * Execute a statement whose parameters have been bound and reset it for the
+ * next use.  rows is the number of rows an upsert passes to the database,
+ * or 0 for other statements; they are counted as inserted, updated or
+ * unchanged.  New rows are recognized by the rowid of the last one
+ * inserted, so for statements with several rows, max_rowid has to point to
+ * the highest rowid in the table and is kept up to date.  Returns FALSE on
+ * error.
+ */
+static gboolean
+ph_import_writer_run(PHImportWriter *writer,
+                     sqlite3_stmt *stmt,
+                     guint rows,
+                     sqlite3_int64 *max_rowid,
+                     GError **error)
+{
+    sqlite3 *connection = sqlite3_db_handle(stmt);
+    sqlite3_int64 last;
+    guint changes, inserted = 0;
+    gint status;
+
+    sqlite3_set_last_insert_rowid(connection, 0);
+    status = ph_database_step(writer->database, stmt, error);
+    (void) sqlite3_reset(stmt);
+
+    if (status != SQLITE_DONE)
+        return FALSE;
+    if (rows == 0)
+        return TRUE;
+
+    changes = sqlite3_changes(connection);
+    last = sqlite3_last_insert_rowid(connection);
+    if (last != 0 && max_rowid == NULL)
+        inserted = 1;
+    else if (last != 0) {
+        inserted = CLAMP(last - *max_rowid, 0, changes);
+        *max_rowid = last;
+    }
+
+    writer->rows += changes;
+    writer->inserted += inserted;
+    writer->updated += changes - inserted;
+    writer->unchanged += rows - changes;
+    return TRUE;
+}
+
+/*
+ * Get the statement inserting count logs at once, preparing it on first use.
+ * Returns NULL on error.
+ */
+static sqlite3_stmt *
+ph_import_writer_log_statement(PHImportWriter *writer,
+                               guint count,
+                               GError **error)
+{
+    g_return_val_if_fail(count >= 1 && count <= PH_IMPORT_WRITER_BATCH_SIZE,
+            NULL);
+
+    if (writer->logs[count - 1] == NULL)
+        writer->logs[count - 1] = ph_import_writer_prepare_upsert(writer,
+                "logs", ph_import_writer_log_columns, 2, count, error);
+
+    return writer->logs[count - 1];
+}
+
+/* Database storage {{{1 */
+
+/*
+ * Store a waypoint, replacing an existing one with the same ID.  Returns FALSE
+ * on error.
+ */
+static gboolean
+ph_import_writer_store_waypoint(PHImportWriter *writer,
+                                const PHWaypoint *waypoint,
+                                GError **error)
+{
+    sqlite3_stmt *stmt = writer->waypoint;
+
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    ph_import_writer_bind_waypoint(stmt, waypoint);
+
+    return ph_import_writer_run(writer, stmt, 1, NULL, error);
+}
+
+/*
+ * Store a geocache together with the hash of its record, replacing an
+ * existing one with the same ID.  Returns FALSE on error.
+ */
+static gboolean
+ph_import_writer_store_geocache(PHImportWriter *writer,
+                                const PHGeocache *gc,
+                                guint64 hash,
+                                GError **error)
+{
+    sqlite3_stmt *stmt = writer->geocache;
+    gchar *attributes;
+    gboolean success;
+
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    attributes = ph_geocache_attrs_to_string(&gc->attributes);
+
+    ph_import_writer_bind_text(stmt, 1, gc->id);
+    ph_import_writer_bind_text(stmt, 2, gc->name);
+    ph_import_writer_bind_text(stmt, 3, gc->creator);
+    ph_import_writer_bind_text(stmt, 4, gc->owner);
+    (void) sqlite3_bind_int(stmt, 5, gc->type);
+    (void) sqlite3_bind_int(stmt, 6, gc->size);
+    (void) sqlite3_bind_int(stmt, 7, gc->difficulty);
+    (void) sqlite3_bind_int(stmt, 8, gc->terrain);
+    ph_import_writer_bind_text(stmt, 9, attributes);
+    (void) sqlite3_bind_int(stmt, 10, gc->summary_html ? 1 : 0);
+    ph_database_bind_packed(writer->database, stmt, 11, gc->summary);
+    (void) sqlite3_bind_int(stmt, 12, gc->description_html ? 1 : 0);
+    ph_database_bind_packed(writer->database, stmt, 13, gc->description);
+    ph_import_writer_bind_text(stmt, 14, gc->hint);
+    (void) sqlite3_bind_int(stmt, 15, gc->logged ? 1 : 0);
+    (void) sqlite3_bind_int(stmt, 16, gc->archived ? 1 : 0);
+    (void) sqlite3_bind_int(stmt, 17, gc->available ? 1 : 0);
+    (void) sqlite3_bind_int64(stmt, 18, (sqlite3_int64) hash);
+    (void) sqlite3_bind_int64(stmt, 19,
+            ph_geocache_attrs_get_mask(&gc->attributes, TRUE));
+    (void) sqlite3_bind_int64(stmt, 20,
+            ph_geocache_attrs_get_mask(&gc->attributes, FALSE));
+
+    success = ph_import_writer_run(writer, stmt, 1, NULL, error);
+    g_free(attributes);
+
+    return success;
+}
+
+/*
+ * Queue a log for storage.  Logs are written in batches, so the strings
+ * referenced by log have to remain valid until the next call to
+ * ph_import_writer_flush().  Returns FALSE on error.
+ */
+static gboolean
+ph_import_writer_add_log(PHImportWriter *writer,
+                         const PHLog *log,
+                         GError **error)
+{
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    writer->pending[writer->pending_count++] = *log;
+
+    if (writer->pending_count == PH_IMPORT_WRITER_BATCH_SIZE)
+        return ph_import_writer_flush(writer, error);
+    else
+        return TRUE;
+}
+
+/*
+ * Count the logs of a record which are newer than the one at index i, in the
+ * order of the retention rules.  Logs already stored are not part of the
+ * record, so the rank in the database may only be higher.  Records carry a
+ * few dozen logs at most, so comparing each pair is cheap enough.
+ */
+static guint
+ph_import_writer_log_rank(const GArray *logs,
+                          guint i)
+{
+    const PHLog *log = &g_array_index(logs, PHLog, i), *other;
+    guint rank = 0, j;
+
+    for (j = 0; j < logs->len; ++j) {
+        other = &g_array_index(logs, PHLog, j);
+        if (other->logged > log->logged ||
+                (other->logged == log->logged && other->id > log->id))
+            ++rank;
+    }
+
+    return rank;
+}
+
+/*
+ * Write all queued logs to the database with a single statement.  Returns
+ * FALSE on error.
+ */
+static gboolean
+ph_import_writer_flush(PHImportWriter *writer,
+                       GError **error)
+{
+    sqlite3_stmt *stmt;
+    guint count = writer->pending_count, i;
+
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    if (count == 0)
+        return TRUE;
+    writer->pending_count = 0;
+
+    stmt = ph_import_writer_log_statement(writer, count, error);
+    if (stmt == NULL)
+        return FALSE;
+
+    for (i = 0; i < count; ++i) {
+        const PHLog *log = &writer->pending[i];
+        gint base = 6 * i;
+
+        (void) sqlite3_bind_int(stmt, base + 1, log->id);
+        ph_import_writer_bind_text(stmt, base + 2, log->geocache_id);
+        (void) sqlite3_bind_int(stmt, base + 3, log->type);
+        ph_import_writer_bind_text(stmt, base + 4, log->logger);
+        (void) sqlite3_bind_int64(stmt, base + 5, log->logged);
+        ph_database_bind_packed(writer->database, stmt, base + 6,
+                log->details);
+    }
+
+    return ph_import_writer_run(writer, stmt, count, &writer->log_rowid,
+            error);
+}
+
+/*
+ * Remove all trackables currently associated with a geocache.  Returns FALSE
+ * on error.
+ */
+static gboolean
+ph_import_writer_clear_trackables(PHImportWriter *writer,
+                                  const gchar *geocache_id,
+                                  GError **error)
+{
+    sqlite3_stmt *stmt = writer->clear_trackables;
+
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    ph_import_writer_bind_text(stmt, 1, geocache_id);
+
+    return ph_import_writer_run(writer, stmt, 0, NULL, error);
+}
+
+/*
+ * Store a trackable, moving it away from any other geocache.  Returns FALSE
+ * on error.
+ */
+static gboolean
+ph_import_writer_store_trackable(PHImportWriter *writer,
+                                 const PHTrackable *trackable,
+                                 GError **error)
+{
+    sqlite3_stmt *stmt = writer->trackable;
+
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    ph_import_writer_bind_text(stmt, 1, trackable->id);
+    ph_import_writer_bind_text(stmt, 2, trackable->name);
+    ph_import_writer_bind_text(stmt, 3, trackable->geocache_id);
+
+    return ph_import_writer_run(writer, stmt, 1, NULL, error);
+}
+
+/* Files {{{1 */
+
+/*
+ * Start storing the records of a file.  They are written within a
+ * savepoint, so that the file can be undone on its own with
+ * ph_import_writer_abort_file().  Returns FALSE on error.
+ */
+gboolean
+ph_import_writer_begin_file(PHImportWriter *writer,
+                            const gchar *filename,
+                            GError **error)
+{
+    struct stat info;
+
+    g_return_val_if_fail(writer != NULL, FALSE);
+    g_return_val_if_fail(writer->filename == NULL, FALSE);
+    g_return_val_if_fail(filename != NULL, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    if (!ph_database_savepoint(writer->database, PH_IMPORT_WRITER_SAVEPOINT,
+                error))
+        return FALSE;
+
+    writer->filename = g_strdup(filename);
+    /* pipes cannot be imported again, so they are not journaled */
+    writer->size = writer->mtime = -1;
+    if (stat(filename, &info) == 0 && S_ISREG(info.st_mode)) {
+        writer->size = info.st_size;
+        writer->mtime = info.st_mtime;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Record the current file as stored completely in the import journal, unless
+ * it is a pipe, and keep its records.  No-op if no file has been started.
+ * Returns FALSE on error.
+ */
+gboolean
+ph_import_writer_end_file(PHImportWriter *writer,
+                          GError **error)
+{
+    sqlite3_stmt *stmt;
+
+    g_return_val_if_fail(writer != NULL, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    if (writer->filename == NULL)
+        return TRUE;
+
+    if (writer->size >= 0) {
+        stmt = writer->journal;
+        ph_import_writer_bind_text(stmt, 1, writer->filename);
+        (void) sqlite3_bind_int64(stmt, 2, writer->size);
+        (void) sqlite3_bind_int64(stmt, 3, writer->mtime);
+        if (!ph_import_writer_run(writer, stmt, 0, NULL, error))
+            return FALSE;
+    }
+
+    if (!ph_database_release(writer->database, PH_IMPORT_WRITER_SAVEPOINT,
+                error))
+        return FALSE;
+
+    g_free(writer->filename);
+    writer->filename = NULL;
+    ++writer->files;
+    return TRUE;
+}
+
+/*
+ * Undo everything stored from the current file, keeping the files before
+ * it.  No-op if no file has been started.  Returns FALSE on error.
+ */
+gboolean
+ph_import_writer_abort_file(PHImportWriter *writer,
+                            GError **error)
+{
+    g_return_val_if_fail(writer != NULL, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    if (writer->filename == NULL)
+        return TRUE;
+
+    writer->pending_count = 0;
+    g_free(writer->filename);
+    writer->filename = NULL;
+
+    return ph_database_rollback_to(writer->database,
+            PH_IMPORT_WRITER_SAVEPOINT, error);
+}
+
+/* Records {{{1 */
+
+/*
+ * Check whether the database already contains exactly what a geocache record
+ * would write, as decided by the stored hash, and set known to whether it
+ * contains the geocache at all.  Other waypoints are left to the upsert,
+ * which does not touch unchanged rows.  Returns 1 if the record is
+ * unchanged, 0 if it has to be written and -1 on error.
+ */
+static gint
+ph_import_writer_unchanged(PHImportWriter *writer,
+                           const PHImportRecord *record,
+                           gboolean *known,
+                           GError **error)
+{
+    sqlite3_stmt *stmt = writer->geocache_hash;
+    gint status, result = 0;
+
+    *known = FALSE;
+    if (record->geocache == NULL)
+        return 0;
+
+    ph_import_writer_bind_text(stmt, 1, record->waypoint.id);
+
+    status = ph_database_step(writer->database, stmt, error);
+    *known = (status == SQLITE_ROW);
+    if (status == SQLITE_ROW)
+        result = (sqlite3_column_type(stmt, 0) != SQLITE_NULL &&
+                (guint64) sqlite3_column_int64(stmt, 0) == record->hash);
+    else if (status != SQLITE_DONE)
+        result = -1;
+    (void) sqlite3_reset(stmt);
+
+    return result;
+}
+
+/*
+ * Store everything read from a <wpt> element, unless it is already in the
+ * database in exactly this form.  Returns FALSE on error.
+ */
+gboolean
+ph_import_writer_store_record(PHImportWriter *writer,
+                              const PHImportRecord *record,
+                              GError **error)
+{
+    gint64 start;
+    gboolean success;
+
+    g_return_val_if_fail(writer != NULL, FALSE);
+    g_return_val_if_fail(record != NULL, FALSE);
+    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+    if (writer->profile == NULL)
+        return ph_import_writer_store(writer, record, error);
+
+    start = g_get_monotonic_time();
+    success = ph_import_writer_store(writer, record, error);
+    writer->time += g_get_monotonic_time() - start;
+
+    return success;
+}
+
+/*
+ * Actually store a record for ph_import_writer_store_record().
+ */
+static gboolean
+ph_import_writer_store(PHImportWriter *writer,
+                       const PHImportRecord *record,
+                       GError **error)
+{
+    const gchar *id = record->waypoint.id;
+    gboolean success = TRUE, known;
+    guint rows = writer->rows, i;
+
+    writer->arena_peak = MAX(writer->arena_peak,
+            ph_arena_get_size(record->arena));
+    writer->arena_allocations += ph_arena_get_allocations(record->arena);
+
+    switch (ph_import_writer_unchanged(writer, record, &known, error)) {
+    case 1:
+        /* the geocache, its waypoint, logs and trackables */
+        writer->unchanged += 2;
+        if (record->logs != NULL)
+            writer->unchanged += record->logs->len;
+        if (record->trackables != NULL)
+            writer->unchanged += record->trackables->len;
+        writer->unchanged += record->known_logs;
+        ++writer->skipped;
+        return TRUE;
+    case -1:
+        return FALSE;
+    }
+
+    /* logs skipped by the parser are stored already */
+    writer->unchanged += record->known_logs;
+
+    if (record->logs != NULL) {
+        for (i = 0; success && i < record->logs->len; ++i) {
+            PHLog log = g_array_index(record->logs, PHLog, i);
+            if (writer->retention != NULL &&
+                    !ph_log_retention_keeps(writer->retention, &log,
+                        ph_import_writer_log_rank(record->logs, i))) {
+                ++writer->expired;
+                continue;
+            }
+            log.geocache_id = (gchar *) id;
+            success = ph_import_writer_add_log(writer, &log, error);
+        }
+        if (success)
+            success = ph_import_writer_flush(writer, error);
+        else
+            writer->pending_count = 0;
+    }
+
+    if (success && record->trackables != NULL) {
+        /* a new geocache has no trackables yet; not asking spares a full
+         * table scan while the indexes are dropped for a bulk import */
+        if (known)
+            success = ph_import_writer_clear_trackables(writer, id, error);
+        for (i = 0; success && i < record->trackables->len; ++i) {
+            PHTrackable trackable =
+                g_array_index(record->trackables, PHTrackable, i);
+            trackable.geocache_id = (gchar *) id;
+            success = ph_import_writer_store_trackable(writer, &trackable,
+                    error);
+        }
+    }
+
+    if (success && record->geocache != NULL) {
+        PHGeocache gc = *record->geocache;
+        gc.id = (gchar *) id;
+        success = ph_import_writer_store_geocache(writer, &gc, record->hash,
+                error);
+    }
+
+    if (success)
+        success = ph_import_writer_store_waypoint(writer, &record->waypoint,
+                error);
+
+    if (success && writer->rows == rows)
+        ++writer->skipped;
+    else if (success)
+        g_hash_table_insert(writer->changed, g_strdup(
+                    (record->waypoint.geocache_id == NULL)
+                    ? id : record->waypoint.geocache_id), NULL);
+
+    return success;
+}
+
+/* Statistics {{{1 */
+
+/*
+ * Get the number of rows written to the database so far.
+ */
+guint
+ph_import_writer_get_rows(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->rows;
+}
+
+/*
+ * Get the number of files which have been stored completely.
+ */
+guint
+ph_import_writer_get_files(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->files;
+}
+
+/*
+ * Get the number of rows which did not exist before.
+ */
+guint
+ph_import_writer_get_inserted(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->inserted;
+}
+
+/*
+ * Get the number of existing rows which have been changed.
+ */
+guint
+ph_import_writer_get_updated(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->updated;
+}
+
+/*
+ * Get the number of logs which have been left out because the retention
+ * rules would remove them.
+ */
+guint
+ph_import_writer_get_expired(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->expired;
+}
+
+/*
+ * Get the number of rows which have been left alone because the database
+ * already contained them in this form.
+ */
+guint
+ph_import_writer_get_unchanged(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->unchanged;
+}
+
+/*
+ * Get the number of records which have been skipped because the database
+ * already contained them.
+ */
+guint
+ph_import_writer_get_skipped(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->skipped;
+}
+
+/*
+ * Get the largest number of bytes a single record has allocated from its
+ * arena.
+ */
+gsize
+ph_import_writer_get_arena_peak(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->arena_peak;
+}
+
+/*
+ * Get the total number of allocations from the arenas of all records
+ * stored so far.
+ */
+guint
+ph_import_writer_get_arena_allocations(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, 0);
+
+    return writer->arena_allocations;
+}
+
+/*
+ * Get the set of IDs of all geocaches written so far, including those whose
+ * additional waypoints have been written.  The hash table is owned by the
+ * writer; its keys are the IDs.
+ */
+GHashTable *
+ph_import_writer_get_changed(const PHImportWriter *writer)
+{
+    g_return_val_if_fail(writer != NULL, NULL);
+
+    return writer->changed;
+}
+
+/* }}} */
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -0,0 +1,63 @@
+/*
+ * plastichunt: desktop geocaching browser
+ *
+ * Copyright © 2012 Michael Schutte <michi@uiae.at>
+ *
+ * This program is free software.  You are permitted to use, copy, modify and
+ * redistribute it according to the terms of the MIT License.  See the COPYING
+ * file for details.
+ */
+
+#ifndef PH_IMPORT_WRITER_H
+#define PH_IMPORT_WRITER_H
+
+/* Includes {{{1 */
+
+#include "ph-database.h"
+#include "ph-import-parser.h"
+
+/* Data types {{{1 */
+
+/*
+ * Set of prepared statements used to store imported data.
+ */
+typedef struct _PHImportWriter PHImportWriter;
+
+/* Public interface {{{1 */
+
+PHImportWriter *ph_import_writer_new(PHDatabase *database,
+                                     GError **error);
+void ph_import_writer_free(PHImportWriter *writer);
+void ph_import_writer_set_profile(PHImportWriter *writer,
+                                  PHImportProfile *profile);
+void ph_import_writer_set_log_retention(PHImportWriter *writer,
+                                        const PHLogRetention *retention);
+
+gboolean ph_import_writer_store_record(PHImportWriter *writer,
+                                       const PHImportRecord *record,
+                                       GError **error);
+
+gboolean ph_import_writer_begin_file(PHImportWriter *writer,
+                                     const gchar *filename,
+                                     GError **error);
+gboolean ph_import_writer_end_file(PHImportWriter *writer,
+                                   GError **error);
+gboolean ph_import_writer_abort_file(PHImportWriter *writer,
+                                     GError **error);
+
+guint ph_import_writer_get_files(const PHImportWriter *writer);
+guint ph_import_writer_get_rows(const PHImportWriter *writer);
+guint ph_import_writer_get_inserted(const PHImportWriter *writer);
+guint ph_import_writer_get_updated(const PHImportWriter *writer);
+guint ph_import_writer_get_unchanged(const PHImportWriter *writer);
+guint ph_import_writer_get_expired(const PHImportWriter *writer);
+guint ph_import_writer_get_skipped(const PHImportWriter *writer);
+gsize ph_import_writer_get_arena_peak(const PHImportWriter *writer);
+guint ph_import_writer_get_arena_allocations(const PHImportWriter *writer);
+GHashTable *ph_import_writer_get_changed(const PHImportWriter *writer);
+
+/* }}} */
+
+#endif
+
+/* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -12,6 +12,15 @@
 
 #include "ph-log.h"
 
+/* Forward declarations {{{1 */
+
+static sqlite3_stmt *ph_logs_prepare_retention(
+    PHDatabase *database, const gchar *query,
+    const PHLogRetention *retention, GError **error);
+static gint ph_logs_delete(PHDatabase *database, const gchar *condition,
+                           const PHLogRetention *retention,
+                           GHashTable *affected, GError **error);
+
 /* Database retrieval and storage {{{1 */
 
 /*
@@ -24,7 +33,6 @@ ph_logs_load_by_geocache_id(GList **list,
                             const gchar *id,
                             GError **error)
 {
-    char *query;
     sqlite3_stmt *stmt;
     GList *result = NULL;
     gint status;
@@ -33,14 +41,14 @@ ph_logs_load_by_geocache_id(GList **list,
     g_return_val_if_fail(id != NULL, FALSE);
     g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-    query = sqlite3_mprintf("SELECT id, geocache_id, type, logger, "
-            "logged, details FROM logs WHERE geocache_id = %Q "
+    stmt = ph_database_prepare_cached(database,
+            "SELECT id, geocache_id, type, logger, "
+            "logged, details FROM logs WHERE geocache_id = ? "
             "ORDER BY logged ASC",  /* building list in reverse */
-            id);
-    stmt = ph_database_prepare(database, query, error);
-    sqlite3_free(query);
+            error);
     if (stmt == NULL)
         return FALSE;
+    (void) sqlite3_bind_text(stmt, 1, id, -1, SQLITE_STATIC);
 
     while ((status = ph_database_step(database, stmt, error)) == SQLITE_ROW) {
         PHLog *current = g_new(PHLog, 1);
@@ -51,12 +59,11 @@ ph_logs_load_by_geocache_id(GList **list,
         current->logger = g_strdup((const gchar *)
                 sqlite3_column_text(stmt, 3));
         current->logged = sqlite3_column_int64(stmt, 4);
-        current->details = g_strdup((const gchar *)
-                sqlite3_column_text(stmt, 5));
+        current->details = ph_database_column_text(stmt, 5);
         result = g_list_prepend(result, current);
     }
 
-    (void) sqlite3_finalize(stmt);
+    ph_database_release_cached(database, stmt);
 
     if (status == SQLITE_DONE) {
         *list = result;
@@ -69,9 +76,17 @@ ph_logs_load_by_geocache_id(GList **list,
 }
 
 /*
- * Store the given log in the database.  Uses an INSERT OR REPLACE statement
- * to avoid duplicates, so the (id, geocache_id) tuple must be unique.
- * Returns FALSE on error.
+ * Columns written by ph_log_store(), starting with the primary key.
+ */
+static const gchar *const ph_log_columns[] = {
+    "id", "geocache_id", "type", "logger", "logged", "details", NULL
+};
+
+/*
+ * Store the given log in the database.  A log with the same (id,
+ * geocache_id) tuple is updated, but only if anything has changed.  The
+ * details are compressed if the database is set up to do so.  Returns FALSE
+ * on error.
  */
 gboolean
 ph_log_store(const PHLog *log,
@@ -79,21 +94,180 @@ ph_log_store(const PHLog *log,
              GError **error)
 {
     char *query;
+    gchar *upsert;
     gboolean success;
 
     g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-    query = sqlite3_mprintf("INSERT OR REPLACE INTO logs "
+    upsert = ph_database_upsert_clause(ph_log_columns, 2);
+    query = sqlite3_mprintf("INSERT INTO logs "
             "(id, geocache_id, type, logger, logged, details) "
-            "VALUES (%d, %Q, %d, %Q, %ld, %Q)",
+            "VALUES (%d, %Q, %d, %Q, %ld, ph_pack(%Q))%s",
             log->id, log->geocache_id, log->type, log->logger, log->logged,
-            log->details);
+            log->details, upsert);
     success = ph_database_exec(database, query, error);
+    g_free(upsert);
     sqlite3_free(query);
 
     return success;
 }
 
+/* Retention {{{1 */
+
+/*
+ * Prepare a query on the logs table with the retention rules bound to the
+ * parameters it uses: :own is the name of the user, :cutoff the cutoff and
+ * :max_logs the number of logs kept.  Returns NULL on error.
+ */
+static sqlite3_stmt *
+ph_logs_prepare_retention(PHDatabase *database,
+                          const gchar *query,
+                          const PHLogRetention *retention,
+                          GError **error)
+{
+    sqlite3_stmt *stmt;
+    gint index;
+
+    stmt = ph_database_prepare(database, query, error);
+    if (stmt == NULL)
+        return NULL;
+
+    index = sqlite3_bind_parameter_index(stmt, ":own");
+    if (index > 0 && retention->own_logger != NULL)
+        (void) sqlite3_bind_text(stmt, index, retention->own_logger, -1,
+                SQLITE_STATIC);
+    index = sqlite3_bind_parameter_index(stmt, ":cutoff");
+    if (index > 0)
+        (void) sqlite3_bind_int64(stmt, index, retention->cutoff);
+    index = sqlite3_bind_parameter_index(stmt, ":max_logs");
+    if (index > 0)
+        (void) sqlite3_bind_int(stmt, index, retention->max_logs);
+
+    return stmt;
+}
+
+/*
+ * Remove the logs matching a condition which uses the parameters of
+ * ph_logs_prepare_retention().  The IDs of the geocaches which lose logs are
+ * added to the affected set unless it is NULL.  Returns the number of
+ * deleted rows, or -1 on error.
+ */
+static gint
+ph_logs_delete(PHDatabase *database,
+               const gchar *condition,
+               const PHLogRetention *retention,
+               GHashTable *affected,
+               GError **error)
+{
+    sqlite3_stmt *stmt;
+    gchar *query;
+    gint status, result = -1;
+
+    if (affected != NULL) {
+        query = g_strdup_printf("SELECT DISTINCT geocache_id FROM logs "
+                "WHERE %s", condition);
+        stmt = ph_logs_prepare_retention(database, query, retention, error);
+        g_free(query);
+        if (stmt == NULL)
+            return -1;
+
+        while ((status = ph_database_step(database, stmt, error)) ==
+                SQLITE_ROW) {
+            const gchar *id = (const gchar *) sqlite3_column_text(stmt, 0);
+            if (id != NULL)
+                g_hash_table_replace(affected, g_strdup(id), NULL);
+        }
+        (void) sqlite3_finalize(stmt);
+        if (status != SQLITE_DONE)
+            return -1;
+    }
+
+    query = g_strdup_printf("DELETE FROM logs WHERE %s", condition);
+    stmt = ph_logs_prepare_retention(database, query, retention, error);
+    g_free(query);
+    if (stmt == NULL)
+        return -1;
+
+    if (ph_database_step(database, stmt, error) == SQLITE_DONE)
+        result = sqlite3_changes(sqlite3_db_handle(stmt));
+    (void) sqlite3_finalize(stmt);
+
+    return result;
+}
+
+/*
+ * Remove the logs which are older than the cutoff or are not among the
+ * newest max_logs logs of their geocache, each with a single statement.
+ * Finds, attendances and webcam photos of the user stay in the database
+ * either way.  If affected is not NULL, the IDs of the geocaches which have
+ * lost logs are added to it; it has to free its keys with g_free().  Returns
+ * the number of removed logs, or -1 on error.
+ */
+gint
+ph_logs_apply_retention(PHDatabase *database,
+                        const PHLogRetention *retention,
+                        GHashTable *affected,
+                        GError **error)
+{
+    gchar *own, *condition;
+    gint deleted, result = 0;
+
+    g_return_val_if_fail(database != NULL, -1);
+    g_return_val_if_fail(retention != NULL, -1);
+    g_return_val_if_fail(error == NULL || *error == NULL, -1);
+
+    own = g_strdup_printf("(:own IS NOT NULL AND logger IS :own AND "
+            "type IN (%d, %d, %d))", PH_LOG_TYPE_FOUND,
+            PH_LOG_TYPE_ATTENDED, PH_LOG_TYPE_WEBCAM);
+
+    if (retention->cutoff != 0) {
+        condition = g_strdup_printf("logged < :cutoff AND NOT %s", own);
+        deleted = ph_logs_delete(database, condition, retention, affected,
+                error);
+        g_free(condition);
+        result = (deleted < 0) ? -1 : result + deleted;
+    }
+
+    if (result >= 0 && retention->max_logs != 0) {
+        condition = g_strdup_printf("serial IN "
+                "(SELECT serial FROM (SELECT serial, ROW_NUMBER() OVER "
+                "(PARTITION BY geocache_id ORDER BY logged DESC, id DESC) "
+                "AS rank FROM logs) WHERE rank > :max_logs) AND NOT %s", own);
+        deleted = ph_logs_delete(database, condition, retention, affected,
+                error);
+        g_free(condition);
+        result = (deleted < 0) ? -1 : result + deleted;
+    }
+
+    g_free(own);
+    return result;
+}
+
+/*
+ * Check whether the retention rules keep a log which is preceded by rank
+ * newer logs of the same geocache, in the order ph_logs_apply_retention()
+ * uses.  Imports drop the logs which would be removed right away, so that
+ * they do not come back every time.
+ */
+gboolean
+ph_log_retention_keeps(const PHLogRetention *retention,
+                       const PHLog *log,
+                       guint rank)
+{
+    g_return_val_if_fail(retention != NULL, TRUE);
+    g_return_val_if_fail(log != NULL, TRUE);
+
+    if (retention->own_logger != NULL &&
+            g_strcmp0(log->logger, retention->own_logger) == 0 &&
+            (log->type == PH_LOG_TYPE_FOUND ||
+             log->type == PH_LOG_TYPE_ATTENDED ||
+             log->type == PH_LOG_TYPE_WEBCAM))
+        return TRUE;
+    if (retention->cutoff != 0 && log->logged < retention->cutoff)
+        return FALSE;
+    return (retention->max_logs == 0 || rank < retention->max_logs);
+}
+
 /* Memory management {{{1 */
 
 /*
@@ -121,6 +295,19 @@ ph_logs_free(GList *logs)
     g_list_free_full(logs, (GDestroyNotify) ph_log_free);
 }
 
+/*
+ * Free a set of retention rules.  Safe no-op if called with NULL.
+ */
+void
+ph_log_retention_free(PHLogRetention *retention)
+{
+    if (retention == NULL)
+        return;
+
+    g_free(retention->own_logger);
+    g_free(retention);
+}
+
 /* }}} */
 
 /* vim: set sw=4 sts=4 et cino=(0,Ws tw=80 fdm=marker: */
@@ -54,6 +54,16 @@ typedef struct _PHLog {
     gchar *details;         /* logger's message */
 } PHLog;
 
+/*
+ * Rules deciding which logs are removed from the database after an import.
+ * The user's own finds are always kept.
+ */
+typedef struct _PHLogRetention {
+    guint max_logs;         /* newest logs kept per geocache, 0 for all */
+    glong cutoff;           /* older logs are removed, 0 to keep them */
+    gchar *own_logger;      /* name of the user, or NULL */
+} PHLogRetention;
+
 /* Public interface {{{1 */
 
 gboolean ph_logs_load_by_geocache_id(GList **list,
@@ -64,8 +74,17 @@ gboolean ph_log_store(const PHLog *log,
                       PHDatabase *database,
                       GError **error);
 
+gint ph_logs_apply_retention(PHDatabase *database,
+                             const PHLogRetention *retention,
+                             GHashTable *affected,
+                             GError **error);
+gboolean ph_log_retention_keeps(const PHLogRetention *retention,
+                                const PHLog *log,
+                                guint rank);
+
 void ph_log_free(PHLog *log);
 void ph_logs_free(GList *list);
+void ph_log_retention_free(PHLogRetention *retention);
 
 /* }}} */
 
@@ -769,6 +769,7 @@ ph_main_window_open_database(PHMainWindow *window,
             GtkRecentManager *recent = gtk_recent_manager_get_default();
             gchar *uri;
 
+            ph_config_setup_database(database);
             ph_main_window_set_database(window, database);
             g_object_unref(database);
 
@@ -27,9 +27,12 @@
 static PHDatabase *ph_main_open_database(const gchar *path, GError **error);
 
 static gboolean ph_main_import(PHDatabase *database, const gchar *path,
+                               gint threads, gboolean profile,
                                GError **error_out);
 static void ph_main_import_filename(PHImportProcess *process, gchar *filename,
                                     gpointer data);
+static void ph_main_import_bytes(PHImportProcess *process, guint64 bytes,
+                                 gpointer data);
 static void ph_main_import_error(PHProcess *process, GError *error_in,
                                  gpointer data);
 static void ph_main_import_stop(PHProcess *process, gpointer data);
@@ -73,17 +76,24 @@ ph_main_open_database(const gchar *path,
     else
         result = ph_database_new(path, TRUE, error);
 
+    if (result != NULL)
+        ph_config_setup_database(result);
+
     return result;
 }
 
 /* Importing {{{1 */
 
 /*
- * Import the given GPX file into the database.
+ * Import the given GPX file into the database, parsing it with the given
+ * number of threads.  With profile set, the time spent per GPX element is
+ * written to the debug log.
  */
 static gboolean
 ph_main_import(PHDatabase *database,
                const gchar *path,
+               gint threads,
+               gboolean profile,
                GError **error_out)
 {
     GError *error_in = NULL;
@@ -93,8 +103,14 @@ ph_main_import(PHDatabase *database,
     loop = g_main_loop_new(NULL, FALSE);
 
     process = ph_import_process_new(database, path);
+    g_object_set(process, "threads", (guint) MAX(threads, 1),
+            "profile", profile, NULL);
+    ph_import_process_set_log_retention(PH_IMPORT_PROCESS(process),
+            ph_config_get_log_retention());
     g_signal_connect(process, "filename-notify",
             G_CALLBACK(ph_main_import_filename), NULL);
+    g_signal_connect(process, "bytes-notify",
+            G_CALLBACK(ph_main_import_bytes), NULL);
     g_signal_connect(process, "error-notify",
             G_CALLBACK(ph_main_import_error), &error_in);
     g_signal_connect(process, "stop-notify",
@@ -126,6 +142,17 @@ ph_main_import_filename(PHImportProcess *process,
     fprintf(stderr, _("Importing `%s'...\n"), filename);
 }
 
+/*
+ * Print how much has been read from a pipe, whose size is unknown.
+ */
+static void
+ph_main_import_bytes(PHImportProcess *process,
+                     guint64 bytes,
+                     gpointer data)
+{
+    fprintf(stderr, _("%u MiB read...\n"), (guint) (bytes >> 20));
+}
+
 /*
  * Propagate an error while importing a file.
  */
@@ -254,6 +281,7 @@ main(int argc,
     gchar *database_filename = NULL;
     gchar *query = NULL;
     gchar **import_filenames = NULL;
+    gint import_threads = 1;
     PHDatabase *database = NULL;
     gboolean verbose = FALSE;
     gboolean debug = FALSE;
@@ -267,8 +295,13 @@ main(int argc,
             N_("FILENAME") },
         { "import", 'i', 0, G_OPTION_ARG_FILENAME_ARRAY,
             &import_filenames,
-            N_("Import a GPX file (and do not start the GUI)."),
+            N_("Import a GPX file, or standard input for `-' "
+                    "(and do not start the GUI)."),
             N_("FILENAME") },
+        { "threads", 'j', 0, G_OPTION_ARG_INT,
+            &import_threads,
+            N_("Use N threads to parse the imported files."),
+            N_("N") },
         { "query", 'q', 0, G_OPTION_ARG_STRING,
             &query,
             N_("Search for geocaches matching certain attributes "
@@ -320,7 +353,8 @@ main(int argc,
     if (success && import_filenames != NULL) {
         gchar **import_filename = import_filenames;
         while (success && *import_filename != NULL) {
-            success = ph_main_import(database, *import_filename, &error);
+            success = ph_main_import(database, *import_filename,
+                    import_threads, debug, &error);
             ++import_filename;
         }
     }
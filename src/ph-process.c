@@ -31,23 +31,58 @@ static guint ph_process_signals[PH_PROCESS_SIGNAL_COUNT];
 #define PH_PROCESS_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), \
             PH_TYPE_PROCESS, PHProcessPrivate))
 
+/*
+ * Progress to be reported in the main thread.  The fraction is protected by
+ * the mutex of the process.
+ */
+typedef struct _PHProcessProgressNotification {
+    PHProcess *process;
+    gdouble fraction;
+} PHProcessProgressNotification;
+
 /*
  * Private data.
  */
 struct _PHProcessPrivate {
-    PHProcessState state;       /* current state of the process */
+    volatile gint state;        /* current PHProcessState, atomic */
+
+    /* threaded processes only */
+    GMutex mutex;               /* protects the following */
+    PHProcessProgressNotification *progress;
+                                /* scheduled, still taking newer values */
 };
 
+/*
+ * Error to be reported in the main thread.
+ */
+typedef struct _PHProcessErrorNotification {
+    PHProcess *process;
+    GError *error;
+} PHProcessErrorNotification;
+
 /* Forward declarations {{{1 */
 
 static void ph_process_class_init(PHProcessClass *cls);
 static void ph_process_init(PHProcess *process);
+static void ph_process_finalize(GObject *object);
 
 static void ph_process_step(PHProcess *process);
+static gpointer ph_process_work(gpointer data);
 static gboolean ph_process_do_setup(gpointer data);
 static gboolean ph_process_do_step(gpointer data);
 static gboolean ph_process_do_finish(gpointer data);
 
+static void ph_process_notify_progress(PHProcess *process,
+                                       gdouble fraction);
+static void ph_process_notify_error(PHProcess *process,
+                                    GError *error);
+static void ph_process_notify_stop(PHProcess *process);
+static gboolean ph_process_emit_progress(gpointer data);
+static gboolean ph_process_emit_error(gpointer data);
+static gboolean ph_process_emit_stop(gpointer data);
+static void ph_process_progress_notification_free(gpointer data);
+static void ph_process_error_notification_free(gpointer data);
+
 /* Standard GObject code {{{1 */
 
 G_DEFINE_ABSTRACT_TYPE(PHProcess, ph_process, G_TYPE_OBJECT)
@@ -58,6 +93,10 @@ G_DEFINE_ABSTRACT_TYPE(PHProcess, ph_process, G_TYPE_OBJECT)
 static void
 ph_process_class_init(PHProcessClass *cls)
 {
+    GObjectClass *g_obj_cls = G_OBJECT_CLASS(cls);
+
+    g_obj_cls->finalize = ph_process_finalize;
+
     g_type_class_add_private(cls, sizeof(PHProcessPrivate));
 
     ph_process_signals[PH_PROCESS_SIGNAL_PROGRESS_NOTIFY] =
@@ -92,19 +131,38 @@ ph_process_init(PHProcess *process)
     PHProcessPrivate *priv = PH_PROCESS_GET_PRIVATE(process);
 
     process->priv = priv;
+    g_mutex_init(&priv->mutex);
+}
+
+/*
+ * Instance destruction code.
+ */
+static void
+ph_process_finalize(GObject *object)
+{
+    PHProcess *process = PH_PROCESS(object);
+
+    g_mutex_clear(&process->priv->mutex);
+
+    if (G_OBJECT_CLASS(ph_process_parent_class)->finalize != NULL)
+        G_OBJECT_CLASS(ph_process_parent_class)->finalize(object);
 }
 
 /* Starting and running {{{1 */
 
 /*
- * Add a step to the idle queue.
+ * Add a step to the idle queue.  Threaded processes are driven by
+ * ph_process_work() instead.
  */
 static void
 ph_process_step(PHProcess *process)
 {
     GSourceFunc func;
 
-    switch (process->priv->state) {
+    if (PH_PROCESS_GET_CLASS(process)->threaded)
+        return;
+
+    switch (g_atomic_int_get(&process->priv->state)) {
     case PH_PROCESS_STATE_BEFORE_SETUP:
         func = ph_process_do_setup;
         break;
@@ -123,6 +181,33 @@ ph_process_step(PHProcess *process)
         (void) g_idle_add(func, process);
 }
 
+/*
+ * Main function of the thread running a threaded process: run all stages
+ * one after the other.  The reference to the process held by the thread is
+ * passed on to the final stop-notify emission.
+ */
+static gpointer
+ph_process_work(gpointer data)
+{
+    PHProcess *process = PH_PROCESS(data);
+
+    for (;;) {
+        switch (g_atomic_int_get(&process->priv->state)) {
+        case PH_PROCESS_STATE_BEFORE_SETUP:
+            (void) ph_process_do_setup(process);
+            break;
+        case PH_PROCESS_STATE_RUNNING:
+            (void) ph_process_do_step(process);
+            break;
+        case PH_PROCESS_STATE_BEFORE_FINISH:
+            (void) ph_process_do_finish(process);
+            break;
+        default:
+            return NULL;
+        }
+    }
+}
+
 /*
  * Run the setup stage of the process.
  */
@@ -137,13 +222,13 @@ ph_process_do_setup(gpointer data)
     success = cls->setup(process, &error);
 
     if (success)
-        process->priv->state = PH_PROCESS_STATE_RUNNING;
+        /* unless the process has been stopped in the meantime */
+        (void) g_atomic_int_compare_and_exchange(&process->priv->state,
+                PH_PROCESS_STATE_BEFORE_SETUP, PH_PROCESS_STATE_RUNNING);
     else {
-        process->priv->state = PH_PROCESS_STATE_BEFORE_FINISH;
-        g_signal_emit(process,
-                ph_process_signals[PH_PROCESS_SIGNAL_ERROR_NOTIFY],
-                0, error);
-        g_error_free(error);
+        g_atomic_int_set(&process->priv->state,
+                PH_PROCESS_STATE_BEFORE_FINISH);
+        ph_process_notify_error(process, error);
     }
 
     ph_process_step(process);
@@ -162,24 +247,20 @@ ph_process_do_step(gpointer data)
     GError *error = NULL;
     gboolean still_running;
 
-    still_running = (process->priv->state == PH_PROCESS_STATE_RUNNING);
+    still_running = (g_atomic_int_get(&process->priv->state) ==
+            PH_PROCESS_STATE_RUNNING);
     still_running = still_running && cls->step(process, &fraction, &error);
 
     if (still_running) {
-        g_signal_emit(process,
-                ph_process_signals[PH_PROCESS_SIGNAL_PROGRESS_NOTIFY],
-                0, fraction);
+        ph_process_notify_progress(process, fraction);
         return TRUE;
     }
     else {
-        process->priv->state = PH_PROCESS_STATE_BEFORE_FINISH;
+        g_atomic_int_set(&process->priv->state,
+                PH_PROCESS_STATE_BEFORE_FINISH);
 
-        if (error != NULL) {
-            g_signal_emit(process,
-                    ph_process_signals[PH_PROCESS_SIGNAL_ERROR_NOTIFY],
-                    0, error);
-            g_error_free(error);
-        }
+        if (error != NULL)
+            ph_process_notify_error(process, error);
 
         ph_process_step(process);
         return FALSE;
@@ -198,37 +279,189 @@ ph_process_do_finish(gpointer data)
     gboolean success;
 
     success = cls->finish(process, &error);
-    process->priv->state = PH_PROCESS_STATE_STOPPED;
+    g_atomic_int_set(&process->priv->state, PH_PROCESS_STATE_STOPPED);
+
+    if (!success)
+        ph_process_notify_error(process, error);
+    ph_process_notify_stop(process);
+
+    return FALSE;
+}
+
+/* Notification {{{1 */
+
+/*
+ * Report progress.  Threaded processes only schedule an emission in the main
+ * thread if there is none pending yet; otherwise, the pending one takes the
+ * new value, unless ph_process_flush_progress() has been called since.
+ */
+static void
+ph_process_notify_progress(PHProcess *process,
+                           gdouble fraction)
+{
+    PHProcessProgressNotification *notification;
+    gboolean schedule;
 
-    if (!success) {
+    if (!PH_PROCESS_GET_CLASS(process)->threaded) {
+        g_signal_emit(process,
+                ph_process_signals[PH_PROCESS_SIGNAL_PROGRESS_NOTIFY],
+                0, fraction);
+        return;
+    }
+
+    g_mutex_lock(&process->priv->mutex);
+    notification = process->priv->progress;
+    schedule = (notification == NULL);
+    if (schedule) {
+        notification = g_new(PHProcessProgressNotification, 1);
+        notification->process = g_object_ref(process);
+        process->priv->progress = notification;
+    }
+    notification->fraction = fraction;
+    g_mutex_unlock(&process->priv->mutex);
+
+    if (schedule)
+        g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+                ph_process_emit_progress, notification,
+                ph_process_progress_notification_free);
+}
+
+/*
+ * Report an error and free it, in the main thread for threaded processes.
+ */
+static void
+ph_process_notify_error(PHProcess *process,
+                        GError *error)
+{
+    PHProcessErrorNotification *notification;
+
+    if (!PH_PROCESS_GET_CLASS(process)->threaded) {
         g_signal_emit(process,
                 ph_process_signals[PH_PROCESS_SIGNAL_ERROR_NOTIFY],
                 0, error);
         g_error_free(error);
+        return;
     }
 
+    notification = g_new(PHProcessErrorNotification, 1);
+    notification->process = g_object_ref(process);
+    notification->error = error;
+    g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+            ph_process_emit_error, notification,
+            ph_process_error_notification_free);
+}
+
+/*
+ * Report that the process has stopped.  For threaded processes, this takes
+ * over the reference held by the thread.
+ */
+static void
+ph_process_notify_stop(PHProcess *process)
+{
+    if (!PH_PROCESS_GET_CLASS(process)->threaded)
+        (void) ph_process_emit_stop(process);
+    else
+        g_main_context_invoke_full(NULL, G_PRIORITY_DEFAULT,
+                ph_process_emit_stop, process, g_object_unref);
+}
+
+/*
+ * Emit the signals in the main thread.
+ */
+static gboolean
+ph_process_emit_progress(gpointer data)
+{
+    PHProcessProgressNotification *notification =
+        (PHProcessProgressNotification *) data;
+    PHProcess *process = notification->process;
+    gdouble fraction;
+
+    g_mutex_lock(&process->priv->mutex);
+    fraction = notification->fraction;
+    if (process->priv->progress == notification)
+        process->priv->progress = NULL;
+    g_mutex_unlock(&process->priv->mutex);
+
     g_signal_emit(process,
+            ph_process_signals[PH_PROCESS_SIGNAL_PROGRESS_NOTIFY],
+            0, fraction);
+    return FALSE;
+}
+
+static gboolean
+ph_process_emit_error(gpointer data)
+{
+    PHProcessErrorNotification *notification =
+        (PHProcessErrorNotification *) data;
+
+    g_signal_emit(notification->process,
+            ph_process_signals[PH_PROCESS_SIGNAL_ERROR_NOTIFY],
+            0, notification->error);
+    return FALSE;
+}
+
+static gboolean
+ph_process_emit_stop(gpointer data)
+{
+    g_signal_emit(PH_PROCESS(data),
             ph_process_signals[PH_PROCESS_SIGNAL_STOP_NOTIFY],
             0);
-
     return FALSE;
 }
 
+/*
+ * Free a progress notification after it has been emitted.
+ */
+static void
+ph_process_progress_notification_free(gpointer data)
+{
+    PHProcessProgressNotification *notification =
+        (PHProcessProgressNotification *) data;
+
+    g_object_unref(notification->process);
+    g_free(notification);
+}
+
+/*
+ * Free an error notification after it has been emitted.
+ */
+static void
+ph_process_error_notification_free(gpointer data)
+{
+    PHProcessErrorNotification *notification =
+        (PHProcessErrorNotification *) data;
+
+    g_object_unref(notification->process);
+    g_error_free(notification->error);
+    g_free(notification);
+}
+
 /* Public interface {{{1 */
 
 /*
  * Start running the process.  Does nothing if it is running or has already
- * finished.
+ * finished.  Threaded processes get a thread of their own, which keeps a
+ * reference to the process until it has stopped; their signals are still
+ * emitted in the main thread.
  */
 void
 ph_process_start(PHProcess *process)
 {
+    GThread *thread;
+
     g_return_if_fail(process != NULL && PH_IS_PROCESS(process));
 
-    if (process->priv->state == PH_PROCESS_STATE_CREATED) {
-        process->priv->state = PH_PROCESS_STATE_BEFORE_SETUP;
-        ph_process_step(process);
+    if (!g_atomic_int_compare_and_exchange(&process->priv->state,
+                PH_PROCESS_STATE_CREATED, PH_PROCESS_STATE_BEFORE_SETUP))
+        return;
+
+    if (PH_PROCESS_GET_CLASS(process)->threaded) {
+        thread = g_thread_new("process", ph_process_work,
+                g_object_ref(process));
+        g_thread_unref(thread);
     }
+    else
+        ph_process_step(process);
 }
 
 /*
@@ -236,11 +469,35 @@ ph_process_start(PHProcess *process)
  */
 void
 ph_process_stop(PHProcess *process)
+{
+    gint state;
+
+    g_return_if_fail(process != NULL && PH_IS_PROCESS(process));
+
+    /* the thread of a threaded process may change the state concurrently */
+    do {
+        state = g_atomic_int_get(&process->priv->state);
+        if (state == PH_PROCESS_STATE_BEFORE_FINISH ||
+                state == PH_PROCESS_STATE_STOPPED)
+            return;
+    } while (!g_atomic_int_compare_and_exchange(&process->priv->state,
+                state, PH_PROCESS_STATE_BEFORE_FINISH));
+}
+
+/*
+ * Let progress reported from now on be emitted after anything the caller
+ * schedules in the main thread next.  A pending emission keeps the fraction
+ * reported last.  Threaded processes call this before announcing a new phase
+ * of their work, so that its progress is not shown for the previous one.
+ */
+void
+ph_process_flush_progress(PHProcess *process)
 {
     g_return_if_fail(process != NULL && PH_IS_PROCESS(process));
 
-    if (process->priv->state != PH_PROCESS_STATE_STOPPED)
-        process->priv->state = PH_PROCESS_STATE_BEFORE_FINISH;
+    g_mutex_lock(&process->priv->mutex);
+    process->priv->progress = NULL;
+    g_mutex_unlock(&process->priv->mutex);
 }
 
 /*
@@ -251,7 +508,7 @@ ph_process_get_state(const PHProcess *process)
 {
     g_return_val_if_fail(process != NULL && PH_IS_PROCESS(process), 0);
 
-    return process->priv->state;
+    return g_atomic_int_get(&process->priv->state);
 }
 
 /* }}} */
@@ -45,6 +45,9 @@ struct _PHProcess {
 struct _PHProcessClass {
     GObjectClass parent_class;
 
+    /* run setup, step and finish in a thread of their own? */
+    gboolean threaded;
+
     /* virtual */
     gboolean (*setup)(PHProcess *process, GError **error);
     gboolean (*step)(PHProcess *process, gdouble *fraction, GError **error);
@@ -74,6 +77,8 @@ typedef enum _PHProcessState {
 void ph_process_start(PHProcess *process);
 void ph_process_stop(PHProcess *process);
 
+void ph_process_flush_progress(PHProcess *process);
+
 PHProcessState ph_process_get_state(const PHProcess *process);
 
 /* }}} */
@@ -39,9 +39,14 @@ static gdouble ph_query_get_double(const PHQueryToken *token);
 
 static const gchar *ph_query_sql_operator(PHQueryTokenType operator);
 
+static gchar *ph_query_match_expression(const gchar *value);
+
 static gboolean ph_query_text_condition(
     PHQueryParserState *state, const PHQueryCondition *condition,
     GError **error);
+static gboolean ph_query_match_condition(
+    PHQueryParserState *state, const PHQueryCondition *condition,
+    GError **error);
 static gboolean ph_query_dt_condition(
     PHQueryParserState *state, const PHQueryCondition *condition,
     GError **error);
@@ -86,6 +91,7 @@ enum _PHQueryTokenType {
     PH_QUERY_TOKEN_TYPE_LESSEQ,
     PH_QUERY_TOKEN_TYPE_GREATER,
     PH_QUERY_TOKEN_TYPE_GREATEREQ,
+    PH_QUERY_TOKEN_TYPE_MATCH,
     PH_QUERY_TOKEN_TYPE_PLUS,
     PH_QUERY_TOKEN_TYPE_MINUS,
     /* arbitrary-length literal tokens */
@@ -200,6 +206,8 @@ ph_query_get_token(PHQueryLexerState *state,
     }
     else if (*c == ':')
         state->type = PH_QUERY_TOKEN_TYPE_COLON;
+    else if (*c == '@')
+        state->type = PH_QUERY_TOKEN_TYPE_MATCH;
     /* ~ could also be ~= */
     else if (*c == '~') {
         state->type = PH_QUERY_TOKEN_TYPE_LIKE;
@@ -370,12 +378,15 @@ static const PHQueryConditionType ph_query_condition_types[] = {
     {"creator", ph_query_text_condition,        PH_DATABASE_TABLE_GEOCACHES},
     {"description", ph_query_text_condition,    PH_DATABASE_TABLE_GEOCACHES},
     {"difficulty", ph_query_dt_condition,       PH_DATABASE_TABLE_GEOCACHES},
+    {"hint",    ph_query_text_condition,        PH_DATABASE_TABLE_GEOCACHES},
     {"id",      ph_query_text_condition,        PH_DATABASE_TABLE_GEOCACHES},
+    {"logs",    ph_query_match_condition,       PH_DATABASE_TABLE_GEOCACHES},
     {"name",    ph_query_text_condition,        PH_DATABASE_TABLE_GEOCACHES},
     {"owner",   ph_query_text_condition,        PH_DATABASE_TABLE_GEOCACHES},
     {"size",    ph_query_size_condition,        PH_DATABASE_TABLE_GEOCACHES},
     {"summary", ph_query_text_condition,        PH_DATABASE_TABLE_GEOCACHES},
     {"terrain", ph_query_dt_condition,          PH_DATABASE_TABLE_GEOCACHES},
+    {"text",    ph_query_match_condition,       PH_DATABASE_TABLE_GEOCACHES},
     {"type",    ph_query_type_condition,        PH_DATABASE_TABLE_GEOCACHES}
 };
 
@@ -394,13 +405,16 @@ static const PHQueryConditionAlias ph_query_condition_aliases[] = {
     {"c", "creator"},
     {"d", "difficulty"},
     {"dt", "description"},
+    {"h", "hint"},
     {"i", "id"},
     {"k", "type"},
+    {"l", "logs"},
     {"n", "name"},
     {"o", "owner"},
     {"s", "size"},
     {"st", "summary"},
-    {"t", "terrain"}
+    {"t", "terrain"},
+    {"x", "text"}
 };
 
 /*
@@ -582,6 +596,48 @@ ph_query_get_string(const PHQueryToken *token)
     return result;
 }
 
+/*
+ * Turn the words of a full-text search into an FTS5 expression matching all
+ * of them.  Quoting each word keeps characters special to FTS5 from causing
+ * syntax errors; a trailing * still matches any word with that prefix.
+ * Returns NULL if there is no word at all.
+ */
+static gchar *
+ph_query_match_expression(const gchar *value)
+{
+    gchar **words = g_strsplit_set(value, " \t\n", -1), **word;
+    GString *result = g_string_new(NULL);
+
+    for (word = words; *word != NULL; ++word) {
+        gsize length = strlen(*word);
+        gboolean prefix = (length > 1 && (*word)[length - 1] == '*');
+        const gchar *c;
+
+        if (length == 0)
+            continue;
+        if (prefix)
+            --length;
+
+        if (result->len > 0)
+            g_string_append_c(result, ' ');
+        g_string_append_c(result, '"');
+        for (c = *word; c < *word + length; ++c) {
+            if (*c == '"')
+                g_string_append_c(result, '"');
+            g_string_append_c(result, *c);
+        }
+        g_string_append(result, prefix ? "\"*" : "\"");
+    }
+
+    g_strfreev(words);
+
+    if (result->len == 0) {
+        g_string_free(result, TRUE);
+        return NULL;
+    }
+    return g_string_free(result, FALSE);
+}
+
 /*
  * Get a long value from an integer token.
  */
@@ -651,17 +707,29 @@ ph_query_text_condition(PHQueryParserState *state,
                         const PHQueryCondition* condition,
                         GError **error)
 {
-    const gchar *sqlop = ph_query_sql_operator(condition->operator);
-    const gchar *table = ph_database_table_name(condition->type->table);
+    const gchar *sqlop, *table;
     gchar *value;
     char *sql;
 
+    if (condition->operator == PH_QUERY_TOKEN_TYPE_MATCH)
+        return ph_query_match_condition(state, condition, error);
+
+    sqlop = ph_query_sql_operator(condition->operator);
+    table = ph_database_table_name(condition->type->table);
+
     if (condition->token->type == PH_QUERY_TOKEN_TYPE_STRING)
         value = ph_query_get_string(condition->token);
     else
         value = g_strndup(condition->token->start, condition->token->length);
 
-    sql = sqlite3_mprintf("%s.%s %s %Q", table, condition->attr, sqlop, value);
+    /* long texts may be stored compressed */
+    if (strcmp(condition->attr, "summary") == 0 ||
+            strcmp(condition->attr, "description") == 0)
+        sql = sqlite3_mprintf("ph_text(%s.%s) %s %Q", table, condition->attr,
+                sqlop, value);
+    else
+        sql = sqlite3_mprintf("%s.%s %s %Q", table, condition->attr, sqlop,
+                value);
     g_string_append(state->result, sql);
     sqlite3_free(sql);
     g_free(value);
@@ -669,6 +737,64 @@ ph_query_text_condition(PHQueryParserState *state,
     return TRUE;
 }
 
+/*
+ * Search for words with the full-text indexes: "logs" in the texts of the
+ * logs, "text" in all indexed geocache columns, anything else in the column
+ * of the same name.
+ */
+static gboolean
+ph_query_match_condition(PHQueryParserState *state,
+                         const PHQueryCondition *condition,
+                         GError **error)
+{
+    gchar *value, *expression;
+    char *sql;
+
+    if (condition->operator != PH_QUERY_TOKEN_TYPE_MATCH) {
+        g_set_error(error, PH_QUERY_ERROR, PH_QUERY_ERROR_PARSER,
+                _("Can only search %s for words with @"), condition->attr);
+        return FALSE;
+    }
+    else if (strcmp(condition->attr, "id") == 0 ||
+            strcmp(condition->attr, "owner") == 0 ||
+            strcmp(condition->attr, "creator") == 0) {
+        g_set_error(error, PH_QUERY_ERROR, PH_QUERY_ERROR_PARSER,
+                _("Cannot search %s for words"), condition->attr);
+        return FALSE;
+    }
+
+    if (condition->token->type == PH_QUERY_TOKEN_TYPE_STRING)
+        value = ph_query_get_string(condition->token);
+    else
+        value = g_strndup(condition->token->start, condition->token->length);
+    expression = ph_query_match_expression(value);
+    g_free(value);
+
+    if (expression == NULL) {
+        g_set_error(error, PH_QUERY_ERROR, PH_QUERY_ERROR_PARSER,
+                _("No words to search %s for"), condition->attr);
+        return FALSE;
+    }
+
+    if (strcmp(condition->attr, "logs") == 0)
+        sql = sqlite3_mprintf("geocaches.id IN (SELECT logs.geocache_id "
+                "FROM log_text INNER JOIN logs ON logs.serial = log_text.rowid "
+                "WHERE log_text MATCH %Q)", expression);
+    else if (strcmp(condition->attr, "text") == 0)
+        sql = sqlite3_mprintf("geocaches.serial IN (SELECT rowid "
+                "FROM geocache_text WHERE geocache_text MATCH %Q)",
+                expression);
+    else
+        sql = sqlite3_mprintf("geocaches.serial IN (SELECT rowid "
+                "FROM geocache_text WHERE geocache_text MATCH '{%q} : (%q)')",
+                condition->attr, expression);
+    g_string_append(state->result, sql);
+    sqlite3_free(sql);
+    g_free(expression);
+
+    return TRUE;
+}
+
 /*
  * Match on the difficulty/terrain columns.
  */
@@ -1159,8 +1285,15 @@ ph_query_parse_boolean(PHQueryParserState *state,
         sql = sqlite3_mprintf(
                 "%s(geocaches.logged = 1 OR geocache_notes.found IS NOT NULL)",
                 (operator == PH_QUERY_TOKEN_TYPE_PLUS) ? "" : "NOT ");
+    else if (match->attribute_match &&
+            match->value < PH_GEOCACHE_ATTRS_MASK_SIZE)
+        /* test the bit in the INTEGER column "attributes_yes" or "_no" */
+        sql = sqlite3_mprintf("(%s.%s_%s & (1 << %d)) <> 0",
+                table, match->column,
+                (operator == PH_QUERY_TOKEN_TYPE_PLUS) ? "yes" : "no",
+                match->value);
     else if (match->attribute_match)
-        /* for geocache attributes, match on the TEXT column "attributes" */
+        /* for other geocache attributes, match on the TEXT column */
         sql = sqlite3_mprintf("%s.%s LIKE '%%%c%d;%%'",
                 table, match->column,
                 (operator == PH_QUERY_TOKEN_TYPE_PLUS) ? '+' : '-',
@@ -24,7 +24,6 @@ ph_trackables_load_by_geocache_id(GList **list,
                                   const gchar *id,
                                   GError **error)
 {
-    char *query;
     sqlite3_stmt *stmt;
     GList *result = NULL;
     gint status;
@@ -33,15 +32,14 @@ ph_trackables_load_by_geocache_id(GList **list,
     g_return_val_if_fail(id != NULL, FALSE);
     g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-    query = sqlite3_mprintf(
+    stmt = ph_database_prepare_cached(database,
             "SELECT id, name, geocache_id FROM trackables "
-            "WHERE geocache_id = %Q "
+            "WHERE geocache_id = ? "
             "ORDER BY name DESC",   /* building list in reverse */
-            id);
-    stmt = ph_database_prepare(database, query, error);
-    sqlite3_free(query);
+            error);
     if (stmt == NULL)
         return FALSE;
+    (void) sqlite3_bind_text(stmt, 1, id, -1, SQLITE_STATIC);
 
     while ((status = ph_database_step(database, stmt, error)) == SQLITE_ROW) {
         PHTrackable *trackable = g_new(PHTrackable, 1);
@@ -55,7 +53,7 @@ ph_trackables_load_by_geocache_id(GList **list,
         result = g_list_prepend(result, trackable);
     }
 
-    (void) sqlite3_finalize(stmt);
+    ph_database_release_cached(database, stmt);
 
     if (status == SQLITE_DONE) {
         *list = result;
@@ -68,10 +66,16 @@ ph_trackables_load_by_geocache_id(GList **list,
 }
 
 /*
- * Store the given trackable in the database.  Uses an INSERT OR REPLACE
- * statement to make sure that the trackable is only ever present in one
- * geocache; this also implies that the IDs must be unique.  Returns FALSE on
- * error.
+ * Columns written by ph_trackable_store(), starting with the primary key.
+ */
+static const gchar *const ph_trackable_columns[] = {
+    "id", "name", "geocache_id", NULL
+};
+
+/*
+ * Store the given trackable in the database.  A trackable with the same ID
+ * is updated, which makes sure that it is only ever present in one geocache,
+ * but only if anything has changed.  Returns FALSE on error.
  */
 gboolean
 ph_trackable_store(const PHTrackable *trackable,
@@ -79,14 +83,17 @@ ph_trackable_store(const PHTrackable *trackable,
                    GError **error)
 {
     char *query;
+    gchar *upsert;
     gboolean success;
 
     g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-    query = sqlite3_mprintf("INSERT OR REPLACE INTO trackables "
-            "(id, name, geocache_id) VALUES (%Q, %Q, %Q)",
-            trackable->id, trackable->name, trackable->geocache_id);
+    upsert = ph_database_upsert_clause(ph_trackable_columns, 1);
+    query = sqlite3_mprintf("INSERT INTO trackables "
+            "(id, name, geocache_id) VALUES (%Q, %Q, %Q)%s",
+            trackable->id, trackable->name, trackable->geocache_id, upsert);
     success = ph_database_exec(database, query, error);
+    g_free(upsert);
     sqlite3_free(query);
 
     return success;
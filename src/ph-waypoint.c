@@ -74,7 +74,7 @@ ph_waypoints_load_by_geocache_id(GList **list,
                                  gboolean full,
                                  GError **error)
 {
-    char *query;
+    const gchar *query;
     sqlite3_stmt *stmt;
     GList *result = NULL;
     PHWaypoint *gc_waypoint = NULL;
@@ -85,18 +85,18 @@ ph_waypoints_load_by_geocache_id(GList **list,
     g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
     if (full)
-        query = sqlite3_mprintf("SELECT id, geocache_id, name, placed, type, "
+        query = "SELECT id, geocache_id, name, placed, type, "
                 "url, summary, description, latitude, longitude, "
                 "new_latitude, new_longitude FROM waypoints_full "
-                "WHERE geocache_id = %Q ORDER BY type ASC, id ASC", id);
+                "WHERE geocache_id = ? ORDER BY type ASC, id ASC";
     else
-        query = sqlite3_mprintf("SELECT id, geocache_id, name, placed, type, "
+        query = "SELECT id, geocache_id, name, placed, type, "
                 "url, summary, description, latitude, longitude FROM waypoints "
-                "WHERE geocache_id = %Q ORDER BY type ASC, id ASC", id);
-    stmt = ph_database_prepare(database, query, error);
-    sqlite3_free(query);
+                "WHERE geocache_id = ? ORDER BY type ASC, id ASC";
+    stmt = ph_database_prepare_cached(database, query, error);
     if (stmt == NULL)
         return FALSE;
+    (void) sqlite3_bind_text(stmt, 1, id, -1, SQLITE_STATIC);
 
     while ((status = ph_database_step(database, stmt, error)) == SQLITE_ROW) {
         PHWaypoint *current = g_new(PHWaypoint, 1);
@@ -117,7 +117,7 @@ ph_waypoints_load_by_geocache_id(GList **list,
             result = g_list_prepend(result, current);
     }
 
-    (void) sqlite3_finalize(stmt);
+    ph_database_release_cached(database, stmt);
 
     if (status == SQLITE_DONE && gc_waypoint == NULL) {
         g_set_error(error, PH_DATABASE_ERROR, PH_DATABASE_ERROR_INCONSISTENT,
@@ -197,9 +197,16 @@ ph_waypoint_note_free(PHWaypointNote *note)
 /* Database storage {{{1 */
 
 /*
- * Store the given waypoint in the database.  Uses an INSERT OR REPLACE
- * statement to avoid duplicates, so the IDs must be unique.  Returns FALSE
- * on error.
+ * Columns written by ph_waypoint_store(), starting with the primary key.
+ */
+static const gchar *const ph_waypoint_columns[] = {
+    "id", "geocache_id", "name", "placed", "type", "url", "summary",
+    "description", "latitude", "longitude", NULL
+};
+
+/*
+ * Store the given waypoint in the database.  A waypoint with the same ID is
+ * updated, but only if anything has changed.  Returns FALSE on error.
  */
 gboolean
 ph_waypoint_store(const PHWaypoint *waypoint,
@@ -207,6 +214,7 @@ ph_waypoint_store(const PHWaypoint *waypoint,
                   GError **error)
 {
     char *query;
+    gchar *upsert;
     gboolean success;
     const gchar *gc_id;
 
@@ -215,14 +223,17 @@ ph_waypoint_store(const PHWaypoint *waypoint,
     gc_id = (waypoint->geocache_id == NULL)
         ? waypoint->id : waypoint->geocache_id;
 
-    query = sqlite3_mprintf("INSERT OR REPLACE INTO waypoints "
+    upsert = ph_database_upsert_clause(ph_waypoint_columns, 1);
+    query = sqlite3_mprintf("INSERT INTO waypoints "
             "(id, geocache_id, name, placed, type, url, summary, description, "
             "latitude, longitude) "
-            "VALUES (%Q, %Q, %Q, %ld, %d, %Q, %Q, %Q, %d, %d)",
+            "VALUES (%Q, %Q, %Q, %ld, %d, %Q, %Q, %Q, %d, %d)%s",
             waypoint->id, gc_id, waypoint->name, waypoint->placed,
             waypoint->type, waypoint->url, waypoint->summary,
-            waypoint->description, waypoint->latitude, waypoint->longitude);
+            waypoint->description, waypoint->latitude, waypoint->longitude,
+            upsert);
     success = ph_database_exec(database, query, error);
+    g_free(upsert);
     sqlite3_free(query);
 
     return success;
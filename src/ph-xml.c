@@ -10,11 +10,71 @@
 
 #include "ph-xml.h"
 #include <glib/gi18n.h>
+#include <string.h>
+
+/* Constants {{{1 */
+
+/*
+ * Parameters of the 32-bit FNV-1a hash function used by string matchers.
+ */
+#define PH_XML_HASH_BASIS 0x811c9dc5u
+#define PH_XML_HASH_PRIME 0x01000193u
+
+/*
+ * Minimum ratio between the number of slots and the number of strings in a
+ * string matcher.  Sparse tables make finding a perfect hash function easy.
+ */
+#define PH_XML_MATCHER_LOAD 4
+
+/*
+ * Convert ASCII letters to lowercase, like xmlStrcasecmp() does.
+ */
+#define PH_XML_ASCII_LOWER(c) \
+    (((c) >= 'A' && (c) <= 'Z') ? (c) - 'A' + 'a' : (c))
+
+/* Data structures {{{1 */
+
+/*
+ * Slot of the hash table used by ph_xml_string_matcher_find().
+ */
+typedef struct _PHXmlStringSlot {
+    const gchar *key;       /* lowercase string, or NULL for empty slots */
+    gsize length;           /* length of key */
+    gint value;             /* result of ph_xml_find_string() for key */
+} PHXmlStringSlot;
+
+struct _PHXmlStringMatcher {
+    const PHXmlStringTable *table;  /* table the matcher was built from */
+    PHXmlStringSlot *slots;         /* hash table */
+    guint32 mask;                   /* number of slots minus one */
+    guint32 seed;                   /* makes the hash function perfect */
+};
 
 /* Forward declarations {{{1 */
 
 static gboolean ph_xml_string_starts(const gchar *haystack,
                                      const gchar *needle);
+static guint32 ph_xml_string_hash(const xmlChar *text,
+                                  guint32 seed,
+                                  gsize *length);
+
+static gint ph_xml_parse_digits(const xmlChar *text,
+                                guint count);
+static glong ph_xml_days_from_civil(gint year,
+                                    gint month,
+                                    gint day);
+static glong ph_xml_parse_time_fallback(const xmlChar *text);
+
+static gboolean ph_xml_enter_text(xmlTextReaderPtr reader,
+                                  int *depth,
+                                  const xmlChar **text,
+                                  GError **error);
+static gboolean ph_xml_leave_text(xmlTextReaderPtr reader,
+                                  int depth,
+                                  GError **error);
+static const xmlChar *ph_xml_attrib_peek(xmlTextReaderPtr reader,
+                                         const xmlChar *attrib,
+                                         GError **error);
 
 /* Mapping strings to numbers {{{1 */
 
@@ -70,114 +130,442 @@ ph_xml_find_string(const PHXmlStringTable *haystack,
     return 0;
 }
 
+/* Compiled string tables {{{1 */
+
+/*
+ * Hash the ASCII-lowercase version of a string, storing its length in
+ * length.
+ */
+static guint32
+ph_xml_string_hash(const xmlChar *text,
+                   guint32 seed,
+                   gsize *length)
+{
+    guint32 hash = PH_XML_HASH_BASIS ^ seed;
+    const xmlChar *cur;
+
+    for (cur = text; *cur != '\0'; ++cur) {
+        hash ^= PH_XML_ASCII_LOWER(*cur);
+        hash *= PH_XML_HASH_PRIME;
+    }
+
+    *length = cur - text;
+    return hash;
+}
+
+/*
+ * Compile a string table into a perfect hash table containing every string
+ * mentioned in it.  The value of each of these strings is determined using
+ * ph_xml_find_string() in advance, so lookups of known strings, which make up
+ * almost all of the input, need a single pass over the needle and return
+ * exactly what the table would.  Anything else falls back to
+ * ph_xml_find_string().  The table has to stay alive as long as the matcher.
+ */
+PHXmlStringMatcher *
+ph_xml_string_matcher_new(const PHXmlStringTable *table)
+{
+    PHXmlStringMatcher *result;
+    GPtrArray *keys = g_ptr_array_new_with_free_func(g_free);
+    const PHXmlStringTable *cur;
+    guint i, size;
+
+    g_return_val_if_fail(table != NULL, NULL);
+
+    /* collect the strings in lowercase, without their match prefixes */
+    for (cur = table; cur->value != 0; ++cur) {
+        if (cur->primary != NULL)
+            g_ptr_array_add(keys, g_ascii_strdown(cur->primary, -1));
+        if (cur->alt != NULL)
+            g_ptr_array_add(keys, g_ascii_strdown(cur->alt + 1, -1));
+    }
+
+    for (size = 1; size < PH_XML_MATCHER_LOAD * MAX(keys->len, 1); size *= 2)
+        ;
+
+    result = g_new0(PHXmlStringMatcher, 1);
+    result->table = table;
+    result->mask = size - 1;
+    result->slots = g_new0(PHXmlStringSlot, size);
+
+    /* try seeds until no two distinct keys share a slot */
+    for (;;) {
+        gboolean perfect = TRUE;
+
+        memset(result->slots, 0, size * sizeof(PHXmlStringSlot));
+        for (i = 0; perfect && i < keys->len; ++i) {
+            const gchar *key = g_ptr_array_index(keys, i);
+            PHXmlStringSlot *slot;
+            gsize length;
+
+            slot = &result->slots[ph_xml_string_hash((const xmlChar *) key,
+                    result->seed, &length) & result->mask];
+            if (slot->key == NULL) {
+                slot->key = key;
+                slot->length = length;
+                slot->value = ph_xml_find_string(table, (const xmlChar *) key);
+            }
+            else
+                perfect = (strcmp(slot->key, key) == 0);
+        }
+
+        if (perfect)
+            break;
+        ++result->seed;
+    }
+
+    /* the slots point into keys, so keep the strings */
+    for (i = 0; i <= result->mask; ++i) {
+        if (result->slots[i].key != NULL)
+            result->slots[i].key = g_strdup(result->slots[i].key);
+    }
+    g_ptr_array_free(keys, TRUE);
+
+    return result;
+}
+
+/*
+ * Free a matcher.  No-op for NULL.
+ */
+void
+ph_xml_string_matcher_free(PHXmlStringMatcher *matcher)
+{
+    guint i;
+
+    if (matcher == NULL)
+        return;
+
+    for (i = 0; i <= matcher->mask; ++i)
+        g_free((gchar *) matcher->slots[i].key);
+    g_free(matcher->slots);
+    g_free(matcher);
+}
+
+/*
+ * Look up needle like ph_xml_find_string() does in the table the matcher was
+ * built from.  Returns 0 if needle cannot be found.
+ */
+gint
+ph_xml_string_matcher_find(const PHXmlStringMatcher *matcher,
+                           const xmlChar *needle)
+{
+    const PHXmlStringSlot *slot;
+    gsize length, i;
+
+    g_return_val_if_fail(matcher != NULL, 0);
+
+    if (needle == NULL)
+        return 0;
+
+    slot = &matcher->slots[ph_xml_string_hash(needle, matcher->seed,
+            &length) & matcher->mask];
+
+    if (slot->key != NULL && slot->length == length) {
+        for (i = 0; i < length &&
+                PH_XML_ASCII_LOWER(needle[i]) == (guchar) slot->key[i]; ++i)
+            ;
+        if (i == length)
+            return slot->value;
+    }
+
+    return ph_xml_find_string(matcher->table, needle);
+}
+
+/* Parsing timestamps {{{1 */
+
+/*
+ * Convert an ISO 8601 timestamp to seconds since the epoch, giving the same
+ * result as g_time_val_from_iso8601().  Fractional seconds are ignored.  The
+ * formats written by Groundspeak and Opencaching, YYYY-MM-DDThh:mm:ss with
+ * an optional fraction followed by Z or a numeric offset, are handled
+ * directly; anything else, including local times, is left to GLib.
+ * Unparseable input yields 0.
+ */
+glong
+ph_xml_parse_time(const xmlChar *text)
+{
+    static const gint month_days[] = {
+        31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+    };
+    const xmlChar *cur = text;
+    gint year, month, day, hour, minute, second;
+    glong offset = 0;
+
+    g_return_val_if_fail(text != NULL, 0);
+
+    /* stop at the first short field, so nothing past the end is read */
+    if ((year = ph_xml_parse_digits(cur, 4)) < 0 || cur[4] != '-' ||
+            (month = ph_xml_parse_digits(cur + 5, 2)) < 0 || cur[7] != '-' ||
+            (day = ph_xml_parse_digits(cur + 8, 2)) < 0 || cur[10] != 'T' ||
+            (hour = ph_xml_parse_digits(cur + 11, 2)) < 0 || cur[13] != ':' ||
+            (minute = ph_xml_parse_digits(cur + 14, 2)) < 0 ||
+            cur[16] != ':' || (second = ph_xml_parse_digits(cur + 17, 2)) < 0)
+        return ph_xml_parse_time_fallback(text);
+
+    /* leave normalization of out-of-range values to GLib */
+    if (month < 1 || month > 12 || day < 1 || day > month_days[month - 1] ||
+            hour > 23 || minute > 59 || second > 59)
+        return ph_xml_parse_time_fallback(text);
+    if (month == 2 && day == 29 &&
+            (year % 4 != 0 || (year % 100 == 0 && year % 400 != 0)))
+        return ph_xml_parse_time_fallback(text);
+    cur += 19;
+
+    if (*cur == '.' || *cur == ',') {
+        while (g_ascii_isdigit(*++cur))
+            ;
+    }
+
+    if (*cur == 'Z')
+        ++cur;
+    else if (*cur == '+' || *cur == '-') {
+        gint sign = (*cur == '+') ? -1 : 1;
+        gint hours = ph_xml_parse_digits(cur + 1, 2), minutes;
+
+        if (hours < 0)
+            return ph_xml_parse_time_fallback(text);
+        else if (cur[3] == ':') {
+            minutes = ph_xml_parse_digits(cur + 4, 2);
+            cur += 6;
+        }
+        else {
+            minutes = ph_xml_parse_digits(cur + 3, 2);
+            cur += 5;
+        }
+        if (minutes < 0)
+            return ph_xml_parse_time_fallback(text);
+        offset = sign * 60 * (60 * hours + minutes);
+    }
+    else
+        return ph_xml_parse_time_fallback(text);
+
+    if (*cur != '\0')
+        return ph_xml_parse_time_fallback(text);
+
+    return ((ph_xml_days_from_civil(year, month, day) * 24 + hour) * 60 +
+            minute) * 60 + second + offset;
+}
+
+/*
+ * Read exactly count decimal digits.  Returns -1 if there are fewer.
+ */
+static gint
+ph_xml_parse_digits(const xmlChar *text,
+                    guint count)
+{
+    gint result = 0;
+    guint i;
+
+    for (i = 0; i < count; ++i) {
+        if (!g_ascii_isdigit(text[i]))
+            return -1;
+        result = 10 * result + (text[i] - '0');
+    }
+
+    return result;
+}
+
+/*
+ * Count the days between 1970-01-01 and the given date of the proleptic
+ * Gregorian calendar.
+ */
+static glong
+ph_xml_days_from_civil(gint year,
+                       gint month,
+                       gint day)
+{
+    gint era, year_of_era, day_of_year;
+
+    /* let the year start in March, so the leap day comes last */
+    year -= (month <= 2);
+    era = (year >= 0 ? year : year - 399) / 400;
+    year_of_era = year - era * 400;
+    day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+
+    return (glong) era * 146097 + year_of_era * 365 + year_of_era / 4 -
+        year_of_era / 100 + day_of_year - 719468;
+}
+
+/*
+ * Let GLib parse an unusual timestamp.
+ */
+static glong
+ph_xml_parse_time_fallback(const xmlChar *text)
+{
+    GTimeVal result = {0, 0};
+
+    (void) g_time_val_from_iso8601((const gchar *) text, &result);
+    return result.tv_sec;
+}
+
 /* Process XML text {{{1 */
 
 /*
- * Get the text content of an element and return it in result.  Positions the
- * reader on the closing tag.  result will be NULL on error, in which case the
- * return value will be FALSE, and "" for empty elements.  The caller is
- * responsible for xmlFree()ing the string.
+ * Advance to the first text node inside the current element and point text
+ * to its value, which stays valid until the reader moves on.  text is "" for
+ * empty elements and NULL if there is no text at all.  depth receives the
+ * argument for ph_xml_leave_text().  Returns FALSE on error.
  */
-gboolean
-ph_xml_extract_text(xmlTextReaderPtr reader,
-                    xmlChar **result,
-                    GError **error)
+static gboolean
+ph_xml_enter_text(xmlTextReaderPtr reader,
+                  int *depth,
+                  const xmlChar **text,
+                  GError **error)
 {
-    int rc, depth;
+    int rc;
+
+    *depth = xmlTextReaderDepth(reader);
+    *text = NULL;
 
     if (xmlTextReaderIsEmptyElement(reader)) {
-        *result = xmlCharStrdup("");
+        *text = (const xmlChar *) "";
         return TRUE;
     }
 
-    /* overwrite prior values without leaking memory */
-    if (*result != NULL) {
-        xmlFree(*result);
-        *result = NULL;
-    }
-
-    depth = xmlTextReaderDepth(reader);
     do {
         rc = xmlTextReaderRead(reader);
-        if (rc == -1) {
-            xmlFree(*result);
-            *result = NULL;
+        if (rc == -1)
             return ph_xml_set_last_error(error);
-        }
-        else if (*result == NULL && xmlTextReaderHasValue(reader))
+        else if (xmlTextReaderHasValue(reader)) {
             /* only return content of the first text node */
-            *result = xmlTextReaderValue(reader);
-    } while (xmlTextReaderDepth(reader) > depth);
+            *text = xmlTextReaderConstValue(reader);
+            return TRUE;
+        }
+    } while (xmlTextReaderDepth(reader) > *depth);
+
+    return TRUE;
+}
+
+/*
+ * Skip the rest of the element entered with ph_xml_enter_text(), leaving the
+ * reader on its closing tag.  Returns FALSE on error.
+ */
+static gboolean
+ph_xml_leave_text(xmlTextReaderPtr reader,
+                  int depth,
+                  GError **error)
+{
+    while (xmlTextReaderDepth(reader) > depth) {
+        if (xmlTextReaderRead(reader) == -1)
+            return ph_xml_set_last_error(error);
+    }
 
     return TRUE;
 }
 
 /*
- * Directly obtain a double value from ph_xml_extract_text().  Returns FALSE
- * on error.
+ * Get the text content of an element and copy it into arena.  Positions the
+ * reader on the closing tag.  result will be NULL on error, in which case the
+ * return value will be FALSE, and "" for empty elements.
+ */
+gboolean
+ph_xml_extract_text(xmlTextReaderPtr reader,
+                    PHArena *arena,
+                    gchar **result,
+                    GError **error)
+{
+    const xmlChar *text;
+    int depth;
+
+    *result = NULL;
+    if (!ph_xml_enter_text(reader, &depth, &text, error))
+        return FALSE;
+    *result = ph_arena_strdup(arena, (const gchar *) text);
+    if (!ph_xml_leave_text(reader, depth, error)) {
+        *result = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Interpret the text content of an element as a double value.  Missing text
+ * yields 0.  Returns FALSE on error.
  */
 gboolean
 ph_xml_extract_double(xmlTextReaderPtr reader,
                       gdouble *result,
                       GError **error)
 {
-    xmlChar *text = NULL;
+    const xmlChar *text;
+    int depth;
 
-    if (ph_xml_extract_text(reader, &text, error)) {
-        *result = g_ascii_strtod((gchar *) text, NULL);
-        xmlFree(text);
-        return TRUE;
-    }
-    else
+    if (!ph_xml_enter_text(reader, &depth, &text, error))
         return FALSE;
+    *result = (text == NULL) ? 0 : g_ascii_strtod((const gchar *) text, NULL);
+    return ph_xml_leave_text(reader, depth, error);
 }
 
 /*
- * Run the result of ph_xml_extract_text() through ph_xml_find_string(), using
- * the given haystack and storing the obtained value in result.  Returns FALSE
- * on error.
+ * Run the text content of an element through ph_xml_string_matcher_find(),
+ * storing the obtained value in result.  Returns FALSE on error.
  */
 gboolean
 ph_xml_extract_value(xmlTextReaderPtr reader,
-                     const PHXmlStringTable *haystack,
+                     const PHXmlStringMatcher *matcher,
                      gint *result,
                      GError **error)
 {
-    xmlChar *needle = NULL;
+    const xmlChar *text;
+    int depth;
 
-    if (ph_xml_extract_text(reader, &needle, error)) {
-        *result = ph_xml_find_string(haystack, needle);
-        xmlFree(needle);
-        return TRUE;
-    }
-    else
+    if (!ph_xml_enter_text(reader, &depth, &text, error))
         return FALSE;
+    *result = ph_xml_string_matcher_find(matcher, text);
+    return ph_xml_leave_text(reader, depth, error);
 }
 
 /*
- * Directly obtain a UNIX timestamp from ph_xml_extract_text().  Assumes that
- * the time value is encoded in ISO 8601 format.  Returns FALSE on error.
+ * Obtain a UNIX timestamp from the text content of an element using
+ * ph_xml_parse_time().  Missing text yields 0.  Returns FALSE on error.
  */
 gboolean
 ph_xml_extract_time(xmlTextReaderPtr reader,
                     glong *result,
                     GError **error)
 {
-    xmlChar *text = NULL;
+    const xmlChar *text;
+    int depth;
 
-    if (ph_xml_extract_text(reader, &text, error)) {
-        GTimeVal tmp;
-        (void) g_time_val_from_iso8601((gchar *) text, &tmp);
-        *result = tmp.tv_sec;
-        xmlFree(text);
-        return TRUE;
-    }
-    else
+    if (!ph_xml_enter_text(reader, &depth, &text, error))
         return FALSE;
+    *result = (text == NULL) ? 0 : ph_xml_parse_time(text);
+    return ph_xml_leave_text(reader, depth, error);
 }
 
 /* Process XML attributes {{{1 */
 
+/*
+ * Look up an attribute of the current element without copying it.  The
+ * value stays valid until the reader moves on.  Returns NULL if the
+ * attribute is missing, setting error in that case.
+ */
+static const xmlChar *
+ph_xml_attrib_peek(xmlTextReaderPtr reader,
+                   const xmlChar *attrib,
+                   GError **error)
+{
+    const xmlChar *result = NULL;
+
+    if (xmlTextReaderMoveToAttribute(reader, attrib) == 1) {
+        result = xmlTextReaderConstValue(reader);
+        (void) xmlTextReaderMoveToElement(reader);
+    }
+
+    if (result == NULL) {
+        if (xmlGetLastError() != NULL)
+            (void) ph_xml_set_last_error(error);
+        else
+            g_set_error(error,
+                    PH_XML_ERROR, PH_XML_ERROR_PARSE,
+                    _("Missing attribute `%s' on <%s> on line %d"),
+                    (gchar *) attrib, (gchar *) xmlTextReaderConstName(reader),
+                    xmlTextReaderGetParserLineNumber(reader));
+    }
+
+    return result;
+}
+
 /*
  * Check if the named XML attribute has the expected value.  Returns TRUE if
  * it does, FALSE if the attribute is either not present or not equal.
@@ -187,41 +575,31 @@ ph_xml_attrib_compare(xmlTextReaderPtr reader,
                       const xmlChar *attrib,
                       const xmlChar *value)
 {
-    xmlChar *text;
-    gboolean matches;
+    const xmlChar *text = NULL;
+
+    if (xmlTextReaderMoveToAttribute(reader, attrib) == 1) {
+        text = xmlTextReaderConstValue(reader);
+        (void) xmlTextReaderMoveToElement(reader);
+    }
 
-    text = xmlTextReaderGetAttribute(reader, attrib);
-    matches = (xmlStrcasecmp(text, value) == 0);
-    xmlFree(text);
-    return matches;
+    return (xmlStrcasecmp(text, value) == 0);
 }
 
 /*
- * Get an attribute of an XML element and store it in result.  The caller is
- * responsible for invoking xmlFree() afterwards.  On error, result will be
- * NULL and the return value FALSE.
+ * Get an attribute of an XML element and copy it into arena.  On error,
+ * result will be NULL and the return value FALSE.
  */
 gboolean
 ph_xml_attrib_text(xmlTextReaderPtr reader,
+                   PHArena *arena,
                    const xmlChar *attrib,
-                   xmlChar **result,
+                   gchar **result,
                    GError **error)
 {
-    if (*result != NULL)
-        xmlFree(*result);
-    *result = xmlTextReaderGetAttribute(reader, attrib);
-    if (*result == NULL) {
-        if (xmlGetLastError() != NULL)
-            (void) ph_xml_set_last_error(error);
-        else
-            g_set_error(error,
-                    PH_XML_ERROR, PH_XML_ERROR_PARSE,
-                    _("Missing attribute `%s' on <%s> on line %d"),
-                    (gchar *) attrib, (gchar *) xmlTextReaderConstName(reader),
-                    xmlTextReaderGetParserLineNumber(reader));
-        return FALSE;
-    }
-    return TRUE;
+    const xmlChar *text = ph_xml_attrib_peek(reader, attrib, error);
+
+    *result = ph_arena_strdup(arena, (const gchar *) text);
+    return (text != NULL);
 }
 
 /*
@@ -234,15 +612,12 @@ ph_xml_attrib_int(xmlTextReaderPtr reader,
                   gint *result,
                   GError **error)
 {
-    xmlChar *text = NULL;
+    const xmlChar *text = ph_xml_attrib_peek(reader, attrib, error);
 
-    if (ph_xml_attrib_text(reader, attrib, &text, error)) {
-        *result = atoi((gchar *) text);
-        xmlFree(text);
-        return TRUE;
-    }
-    else
+    if (text == NULL)
         return FALSE;
+    *result = atoi((const gchar *) text);
+    return TRUE;
 }
 
 /*
@@ -255,15 +630,12 @@ ph_xml_attrib_double(xmlTextReaderPtr reader,
                      gdouble *result,
                      GError **error)
 {
-    xmlChar *text = NULL;
+    const xmlChar *text = ph_xml_attrib_peek(reader, attrib, error);
 
-    if (ph_xml_attrib_text(reader, attrib, &text, error)) {
-        *result = g_ascii_strtod((gchar *) text, NULL);
-        xmlFree(text);
-        return TRUE;
-    }
-    else
+    if (text == NULL)
         return FALSE;
+    *result = g_ascii_strtod((const gchar *) text, NULL);
+    return TRUE;
 }
 
 /* Error reporting {{{1 */
@@ -287,11 +659,10 @@ ph_xml_set_last_error(GError **error)
     xmlErrorPtr err = xmlGetLastError();
 
     g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-    g_return_val_if_fail(err != NULL, FALSE);
 
     g_set_error_literal(error,
             PH_XML_ERROR, PH_XML_ERROR_PARSE,
-            err->message);
+            (err != NULL) ? err->message : _("Unknown parser error"));
     return FALSE;
 }
 
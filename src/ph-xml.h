@@ -13,6 +13,7 @@
 
 /* Includes {{{1 */
 
+#include "ph-arena.h"
 #include <glib.h>
 #include <libxml/xmlreader.h>
 
@@ -31,16 +32,31 @@ typedef struct _PHXmlStringTable {
 gint ph_xml_find_string(const PHXmlStringTable *haystack,
                         const xmlChar *needle);
 
+/*
+ * String table compiled for fast lookups.
+ */
+typedef struct _PHXmlStringMatcher PHXmlStringMatcher;
+
+PHXmlStringMatcher *ph_xml_string_matcher_new(const PHXmlStringTable *table);
+void ph_xml_string_matcher_free(PHXmlStringMatcher *matcher);
+gint ph_xml_string_matcher_find(const PHXmlStringMatcher *matcher,
+                                const xmlChar *needle);
+
+/* Parsing timestamps {{{1 */
+
+glong ph_xml_parse_time(const xmlChar *text);
+
 /* Processing XML text {{{1 */
 
 gboolean ph_xml_extract_text(xmlTextReaderPtr reader,
-                             xmlChar **result,
+                             PHArena *arena,
+                             gchar **result,
                              GError **error);
 gboolean ph_xml_extract_double(xmlTextReaderPtr reader,
                                gdouble *result,
                                GError **error);
 gboolean ph_xml_extract_value(xmlTextReaderPtr reader,
-                              const PHXmlStringTable *haystack,
+                              const PHXmlStringMatcher *matcher,
                               gint *result,
                               GError **error);
 gboolean ph_xml_extract_time(xmlTextReaderPtr reader,
@@ -53,8 +69,9 @@ gboolean ph_xml_attrib_compare(xmlTextReaderPtr reader,
                                const xmlChar *attrib,
                                const xmlChar *value);
 gboolean ph_xml_attrib_text(xmlTextReaderPtr reader,
+                            PHArena *arena,
                             const xmlChar *attrib,
-                            xmlChar **result,
+                            gchar **result,
                             GError **error);
 gboolean ph_xml_attrib_int(xmlTextReaderPtr reader,
                            const xmlChar *attrib,